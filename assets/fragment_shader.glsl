@@ -9,11 +9,19 @@ in vec2 UV2;
 
 out vec4 outColor;
 
-uniform float alphaCutoff;
+// Pro Draw-Aufruf, muss zu DrawDaten in draw_list.hpp und zum Vertex-Shader passen
+layout(std140) uniform DrawDaten {
+  mat4 model;
+  mat4 nor;
+  vec4 diffuseColor;
+  vec4 emissiveColor;
+  float alphaCutoff;
+  int texVoreinstellung;
+  int numTextures;
+};
+
 uniform sampler2D tex1;
 uniform sampler2D tex2;
-uniform int numTextures;
-uniform int texVoreinstellung;
 
 void main() {
   vec4 texColor = texture(tex1, UV1);
@@ -22,7 +30,7 @@ void main() {
     discard;
   }
 
-  if (texVoreinstellung == 3) {
+  if (texVoreinstellung == 3 && numTextures > 1) {
     // Tex 1 Standard, Tex 2 transparent
     vec4 tex2Color = texture(tex2, UV2);
     texColor = mix(texColor, tex2Color, tex2Color.a);
@@ -12,20 +12,41 @@ out vec4 EmissiveColor;
 out vec2 UV1;
 out vec2 UV2;
 
-uniform mat4 nor;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
-uniform mat4 shear;
-uniform vec4 diffuseColor;
-uniform vec4 emissiveColor;
+// Pro Instanz: Modellmatrix (4 Texel), dann Normalenmatrix (4 Texel)
+uniform samplerBuffer instances;
+
+// Pro Draw-Aufruf, muss zu DrawDaten in draw_list.hpp und zum Fragment-Shader passen
+layout(std140) uniform DrawDaten {
+  mat4 model;  // Transformation des Subsets relativ zur Instanz
+  mat4 nor;
+  vec4 diffuseColor;
+  vec4 emissiveColor;
+  float alphaCutoff;
+  int texVoreinstellung;
+  int numTextures;
+};
+
+// proj * shear * view
+uniform mat4 viewProj;
 
 void main() {
-  Normal = vec3(nor * vec4(normal, 0.0));
+  int base = gl_InstanceID * 8;
+  mat4 instanceModel = mat4(
+      texelFetch(instances, base),
+      texelFetch(instances, base + 1),
+      texelFetch(instances, base + 2),
+      texelFetch(instances, base + 3));
+  mat4 instanceNor = mat4(
+      texelFetch(instances, base + 4),
+      texelFetch(instances, base + 5),
+      texelFetch(instances, base + 6),
+      texelFetch(instances, base + 7));
+
+  Normal = vec3(instanceNor * nor * vec4(normal, 0.0));
   DiffuseColor = diffuseColor;
   EmissiveColor = emissiveColor;
   UV1 = uv1;
   UV2 = uv2;
-  gl_Position = proj * shear * view * model * vec4(position, 1.0);
+  gl_Position = viewProj * instanceModel * model * vec4(position, 1.0);
 }
 )""
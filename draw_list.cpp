@@ -0,0 +1,236 @@
+#include "./draw_list.hpp"
+
+#include "./gl_state.hpp"
+#include "./macros.hpp"
+#include "./render_object.hpp"
+#include "./shader_parameters.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+// So weit sucht sort() hoechstens nach einem Record mit gleichem Zustand zurueck (in Laeufen gleichen Zustands).
+constexpr size_t kMaxLaeufeZurueck = 32;
+// Abstand, ab dem zwei Bounding Boxes als getrennt gelten; darunter koennten sich Tiefenwerte gleichen.
+constexpr float kMindestAbstand = 1e-3f;
+
+uint64_t zustandsSchluessel(const DrawRecord& record) {
+  const auto textur = [&record](size_t j) -> uint64_t {
+    return j < record.textures->size() ? (*record.textures)[j]->id() : 0;
+  };
+  // Teure Zustandswechsel (Texturen) in die hoeherwertigen Bits
+  return (static_cast<uint64_t>(record.texVoreinstellung & 0xff) << 56)
+    | ((textur(0) & 0xffffff) << 32)
+    | ((textur(1) & 0xffff) << 16)
+    | (record.instanceTexture & 0xffff);
+}
+
+bool getrennt(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax) {
+  for (int achse = 0; achse < 3; achse++) {
+    if (aMin[achse] > bMax[achse] + kMindestAbstand || bMin[achse] > aMax[achse] + kMindestAbstand) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Aufeinanderfolgende Records mit gleichem Zustand in der sortierten Reihenfolge
+struct Lauf {
+  uint32_t gruppe;
+  uint64_t zustand;
+  glm::vec3 boxMin;
+  glm::vec3 boxMax;
+  std::optional<GLfloat> polygonOffset;  // nullopt, wenn die Records verschiedene haben
+  std::vector<size_t> records;
+};
+
+}  // namespace
+
+DrawList::DrawList() : m_records(), m_gruppe(0), m_zOffsetSumme(), m_uniformBuffer(), m_weisseTextur() {}
+
+DrawList::~DrawList() {
+  glDeleteBuffers(1, &m_uniformBuffer);
+  glDeleteTextures(1, &m_weisseTextur);
+}
+
+void DrawList::clear() {
+  m_records.clear();
+  m_gruppe = 0;
+  m_zOffsetSumme.reset();
+}
+
+void DrawList::add(const RenderObject& renderObject) {
+  const int zOffsetSumme = renderObject.getSubsetZOffsetSumme();
+  if (m_zOffsetSumme && *m_zOffsetSumme != zOffsetSumme) {
+    m_gruppe++;
+  }
+  m_zOffsetSumme = zOffsetSumme;
+
+  const size_t start = m_records.size();
+  renderObject.appendDrawRecords(&m_records);
+
+  for (auto it = std::next(std::begin(m_records), start); it != std::end(m_records); ++it) {
+    if (it->blend) {
+      // Geblendete Records bilden eine eigene Gruppe und trennen die deckenden davor und danach
+      it->gruppe = ++m_gruppe;
+      ++m_gruppe;
+    } else {
+      it->gruppe = m_gruppe;
+    }
+    it->zustand = zustandsSchluessel(*it);
+  }
+}
+
+void DrawList::sort() {
+  // Ein Record wird nur an Laeufen vorbeigezogen, deren Bounding Box er nicht ueberlappt und deren Polygon-Offset
+  // gleich ist. Dort kann kein Pixel von beiden mit gleichem Tiefenwert getroffen werden, die Reihenfolge ist also egal.
+  // Die Reihenfolge bereits einsortierter Records aendert sich dabei nie.
+  std::vector<Lauf> laeufe;
+  for (size_t r = 0; r < m_records.size(); r++) {
+    const DrawRecord& record = m_records[r];
+    Lauf* ziel = nullptr;
+    for (size_t k = laeufe.size(), schritte = 0; k > 0 && schritte < kMaxLaeufeZurueck; k--, schritte++) {
+      Lauf& lauf = laeufe[k - 1];
+      if (lauf.gruppe != record.gruppe) {
+        break;
+      }
+      if (lauf.zustand == record.zustand) {
+        ziel = &lauf;
+        break;
+      }
+      if (lauf.polygonOffset != record.polygonOffset || !getrennt(lauf.boxMin, lauf.boxMax, record.boxMin, record.boxMax)) {
+        break;
+      }
+    }
+
+    if (!ziel) {
+      laeufe.push_back(Lauf { record.gruppe, record.zustand, record.boxMin, record.boxMax, record.polygonOffset, {} });
+      ziel = &laeufe.back();
+    } else {
+      ziel->boxMin = glm::min(ziel->boxMin, record.boxMin);
+      ziel->boxMax = glm::max(ziel->boxMax, record.boxMax);
+      if (ziel->polygonOffset != record.polygonOffset) {
+        ziel->polygonOffset.reset();
+      }
+    }
+    ziel->records.push_back(r);
+  }
+
+  std::vector<DrawRecord> sortiert;
+  sortiert.reserve(m_records.size());
+  for (const auto& lauf : laeufe) {
+    for (size_t r : lauf.records) {
+      sortiert.push_back(m_records[r]);
+    }
+  }
+  m_records = std::move(sortiert);
+}
+
+bool DrawList::upload(const ShaderParameters& shaderParameters) {
+  if (m_records.empty()) {
+    return true;
+  }
+
+  GLint alignment = 0;
+  TRY(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+  alignment = std::max(alignment, 1);
+  const size_t stride = (sizeof(DrawDaten) + alignment - 1) / alignment * alignment;
+
+  std::vector<unsigned char> daten;
+  daten.reserve(m_records.size() * stride);
+  DrawDaten vorher {};
+  for (auto& record : m_records) {
+    DrawDaten d {};
+    d.model = *record.model;
+    d.nor = *record.nor;
+    d.diffuseColor = record.diffuseColor;
+    d.emissiveColor = record.emissiveColor;
+    d.alphaCutoff = record.alphaCutoff;
+    d.texVoreinstellung = record.texVoreinstellung;
+    d.numTextures = std::min(record.textures->size(), shaderParameters.uni_tex.size());
+
+    if (daten.empty() || std::memcmp(&d, &vorher, sizeof(DrawDaten)) != 0) {
+      daten.resize(daten.size() + stride);
+      std::memcpy(daten.data() + daten.size() - stride, &d, sizeof(DrawDaten));
+      vorher = d;
+    }
+    record.drawDatenOffset = daten.size() - stride;
+  }
+
+  if (!m_uniformBuffer) {
+    TRY(glGenBuffers(1, &m_uniformBuffer));
+  }
+  if (!m_weisseTextur) {
+    const GLubyte weiss[4] = { 255, 255, 255, 255 };
+    TRY(glGenTextures(1, &m_weisseTextur));
+    TRY(glBindTexture(GL_TEXTURE_2D, m_weisseTextur));
+    TRY(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, weiss));
+    TRY(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    TRY(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    TRY(glBindTexture(GL_TEXTURE_2D, 0));
+  }
+  TRY(glBindBuffer(GL_UNIFORM_BUFFER, m_uniformBuffer));
+  TRY(glBufferData(GL_UNIFORM_BUFFER, daten.size(), daten.data(), GL_STATIC_DRAW));
+  TRY(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+  return true;
+}
+
+bool DrawList::render(const ShaderParameters& shaderParameters) const {
+  // Der Zustand vor dem ersten Record ist unbekannt, deshalb wird alles einmal gesetzt.
+  GLStateTracker state;
+  if (!state.blendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA)) {
+    return false;
+  }
+
+  for (const auto& record : m_records) {
+    if (!state.bindTexture(kInstanceTextureUnit, GL_TEXTURE_BUFFER, record.instanceTexture)) {
+      return false;
+    }
+    const size_t numTextures = std::min(record.textures->size(), shaderParameters.uni_tex.size());
+    for (size_t j = 0; j < numTextures; j++) {
+      if (!state.bindTexture(j, GL_TEXTURE_2D, (*record.textures)[j]->id())) {
+        return false;
+      }
+    }
+    if (numTextures == 0 && !state.bindTexture(0, GL_TEXTURE_2D, m_weisseTextur)) {
+      return false;
+    }
+    if (!state.bindBufferRange(GL_UNIFORM_BUFFER, kDrawDatenBinding, m_uniformBuffer, record.drawDatenOffset, sizeof(DrawDaten))
+        || !state.polygonOffset(0, record.polygonOffset)
+        || !state.setEnabled(GL_BLEND, record.blend)) {
+      return false;
+    }
+
+#ifndef NDEBUG
+    std::cerr << "Drawing " << record.drawCount << " subsets (" << record.instanceCount << " instances)" << std::endl;
+#endif
+    if (record.instanceCount > 1) {
+      for (GLsizei k = 0; k < record.drawCount; k++) {
+        TRY(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, record.counts[k], GL_UNSIGNED_SHORT, record.indexOffsets[k], record.instanceCount, record.baseVertices[k]));
+      }
+    } else if (record.drawCount == 1) {
+      TRY(glDrawElementsBaseVertex(GL_TRIANGLES, record.counts[0], GL_UNSIGNED_SHORT, record.indexOffsets[0], record.baseVertices[0]));
+    } else {
+      // const_cast: older GLEW versions declare the array parameters as non-const
+      TRY(glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+            const_cast<GLsizei*>(record.counts),
+            GL_UNSIGNED_SHORT,
+            const_cast<void**>(record.indexOffsets),
+            record.drawCount,
+            const_cast<GLint*>(record.baseVertices)));
+    }
+  }
+
+  return true;
+}
+
+}
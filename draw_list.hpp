@@ -0,0 +1,100 @@
+#pragma once
+
+#include "./texture_manager.hpp"
+
+#include <glm/glm.hpp>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace ls3render {
+
+class RenderObject;
+struct ShaderParameters;
+
+// Inhalt des Uniform-Blocks DrawDaten (Layout std140), muss zu den Shadern passen.
+struct DrawDaten {
+  glm::mat4 model;
+  glm::mat4 nor;
+  glm::vec4 diffuseColor;
+  glm::vec4 emissiveColor;
+  GLfloat alphaCutoff;
+  GLint texVoreinstellung;
+  GLint numTextures;
+  GLint padding;
+};
+static_assert(sizeof(DrawDaten) == 176, "DrawDaten does not match std140 layout");
+
+// Ein Draw-Aufruf (ein Batch gleichartiger Subsets aller Instanzen eines Render-Objekts)
+// mit allen Uniforms und Render-States, die beim Kompilieren der Szene bereits feststehen.
+struct DrawRecord {
+  // Records mit gleicher Gruppe duerfen untereinander umsortiert werden, Gruppen nicht.
+  uint32_t gruppe;
+  // Records mit gleichem Zustand werden moeglichst hintereinander gezeichnet.
+  uint64_t zustand;
+  // Bounding Box der gezeichneten Subsets aller Instanzen (Weltkoordinaten)
+  glm::vec3 boxMin;
+  glm::vec3 boxMax;
+
+  GLuint instanceTexture;
+  GLsizei instanceCount;
+  const glm::mat4* model;
+  const glm::mat4* nor;
+  const std::vector<TextureHandle>* textures;
+  glm::vec4 diffuseColor;
+  glm::vec4 emissiveColor;
+  GLint texVoreinstellung;
+  GLfloat alphaCutoff;
+  GLfloat polygonOffset;
+  bool blend;
+
+  // Lage der DrawDaten im Uniform-Buffer (nach DrawList::upload())
+  GLintptr drawDatenOffset;
+
+  // Zeigen in den Batch des Render-Objekts
+  const GLsizei* counts;
+  const void* const* indexOffsets;
+  const GLint* baseVertices;
+  GLsizei drawCount;
+};
+
+// Flache, nach Zustand sortierte Liste aller Draw-Aufrufe einer Szene.
+// Die Reihenfolge, die Zusi vorgibt, bleibt erhalten, wo sie das Ergebnis beeinflussen kann:
+// Render-Objekte mit unterschiedlicher Z-Offset-Summe werden nicht vermischt,
+// transparente (geblendete) Records bleiben an ihrer Stelle, und deckende Records ziehen nur
+// an Records vorbei, die sie nicht ueberlappen (bei GL_LESS gewinnt sonst ein anderes Subset).
+class DrawList {
+ public:
+  DrawList();
+  ~DrawList();
+  DrawList(const DrawList&) = delete;
+  DrawList& operator=(const DrawList&) = delete;
+
+  void clear();
+  // Fuegt die Records des Objekts an. Objekte muessen in Zeichenreihenfolge hinzugefuegt werden.
+  void add(const RenderObject& renderObject);
+  // Zieht deckende Records zum letzten vorherigen Record mit gleichem Zustand vor, soweit das das Bild nicht aendert.
+  void sort();
+  // Laedt die DrawDaten aller Records in einen Uniform-Buffer. Aufeinanderfolgende Records
+  // mit gleichen Daten teilen sich einen Eintrag.
+  bool upload(const ShaderParameters& shaderParameters);
+
+  bool render(const ShaderParameters& shaderParameters) const;
+
+  size_t size() const { return m_records.size(); }
+
+ private:
+  std::vector<DrawRecord> m_records;
+  uint32_t m_gruppe;
+  std::optional<int> m_zOffsetSumme;
+  GLuint m_uniformBuffer;
+  // 1x1 weiss, fuer Records ohne Textur, damit der Shader keine zuvor gebundene Textur abtastet
+  GLuint m_weisseTextur;
+};
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifdef USE_BOOST_FILESYSTEM
+#include <boost/filesystem.hpp>
+#else
+#include <filesystem>
+#endif
+
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+namespace ls3render {
+
+#ifdef USE_BOOST_FILESYSTEM
+namespace fs = boost::filesystem;
+using fs_error_code = boost::system::error_code;
+#else
+namespace fs = std::filesystem;
+using fs_error_code = std::error_code;
+#endif
+
+// Identifiziert einen bestimmten Stand einer Datei auf der Festplatte.
+struct DateiStempel {
+  std::string pfad;  // kanonischer Pfad
+  uint64_t groesse { 0 };
+  int64_t aenderungszeit { 0 };
+
+  bool operator==(const DateiStempel& other) const {
+    return pfad == other.pfad && groesse == other.groesse && aenderungszeit == other.aenderungszeit;
+  }
+  bool operator!=(const DateiStempel& other) const {
+    return !(*this == other);
+  }
+};
+
+// Ermittelt kanonischen Pfad, Groesse und Aenderungszeit einer Datei.
+// Gibt false zurueck, wenn die Datei nicht existiert oder nicht gelesen werden kann.
+inline bool stempel(const std::string& os_pfad, DateiStempel* result) {
+  fs_error_code ec;
+  const auto kanonisch = fs::canonical(os_pfad, ec);
+  if (ec) {
+    return false;
+  }
+  const auto groesse = fs::file_size(kanonisch, ec);
+  if (ec) {
+    return false;
+  }
+  const auto aenderungszeit = fs::last_write_time(kanonisch, ec);
+  if (ec) {
+    return false;
+  }
+
+  result->pfad = kanonisch.string();
+  result->groesse = groesse;
+#ifdef USE_BOOST_FILESYSTEM
+  result->aenderungszeit = static_cast<int64_t>(aenderungszeit);  // std::time_t
+#else
+  result->aenderungszeit = static_cast<int64_t>(aenderungszeit.time_since_epoch().count());
+#endif
+  return true;
+}
+
+}
@@ -0,0 +1,342 @@
+#include "./gl_context.hpp"
+
+#include "./macros.hpp"
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef HAVE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+// Serialisiert die Erzeugung von Kontexten. Die GLEW-Funktionszeiger sind global und werden
+// bei jeder Erzeugung neu geladen; sie sind fuer alle Kontexte desselben Treibers gleich.
+std::mutex erzeugung_mutex;
+
+// glfwInit/glfwTerminate sind prozessweit, daher mit Referenzzaehler ueber alle GLFW-Kontexte
+std::mutex glfw_mutex;
+int glfw_nutzer = 0;
+
+#ifdef HAVE_EGL
+// Das Surfaceless-Display ist prozessweit dasselbe, eglTerminate daher erst, wenn es kein EGL-Kontext mehr verwendet
+std::mutex egl_mutex;
+int egl_nutzer = 0;
+#endif
+
+void glfw_error_callback(int error, const char* description) {
+  std::cerr << "GLFW error " << error << ": " << description << std::endl;
+}
+
+// Laedt die GL-Funktionen ueber GLEW.
+// Fuer Kontexte ohne GLX/WGL nur den kontextunabhaengigen Teil, glewInit() wuerde dort am Fenstersystem scheitern.
+bool initGlew(bool mitFenstersystem) {
+  glewExperimental = GL_TRUE;
+  if (mitFenstersystem) {
+    TRY_GLEW(glewInit());
+  } else {
+    TRY_GLEW(glewContextInit());
+  }
+  // glewInit erzeugt in Core-Profilen u.U. GL_INVALID_ENUM, das hier nicht interessiert
+  while (glGetError() != GL_NO_ERROR) {}
+  return true;
+}
+
+class GlfwKontext : public GLKontext {
+ public:
+  GlfwKontext() : m_Window(nullptr), m_GlfwInitialisiert(false) {}
+
+  ~GlfwKontext() override {
+    if (!m_GlfwInitialisiert) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(glfw_mutex);
+    if (m_Window) {
+      TRY_GLFW(glfwDestroyWindow(m_Window));
+    }
+    if (--glfw_nutzer == 0) {
+      TRY_GLFW(glfwTerminate());
+    }
+  }
+
+  bool init(bool debug) {
+    {
+      std::lock_guard<std::mutex> lock(glfw_mutex);
+      if (glfw_nutzer == 0) {
+        glfwSetErrorCallback(glfw_error_callback);
+        if (!glfwInit()) {
+          std::cerr << "Error initializing GLFW" << std::endl;
+          return false;
+        }
+      }
+      ++glfw_nutzer;
+      m_GlfwInitialisiert = true;
+    }
+
+    // Require the OpenGL context to support at least OpenGL 3.2
+    TRY_GLFW(glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3));
+    TRY_GLFW(glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2));
+
+    // We want a context that supports only the new core functionality
+    TRY_GLFW(glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE));
+
+    TRY_GLFW(glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE));
+
+    TRY_GLFW(glfwWindowHint(GLFW_RESIZABLE, GL_FALSE));
+    TRY_GLFW(glfwWindowHint(GLFW_VISIBLE, GL_FALSE));
+    TRY_GLFW(glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debug ? GL_TRUE : GL_FALSE));
+
+    // The GLFWwindow object encapsulates both a window and a context
+    // (which are inseparably linked).
+    m_Window = TRY_GLFW(glfwCreateWindow(1, 1, "ls3render",
+            nullptr,  // monitor if fullscreen
+            nullptr   // existing OpenGL context to share resources with
+            ));
+    if (!m_Window) {
+      std::cerr << "Error creating GLFW window" << std::endl;
+      return false;
+    }
+    return makeCurrent() && initGlew(true);
+  }
+
+  KontextBackend backend() const override { return KontextBackend::Glfw; }
+
+  bool makeCurrent() override {
+    TRY_GLFW(glfwMakeContextCurrent(m_Window));
+    return true;
+  }
+
+  void gibFrei() override {
+    TRY_GLFW(glfwMakeContextCurrent(nullptr));
+  }
+
+ private:
+  GLFWwindow* m_Window;
+  bool m_GlfwInitialisiert;
+};
+
+#ifdef HAVE_EGL
+class EglKontext : public GLKontext {
+ public:
+  EglKontext() : m_Display(EGL_NO_DISPLAY), m_Context(EGL_NO_CONTEXT), m_EglInitialisiert(false) {}
+
+  ~EglKontext() override {
+    if (!m_EglInitialisiert) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(egl_mutex);
+    if (m_Context != EGL_NO_CONTEXT) {
+      if (eglGetCurrentContext() == m_Context) {
+        eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      }
+      eglDestroyContext(m_Display, m_Context);
+    }
+    if (--egl_nutzer == 0) {
+      eglTerminate(m_Display);
+    }
+  }
+
+  bool init(bool debug) {
+    const auto eglGetPlatformDisplayEXT = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!eglGetPlatformDisplayEXT) {
+      std::cerr << "EGL_EXT_platform_base not supported\n";
+      return false;
+    }
+    m_Display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (m_Display == EGL_NO_DISPLAY) {
+      std::cerr << "EGL_MESA_platform_surfaceless not supported\n";
+      return false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(egl_mutex);
+      if (egl_nutzer == 0) {
+        EGLint major;
+        EGLint minor;
+        if (!eglInitialize(m_Display, &major, &minor)) {
+          std::cerr << "eglInitialize failed: 0x" << std::hex << eglGetError() << std::dec << "\n";
+          return false;
+        }
+      }
+      ++egl_nutzer;
+      m_EglInitialisiert = true;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      std::cerr << "eglBindAPI(EGL_OPENGL_API) failed\n";
+      return false;
+    }
+
+    const EGLint config_attribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(m_Display, config_attribs, &config, 1, &num_configs) || num_configs < 1) {
+      std::cerr << "No suitable EGL config\n";
+      return false;
+    }
+
+    const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 3,
+      EGL_CONTEXT_MINOR_VERSION, 2,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+      EGL_CONTEXT_OPENGL_DEBUG, debug ? EGL_TRUE : EGL_FALSE,
+      EGL_NONE
+    };
+    m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, context_attribs);
+    if (m_Context == EGL_NO_CONTEXT) {
+      std::cerr << "eglCreateContext failed: 0x" << std::hex << eglGetError() << std::dec << "\n";
+      return false;
+    }
+    return makeCurrent() && initGlew(false);
+  }
+
+  KontextBackend backend() const override { return KontextBackend::Egl; }
+
+  bool makeCurrent() override {
+    // Ohne Surface (EGL_KHR_surfaceless_context), gezeichnet wird nur in Framebuffer-Objekte
+    if (!eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context)) {
+      std::cerr << "eglMakeCurrent failed: 0x" << std::hex << eglGetError() << std::dec << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  void gibFrei() override {
+    eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  }
+
+ private:
+  EGLDisplay m_Display;
+  EGLContext m_Context;
+  bool m_EglInitialisiert;
+};
+#endif
+
+#ifdef HAVE_OSMESA
+class OSMesaKontext : public GLKontext {
+ public:
+  OSMesaKontext() : m_Context(nullptr), m_Puffer(4) {}
+
+  ~OSMesaKontext() override {
+    if (m_Context) {
+      OSMesaDestroyContext(m_Context);
+    }
+  }
+
+  bool init(bool debug) {
+    (void)debug;
+    const int attribs[] = {
+      OSMESA_FORMAT, OSMESA_RGBA,
+      OSMESA_DEPTH_BITS, 0,  // Tiefenpuffer liegen in den Framebuffer-Objekten
+      OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+      OSMESA_CONTEXT_MAJOR_VERSION, 3,
+      OSMESA_CONTEXT_MINOR_VERSION, 2,
+      0
+    };
+    m_Context = OSMesaCreateContextAttribs(attribs, nullptr);
+    if (!m_Context) {
+      std::cerr << "OSMesaCreateContextAttribs failed\n";
+      return false;
+    }
+    return makeCurrent() && initGlew(false);
+  }
+
+  KontextBackend backend() const override { return KontextBackend::OSMesa; }
+
+  bool makeCurrent() override {
+    // OSMesa braucht immer einen Farbpuffer; gezeichnet wird aber nur in Framebuffer-Objekte
+    if (!OSMesaMakeCurrent(m_Context, m_Puffer.data(), GL_UNSIGNED_BYTE, 1, 1)) {
+      std::cerr << "OSMesaMakeCurrent failed\n";
+      return false;
+    }
+    return true;
+  }
+
+  void gibFrei() override {
+    OSMesaMakeCurrent(nullptr, nullptr, 0, 0, 0);
+  }
+
+ private:
+  OSMesaContext m_Context;
+  std::vector<unsigned char> m_Puffer;
+};
+#endif
+
+template <typename Kontext>
+std::unique_ptr<GLKontext> erzeuge(bool debug) {
+  auto kontext = std::make_unique<Kontext>();
+  if (!kontext->init(debug)) {
+    return nullptr;
+  }
+  return kontext;
+}
+
+}  // namespace
+
+std::unique_ptr<GLKontext> erzeugeKontext(KontextBackend backend, bool debug) {
+  std::lock_guard<std::mutex> lock(erzeugung_mutex);
+  switch (backend) {
+    case KontextBackend::Glfw:
+      return erzeuge<GlfwKontext>(debug);
+    case KontextBackend::Egl:
+#ifdef HAVE_EGL
+      return erzeuge<EglKontext>(debug);
+#else
+      std::cerr << "ls3render was built without EGL support\n";
+      return nullptr;
+#endif
+    case KontextBackend::OSMesa:
+#ifdef HAVE_OSMESA
+      return erzeuge<OSMesaKontext>(debug);
+#else
+      std::cerr << "ls3render was built without OSMesa support\n";
+      return nullptr;
+#endif
+  }
+  return nullptr;
+}
+
+std::vector<KontextBackend> standardBackends() {
+  return {
+#ifdef HAVE_EGL
+    KontextBackend::Egl,
+#endif
+#ifdef HAVE_OSMESA
+    KontextBackend::OSMesa,
+#endif
+    KontextBackend::Glfw,
+  };
+}
+
+std::optional<KontextBackend> backendAusName(const std::string& name) {
+  if (name == "glfw") {
+    return KontextBackend::Glfw;
+  } else if (name == "egl") {
+    return KontextBackend::Egl;
+  } else if (name == "osmesa") {
+    return KontextBackend::OSMesa;
+  }
+  return std::nullopt;
+}
+
+}
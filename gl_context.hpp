@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ls3render {
+
+enum class KontextBackend {
+  Glfw,    // Verstecktes GLFW-Fenster, braucht einen Display-Server
+  Egl,     // EGL_MESA_platform_surfaceless, ohne Display-Server (nur mit HAVE_EGL)
+  OSMesa,  // Software-Rendering mit OSMesa/llvmpipe (nur mit HAVE_OSMESA)
+};
+
+// Ein OpenGL-3.2-Core-Kontext. Gezeichnet wird ausschliesslich in Framebuffer-Objekte,
+// der Kontext braucht also keinen sichtbaren Framebuffer.
+// Ein Kontext kann in jedem Thread aktuell gemacht werden, aber in hoechstens einem gleichzeitig.
+class GLKontext {
+ public:
+  virtual ~GLKontext() {}
+  virtual KontextBackend backend() const = 0;
+  virtual bool makeCurrent() = 0;
+  // Loest den Kontext vom aufrufenden Thread, danach kann ihn ein anderer Thread aktuell machen.
+  virtual void gibFrei() = 0;
+};
+
+// Erzeugt einen Kontext mit dem angegebenen Backend und macht ihn aktuell.
+// Initialisiert ausserdem GLEW. nullptr bei Fehlschlag (oder wenn das Backend nicht einkompiliert ist).
+// Threadsicher; GLFW-Kontexte sollten trotzdem nur im Hauptthread erzeugt werden.
+std::unique_ptr<GLKontext> erzeugeKontext(KontextBackend backend, bool debug);
+
+// Backends in der Reihenfolge, in der sie ohne ausdrueckliche Auswahl probiert werden:
+// zuerst die einkompilierten Backends ohne Display-Server, zuletzt GLFW.
+std::vector<KontextBackend> standardBackends();
+
+// "glfw", "egl" oder "osmesa"
+std::optional<KontextBackend> backendAusName(const std::string& name);
+
+}
@@ -0,0 +1,62 @@
+#include "./gl_debug.hpp"
+
+#include <iostream>
+
+namespace ls3render {
+namespace gldebug {
+
+thread_local Aufrufstelle aufrufstelle { "", 0, "" };
+
+namespace {
+
+const char* schweregrad(GLenum severity) {
+  switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH:
+      return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM:
+      return "medium";
+    case GL_DEBUG_SEVERITY_LOW:
+      return "low";
+    default:
+      return "notification";
+  }
+}
+
+void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam) {
+  (void)source;
+  (void)length;
+  (void)userParam;
+  std::cerr << aufrufstelle.datei << ":" << std::dec << aufrufstelle.zeile << ": GL debug message (" << schweregrad(severity)
+    << (type == GL_DEBUG_TYPE_ERROR ? ", error" : "") << ", id " << id << ") after " << aufrufstelle.aufruf << ": " << message << std::endl;
+}
+
+}  // namespace
+
+bool pruefeFehler(const char* datei, int zeile, const char* kontext) {
+  GLenum error = glGetError();
+  if (error == GL_NO_ERROR) {
+    return true;
+  }
+  do {
+    std::cerr << datei << ":" << std::dec << zeile << ": Error executing " << kontext << ": 0x" << std::hex << error << std::dec << std::endl;
+    error = glGetError();
+  } while (error != GL_NO_ERROR);
+  return false;
+}
+
+bool aktiviereDebugAusgabe() {
+  if (!GLEW_KHR_debug) {
+    std::cerr << "GL_KHR_debug not supported, no GL debug output\n";
+    return false;
+  }
+
+  glEnable(GL_DEBUG_OUTPUT);
+  // Synchron, damit die Aufrufstelle zur Meldung passt
+  glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  glDebugMessageCallback(debugCallback, nullptr);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+  return pruefeFehler(__FILE__, __LINE__, "aktiviereDebugAusgabe");
+}
+
+}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+namespace ls3render {
+namespace gldebug {
+
+// Zuletzt ueber TRY ausgefuehrter GL-Aufruf. Wird vom Debug-Callback mit ausgegeben,
+// damit sich Meldungen einer Stelle im Quelltext zuordnen lassen.
+struct Aufrufstelle {
+  const char* datei;
+  int zeile;
+  const char* aufruf;
+};
+
+extern thread_local Aufrufstelle aufrufstelle;
+
+inline void setzeAufrufstelle(const char* datei, int zeile, const char* aufruf) {
+  aufrufstelle = Aufrufstelle { datei, zeile, aufruf };
+}
+
+// Holt alle anstehenden Fehler mit glGetError ab und gibt sie mit dem Kontext aus.
+// @return true, wenn kein Fehler anstand.
+bool pruefeFehler(const char* datei, int zeile, const char* kontext);
+
+// Installiert einen Callback fuer GL_KHR_debug, der alle Meldungen des Treibers (ohne
+// reine Hinweise) synchron mit der letzten Aufrufstelle ausgibt.
+// @return false, wenn der Kontext GL_KHR_debug nicht unterstuetzt.
+bool aktiviereDebugAusgabe();
+
+}
+}
@@ -0,0 +1,83 @@
+#include "./gl_state.hpp"
+
+#include "./macros.hpp"
+
+#include <array>
+#include <iterator>
+#include <utility>
+
+namespace ls3render {
+
+GLStateTracker::GLStateTracker() : m_activeTexture(), m_textures(), m_capabilities(), m_blendFunc(), m_polygonOffset(), m_bufferRanges() {}
+
+bool GLStateTracker::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+  const auto key = std::make_pair(unit, target);
+  const auto it = m_textures.find(key);
+  if (it != std::end(m_textures) && it->second == texture) {
+    return true;
+  }
+
+  if (m_activeTexture != unit) {
+    TRY(glActiveTexture(GL_TEXTURE0 + unit));
+    m_activeTexture = unit;
+  }
+  TRY(glBindTexture(target, texture));
+  m_textures[key] = texture;
+  return true;
+}
+
+bool GLStateTracker::setEnabled(GLenum capability, bool enabled) {
+  const auto it = m_capabilities.find(capability);
+  if (it != std::end(m_capabilities) && it->second == enabled) {
+    return true;
+  }
+
+  if (enabled) {
+    TRY(glEnable(capability));
+  } else {
+    TRY(glDisable(capability));
+  }
+  m_capabilities[capability] = enabled;
+  return true;
+}
+
+bool GLStateTracker::blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+  const std::array<GLenum, 4> blendFunc { srcRGB, dstRGB, srcAlpha, dstAlpha };
+  if (m_blendFunc == blendFunc) {
+    return true;
+  }
+  TRY(glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha));
+  m_blendFunc = blendFunc;
+  return true;
+}
+
+bool GLStateTracker::polygonOffset(GLfloat factor, GLfloat units) {
+  const auto polygonOffset = std::make_pair(factor, units);
+  if (m_polygonOffset == polygonOffset) {
+    return true;
+  }
+  TRY(glPolygonOffset(factor, units));
+  m_polygonOffset = polygonOffset;
+  return true;
+}
+
+bool GLStateTracker::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+  const auto it = m_bufferRanges.find(std::make_pair(target, index));
+  if (it != std::end(m_bufferRanges) && it->second.buffer == buffer && it->second.offset == offset && it->second.size == size) {
+    return true;
+  }
+  TRY(glBindBufferRange(target, index, buffer, offset, size));
+  m_bufferRanges[std::make_pair(target, index)] = BufferRange { buffer, offset, size };
+  return true;
+}
+
+void GLStateTracker::invalidate() {
+  m_activeTexture.reset();
+  m_textures.clear();
+  m_capabilities.clear();
+  m_blendFunc.reset();
+  m_polygonOffset.reset();
+  m_bufferRanges.clear();
+}
+
+}
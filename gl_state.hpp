@@ -0,0 +1,42 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <array>
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace ls3render {
+
+// Merkt sich den zuletzt gesetzten GL-Zustand und laesst Aufrufe weg, die nichts aendern wuerden.
+// Anfangs ist jeder Zustand unbekannt; nach GL-Aufrufen am Tracker vorbei muss invalidate() aufgerufen werden.
+class GLStateTracker {
+ public:
+  GLStateTracker();
+
+  bool bindTexture(GLuint unit, GLenum target, GLuint texture);
+  bool setEnabled(GLenum capability, bool enabled);
+  bool blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
+  bool polygonOffset(GLfloat factor, GLfloat units);
+  bool bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+  void invalidate();
+
+ private:
+  struct BufferRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+
+  std::optional<GLuint> m_activeTexture;
+  std::map<std::pair<GLuint, GLenum>, GLuint> m_textures;  // (Einheit, Ziel) -> Textur
+  std::map<GLenum, bool> m_capabilities;
+  std::optional<std::array<GLenum, 4>> m_blendFunc;
+  std::optional<std::pair<GLfloat, GLfloat>> m_polygonOffset;
+  std::map<std::pair<GLenum, GLuint>, BufferRange> m_bufferRanges;  // (Ziel, Index) -> Bereich
+};
+
+}
@@ -1,7 +1,7 @@
 #include "ls3render.h"
+#include "./image_writer.hpp"
 
 #include <cstdint>
-#include <cstdio>
 #include <vector>
 
 int main(int /*argc*/, char** argv) {
@@ -26,19 +26,8 @@ int main(int /*argc*/, char** argv) {
     return 1;
   }
 
-  short TGAhead[] = {
-    0,  // image id length 0, color map type 0
-    2,  // data type code 2 [uncompressed RGB], color map origin 0 (first half)
-    0,  // color map origin 0 (second half), color map length 0 (first half)
-    0,  // color map length 0 (second half), color map depth 0
-    0,  // x origin
-    0,  // y origin
-    static_cast<short>(ls3render_GetBildbreite()),  // width
-    static_cast<short>(ls3render_GetBildhoehe()), // height
-    32  // bits per pixel 32, image descriptor 0
-  };
-  FILE* out = fopen("screenshot.tga","wb");
-  fwrite(&TGAhead, sizeof(TGAhead), 1, out);
-  fwrite(&buf[0], buf.size(), 1, out);
-  fclose(out);
+  if (!ls3render::schreibeBild("screenshot.tga", ls3render::BildFormat::TgaRle, buf.data(),
+        ls3render_GetBildbreite(), ls3render_GetBildhoehe())) {
+    return 1;
+  }
 }
@@ -0,0 +1,381 @@
+#include "./image_writer.hpp"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+// Gepufferte Ausgabe in eine Datei; Fehler werden gesammelt und am Ende von schliesse() gemeldet.
+class Datei {
+ public:
+  explicit Datei(const std::string& pfad) : m_pfad(pfad), m_datei(std::fopen(pfad.c_str(), "wb")) {
+    if (!m_datei) {
+      std::cerr << "Error opening " << pfad << "\n";
+    }
+  }
+
+  ~Datei() {
+    if (m_datei) {
+      std::fclose(m_datei);
+    }
+  }
+
+  bool offen() const { return m_datei != nullptr; }
+
+  void schreibe(const void* daten, size_t groesse) {
+    const auto* bytes = static_cast<const unsigned char*>(daten);
+    m_puffer.insert(std::end(m_puffer), bytes, bytes + groesse);
+    if (m_puffer.size() >= kPuffergroesse) {
+      leere();
+    }
+  }
+
+  bool schliesse() {
+    leere();
+    const bool ok = m_ok && std::fclose(m_datei) == 0;
+    m_datei = nullptr;
+    if (!ok) {
+      std::cerr << "Error writing " << m_pfad << "\n";
+    }
+    return ok;
+  }
+
+ private:
+  static constexpr size_t kPuffergroesse = 1 << 20;
+
+  void leere() {
+    if (!m_puffer.empty() && std::fwrite(m_puffer.data(), m_puffer.size(), 1, m_datei) != 1) {
+      m_ok = false;
+    }
+    m_puffer.clear();
+  }
+
+  std::string m_pfad;
+  FILE* m_datei;
+  std::vector<unsigned char> m_puffer;
+  bool m_ok { true };
+};
+
+bool transparent(const unsigned char* zeile, size_t bytes) {
+  return zeile[0] == 0 && std::memcmp(zeile, zeile + 1, bytes - 1) == 0;
+}
+
+uint32_t pixel(const unsigned char* zeile, int x) {
+  uint32_t result;
+  std::memcpy(&result, zeile + static_cast<size_t>(x) * 4, 4);
+  return result;
+}
+
+bool schreibeTga(const std::string& pfad, bool rle, const unsigned char* bgra, int breite, int hoehe) {
+  if (breite > 0xFFFF || hoehe > 0xFFFF) {
+    std::cerr << pfad << ": image too large for TGA (" << breite << "x" << hoehe << "), use PNG\n";
+    return false;
+  }
+  Datei datei(pfad);
+  if (!datei.offen()) {
+    return false;
+  }
+
+  const unsigned char header[18] = {
+    0,  // image id length
+    0,  // color map type
+    static_cast<unsigned char>(rle ? 10 : 2),  // data type code: [RLE] true color
+    0, 0, 0, 0, 0,  // color map specification
+    0, 0, 0, 0,  // x, y origin
+    static_cast<unsigned char>(breite & 0xFF), static_cast<unsigned char>(breite >> 8),
+    static_cast<unsigned char>(hoehe & 0xFF), static_cast<unsigned char>(hoehe >> 8),
+    32,  // bits per pixel
+    8,   // image descriptor: 8 Alpha-Bits, Ursprung unten links
+  };
+  datei.schreibe(header, sizeof(header));
+
+  const size_t zeilenbytes = static_cast<size_t>(breite) * 4;
+  if (!rle) {
+    datei.schreibe(bgra, zeilenbytes * hoehe);
+    return datei.schliesse();
+  }
+
+  // Pakete reichen nie ueber ein Zeilenende hinaus (TGA-Spezifikation)
+  std::vector<unsigned char> kodiert;
+  kodiert.reserve(zeilenbytes + zeilenbytes / 128 + 1);
+  for (int y = 0; y < hoehe; y++) {
+    const unsigned char* zeile = bgra + zeilenbytes * y;
+    kodiert.clear();
+    if (transparent(zeile, zeilenbytes)) {
+      for (int x = 0; x < breite; x += 128) {
+        const unsigned char paket[5] = { static_cast<unsigned char>(0x80 | (std::min(128, breite - x) - 1)), 0, 0, 0, 0 };
+        kodiert.insert(std::end(kodiert), paket, paket + sizeof(paket));
+      }
+    } else {
+      int x = 0;
+      while (x < breite) {
+        // Wiederholungspaket ab zwei gleichen Pixeln, sonst Rohdaten bis zur naechsten Wiederholung
+        const uint32_t p = pixel(zeile, x);
+        int lauf = 1;
+        while (x + lauf < breite && lauf < 128 && pixel(zeile, x + lauf) == p) {
+          lauf++;
+        }
+        if (lauf >= 2) {
+          kodiert.push_back(static_cast<unsigned char>(0x80 | (lauf - 1)));
+          kodiert.insert(std::end(kodiert), zeile + static_cast<size_t>(x) * 4, zeile + static_cast<size_t>(x) * 4 + 4);
+          x += lauf;
+          continue;
+        }
+        int roh = 1;
+        while (x + roh < breite && roh < 128
+            && !(x + roh + 1 < breite && pixel(zeile, x + roh) == pixel(zeile, x + roh + 1))) {
+          roh++;
+        }
+        kodiert.push_back(static_cast<unsigned char>(roh - 1));
+        kodiert.insert(std::end(kodiert), zeile + static_cast<size_t>(x) * 4, zeile + static_cast<size_t>(x + roh) * 4);
+        x += roh;
+      }
+    }
+    datei.schreibe(kodiert.data(), kodiert.size());
+  }
+  return datei.schliesse();
+}
+
+#ifdef HAVE_ZLIB
+
+void schreibeUint32(std::vector<unsigned char>* ziel, uint32_t wert) {
+  const unsigned char bytes[4] = {
+    static_cast<unsigned char>(wert >> 24), static_cast<unsigned char>(wert >> 16),
+    static_cast<unsigned char>(wert >> 8), static_cast<unsigned char>(wert),
+  };
+  ziel->insert(std::end(*ziel), bytes, bytes + 4);
+}
+
+void schreibeChunk(Datei* datei, const char typ[4], const unsigned char* daten, size_t groesse) {
+  std::vector<unsigned char> kopf;
+  schreibeUint32(&kopf, static_cast<uint32_t>(groesse));
+  kopf.insert(std::end(kopf), typ, typ + 4);
+  datei->schreibe(kopf.data(), kopf.size());
+  if (groesse > 0) {
+    datei->schreibe(daten, groesse);
+  }
+
+  uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(typ), 4);
+  if (groesse > 0) {
+    crc = crc32(crc, daten, static_cast<uInt>(groesse));  // crc32 mit nullptr liefert den Startwert
+  }
+  std::vector<unsigned char> ende;
+  schreibeUint32(&ende, static_cast<uint32_t>(crc));
+  datei->schreibe(ende.data(), ende.size());
+}
+
+bool schreibePng(const std::string& pfad, const unsigned char* bgra, int breite, int hoehe) {
+  // Schnelle Kompressionsstufe: Die Bilder bestehen zum grossen Teil aus transparenten Flaechen,
+  // die auch so fast vollstaendig wegfallen
+  constexpr int kKompression = 3;
+  constexpr size_t kIdatGroesse = 1 << 16;
+
+  Datei datei(pfad);
+  if (!datei.offen()) {
+    return false;
+  }
+
+  const unsigned char signatur[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  datei.schreibe(signatur, sizeof(signatur));
+
+  std::vector<unsigned char> ihdr;
+  schreibeUint32(&ihdr, static_cast<uint32_t>(breite));
+  schreibeUint32(&ihdr, static_cast<uint32_t>(hoehe));
+  const unsigned char ihdr_rest[5] = { 8, 6, 0, 0, 0 };  // 8 Bit, RGBA, deflate, Standardfilter, kein Interlacing
+  ihdr.insert(std::end(ihdr), ihdr_rest, ihdr_rest + sizeof(ihdr_rest));
+  schreibeChunk(&datei, "IHDR", ihdr.data(), ihdr.size());
+
+  z_stream stream {};
+  if (deflateInit(&stream, kKompression) != Z_OK) {
+    std::cerr << pfad << ": deflateInit failed\n";
+    return false;
+  }
+  std::unique_ptr<z_stream, int (*)(z_stream*)> stream_guard(&stream, deflateEnd);
+
+  std::vector<unsigned char> idat(kIdatGroesse);
+  stream.next_out = idat.data();
+  stream.avail_out = static_cast<uInt>(idat.size());
+  const auto komprimiere = [&](const unsigned char* daten, size_t groesse) {
+    stream.next_in = const_cast<Bytef*>(daten);
+    stream.avail_in = static_cast<uInt>(groesse);
+    do {
+      if (deflate(&stream, Z_NO_FLUSH) == Z_STREAM_ERROR) {
+        return false;
+      }
+      if (stream.avail_out == 0) {
+        schreibeChunk(&datei, "IDAT", idat.data(), idat.size());
+        stream.next_out = idat.data();
+        stream.avail_out = static_cast<uInt>(idat.size());
+      }
+    } while (stream.avail_in > 0);
+    return true;
+  };
+
+  // PNG beginnt mit der obersten Zeile und speichert RGBA
+  const size_t zeilenbytes = static_cast<size_t>(breite) * 4;
+  std::vector<unsigned char> zeile(1 + zeilenbytes);
+  std::vector<unsigned char> rgba(zeilenbytes);
+  for (int y = hoehe - 1; y >= 0; y--) {
+    const unsigned char* quelle = bgra + zeilenbytes * y;
+    if (transparent(quelle, zeilenbytes)) {
+      // Filter None, Nullen komprimieren ohne weiteres Zutun
+      std::fill(std::begin(zeile), std::end(zeile), 0);
+    } else {
+      for (size_t i = 0; i < zeilenbytes; i += 4) {
+        rgba[i] = quelle[i + 2];
+        rgba[i + 1] = quelle[i + 1];
+        rgba[i + 2] = quelle[i];
+        rgba[i + 3] = quelle[i + 3];
+      }
+      // Filter Sub: Differenz zum linken Nachbarpixel
+      zeile[0] = 1;
+      std::copy(std::begin(rgba), std::begin(rgba) + 4, std::begin(zeile) + 1);
+      for (size_t i = 4; i < zeilenbytes; i++) {
+        zeile[1 + i] = static_cast<unsigned char>(rgba[i] - rgba[i - 4]);
+      }
+    }
+    if (!komprimiere(zeile.data(), zeile.size())) {
+      std::cerr << pfad << ": deflate failed\n";
+      return false;
+    }
+  }
+
+  // Restliche Daten ausgeben, bis deflate fertig ist
+  stream.next_in = nullptr;
+  stream.avail_in = 0;
+  int status;
+  do {
+    status = deflate(&stream, Z_FINISH);
+    if (status == Z_STREAM_ERROR) {
+      std::cerr << pfad << ": deflate failed\n";
+      return false;
+    }
+    if (idat.size() - stream.avail_out > 0) {
+      schreibeChunk(&datei, "IDAT", idat.data(), idat.size() - stream.avail_out);
+      stream.next_out = idat.data();
+      stream.avail_out = static_cast<uInt>(idat.size());
+    }
+  } while (status != Z_STREAM_END);
+
+  schreibeChunk(&datei, "IEND", nullptr, 0);
+  return datei.schliesse();
+}
+
+#endif
+
+}  // namespace
+
+BildFormat formatAusDateiname(const std::string& pfad, bool rle) {
+  const auto punkt = pfad.find_last_of('.');
+  std::string endung = punkt == std::string::npos ? std::string() : pfad.substr(punkt + 1);
+  std::transform(std::begin(endung), std::end(endung), std::begin(endung), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  if (endung == "png") {
+    return BildFormat::Png;
+  }
+  return rle ? BildFormat::TgaRle : BildFormat::Tga;
+}
+
+bool schreibeBild(const std::string& pfad, BildFormat format, const void* bgra, int breite, int hoehe) {
+  const auto* daten = static_cast<const unsigned char*>(bgra);
+  switch (format) {
+    case BildFormat::Tga:
+      return schreibeTga(pfad, false, daten, breite, hoehe);
+    case BildFormat::TgaRle:
+      return schreibeTga(pfad, true, daten, breite, hoehe);
+    case BildFormat::Png:
+#ifdef HAVE_ZLIB
+      return schreibePng(pfad, daten, breite, hoehe);
+#else
+      std::cerr << pfad << ": PNG output requires zlib\n";
+      return false;
+#endif
+  }
+  return false;
+}
+
+BildAusgabe::BildAusgabe(size_t threads, size_t maxBytes) : m_maxBytes(maxBytes) {
+  for (size_t i = 0; i < std::max<size_t>(1, threads); i++) {
+    m_threads.emplace_back(&BildAusgabe::arbeite, this);
+  }
+}
+
+BildAusgabe::~BildAusgabe() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ende = true;
+  }
+  m_neu.notify_all();
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+}
+
+void BildAusgabe::schreibe(std::string pfad, BildFormat format, std::vector<unsigned char> bgra, int breite, int hoehe, Fertig fertig) {
+  const void* daten = bgra.data();  // bleibt beim Verschieben des Vektors gueltig
+  reiheEin(Auftrag { std::move(pfad), format, std::move(bgra), daten, breite, hoehe, std::move(fertig) });
+}
+
+void BildAusgabe::schreibe(std::string pfad, BildFormat format, const void* bgra, int breite, int hoehe, Fertig fertig) {
+  reiheEin(Auftrag { std::move(pfad), format, {}, bgra, breite, hoehe, std::move(fertig) });
+}
+
+void BildAusgabe::reiheEin(Auftrag auftrag) {
+  const size_t groesse = bytes(auftrag);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_frei.wait(lock, [this, groesse]() { return m_belegt == 0 || m_belegt + groesse <= m_maxBytes; });
+  m_belegt += groesse;
+  m_auftraege.push_back(std::move(auftrag));
+  lock.unlock();
+  m_neu.notify_one();
+}
+
+size_t BildAusgabe::warte() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_frei.wait(lock, [this]() { return m_auftraege.empty() && m_inArbeit == 0; });
+  return m_fehler;
+}
+
+void BildAusgabe::arbeite() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_neu.wait(lock, [this]() { return m_ende || !m_auftraege.empty(); });
+    if (m_auftraege.empty()) {
+      return;  // m_ende und nichts mehr zu tun
+    }
+    Auftrag auftrag = std::move(m_auftraege.front());
+    m_auftraege.pop_front();
+    m_inArbeit++;
+    lock.unlock();
+    m_frei.notify_all();
+
+    const bool ok = schreibeBild(auftrag.pfad, auftrag.format, auftrag.bgra, auftrag.breite, auftrag.hoehe);
+    if (auftrag.fertig) {
+      auftrag.fertig(ok);
+    }
+    std::vector<unsigned char>().swap(auftrag.kopie);  // vor dem Verringern von m_belegt freigeben
+
+    lock.lock();
+    m_inArbeit--;
+    m_belegt -= bytes(auftrag);
+    if (!ok) {
+      m_fehler++;
+    }
+    m_frei.notify_all();
+  }
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ls3render {
+
+enum class BildFormat {
+  Tga,     // unkomprimiert
+  TgaRle,  // lauflaengenkodiert
+  Png,     // nur mit zlib (HAVE_ZLIB)
+};
+
+// Format anhand der Dateiendung (.png, sonst TGA). rle: TGA lauflaengenkodiert schreiben.
+BildFormat formatAusDateiname(const std::string& pfad, bool rle);
+
+// Schreibt ein Bild im Format von ls3render_Render (BGRA, unterste Zeile zuerst).
+// Vollstaendig transparente Zeilen werden ohne weitere Pruefung als Ganzes kodiert.
+// Gibt bei Fehlschlag false zurueck (Fehlermeldung auf std::cerr).
+bool schreibeBild(const std::string& pfad, BildFormat format, const void* bgra, int breite, int hoehe);
+
+// Kodiert und schreibt Bilder in Hintergrund-Threads, damit der Render-Thread nicht auf die Festplatte wartet.
+// Wartende und in Arbeit befindliche Bilder belegen zusammen hoechstens maxBytes, danach blockiert schreibe(),
+// so dass der Speicherbedarf auch bei sehr grossen Bildern begrenzt bleibt. Ein einzelnes groesseres Bild
+// wird angenommen, wenn sonst nichts in Arbeit ist.
+class BildAusgabe {
+ public:
+  BildAusgabe(size_t threads, size_t maxBytes);
+  // Wartet, bis alle Bilder geschrieben sind.
+  ~BildAusgabe();
+  BildAusgabe(const BildAusgabe&) = delete;
+  BildAusgabe& operator=(const BildAusgabe&) = delete;
+
+  // fertig(ok) wird nach dem Schreiben im Schreib-Thread aufgerufen, auch bei Fehlschlag.
+  // Mehrere Schreib-Threads koennen es gleichzeitig aufrufen.
+  using Fertig = std::function<void(bool)>;
+
+  void schreibe(std::string pfad, BildFormat format, std::vector<unsigned char> bgra, int breite, int hoehe, Fertig fertig = nullptr);
+  // Ohne Kopie: bgra muss gueltig bleiben, bis fertig aufgerufen wurde.
+  void schreibe(std::string pfad, BildFormat format, const void* bgra, int breite, int hoehe, Fertig fertig);
+
+  // Wartet, bis alle Bilder geschrieben sind. Gibt die Anzahl der fehlgeschlagenen zurueck.
+  size_t warte();
+
+ private:
+  struct Auftrag {
+    std::string pfad;
+    BildFormat format;
+    std::vector<unsigned char> kopie;
+    const void* bgra;
+    int breite;
+    int hoehe;
+    Fertig fertig;
+  };
+
+  static size_t bytes(const Auftrag& auftrag) { return static_cast<size_t>(auftrag.breite) * auftrag.hoehe * 4; }
+  void reiheEin(Auftrag auftrag);
+  void arbeite();
+
+  const size_t m_maxBytes;
+  std::mutex m_mutex;
+  std::condition_variable m_neu;
+  std::condition_variable m_frei;
+  std::deque<Auftrag> m_auftraege;
+  size_t m_inArbeit { 0 };
+  size_t m_belegt { 0 };  // Bytes der wartenden und in Arbeit befindlichen Bilder
+  size_t m_fehler { 0 };
+  bool m_ende { false };
+  std::vector<std::thread> m_threads;
+};
+
+}
@@ -0,0 +1,310 @@
+#include "./ls3_cache.hpp"
+
+#include "./utils.hpp"
+
+#include "zusi_parser/zusi_types.hpp"
+#include "zusi_parser/utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+// Ordnet jedem Element (Subset oder Verknuepfung) die erste Animation zu, die es animiert
+// und zu der es eine Animationsdefinition gibt.
+template <typename Animationen>
+std::vector<AnimationsBindung> bindeAnimationen(const Landschaft& ls3_datei, const Animationen& animationen, size_t n_elemente, std::vector<int>* ani_ids) {
+  std::vector<AnimationsBindung> result(n_elemente);
+  std::vector<bool> gebunden(n_elemente, false);
+
+  for (const auto& a : animationen) {
+    if (a->AniIndex < 0 || static_cast<size_t>(a->AniIndex) >= n_elemente || gebunden[a->AniIndex]) {
+      continue;
+    }
+    if (a->children_AniPunkt.empty()) {
+      // Ergibt keine Lage, eine spaetere Animation desselben Elements kann noch greifen
+      continue;
+    }
+    for (const auto& def : ls3_datei.children_Animation) {
+      if (std::find_if(
+          std::begin(def->children_AniNrs),
+          std::end(def->children_AniNrs),
+          [&a](const auto& aniNrs) {
+            return aniNrs->AniNr == a->AniNr;
+          }) != std::end(def->children_AniNrs)) {
+        auto spur = std::find(std::begin(*ani_ids), std::end(*ani_ids), def->AniID);
+        if (spur == std::end(*ani_ids)) {
+          spur = ani_ids->insert(spur, def->AniID);
+        }
+        result[a->AniIndex] = AnimationsBindung { &a->children_AniPunkt, static_cast<size_t>(std::distance(std::begin(*ani_ids), spur)), std::nullopt };
+        gebunden[a->AniIndex] = true;
+        break;
+      }
+    }
+  }
+
+  return result;
+}
+
+// Mappt die LSB-Datei und legt die Geometrie-Sichten der Subsets an.
+// Die Datei enthaelt fuer jedes Subset nacheinander MeshV Vertices und MeshI Indizes.
+bool mappeLsb(const std::string& lsb_pfad, const Landschaft& ls3_datei, Ls3Datei* result) {
+  static_assert(sizeof(Vertex) == 40, "Wrong size of Vertex");
+  static_assert(offsetof(Vertex, p) == 0, "Wrong offset of Vertex::p");
+  static_assert(offsetof(Vertex, n) == 12, "Wrong offset of Vertex::n");
+  static_assert(offsetof(Vertex, U) == 24, "Wrong offset of Vertex::U");
+  static_assert(offsetof(Vertex, V) == 28, "Wrong offset of Vertex::V");
+  static_assert(offsetof(Vertex, U2) == 32, "Wrong offset of Vertex::U2");
+  static_assert(offsetof(Vertex, V2) == 36, "Wrong offset of Vertex::V2");
+  static_assert(sizeof(Face) == 6, "Wrong size of Face");
+
+  // Groesse vorab pruefen, danach sind alle Sichten garantiert innerhalb der Datei
+  size_t erwartet = 0;
+  for (const auto& mesh_subset : ls3_datei.children_SubSet) {
+    if (mesh_subset->MeshV < 0 || mesh_subset->MeshI < 0 || mesh_subset->MeshI % 3 != 0) {
+      std::cerr << lsb_pfad << ": invalid MeshV/MeshI in LS3 file\n";
+      return false;
+    }
+    erwartet += static_cast<size_t>(mesh_subset->MeshV) * sizeof(Vertex) + static_cast<size_t>(mesh_subset->MeshI / 3) * sizeof(Face);
+  }
+
+  if (!stempel(lsb_pfad, &result->lsb_stempel)) {
+    std::cerr << "Error opening " << lsb_pfad << "\n";
+    return false;
+  }
+  result->lsb = GemappteDatei::oeffne(lsb_pfad);
+  if (!result->lsb) {
+    return false;
+  }
+  if (result->lsb->groesse() != erwartet) {
+    std::cerr << lsb_pfad << ": expected " << erwartet << " bytes, file has " << result->lsb->groesse() << "\n";
+    return false;
+  }
+
+  const unsigned char* pos = result->lsb->daten();
+  for (const auto& mesh_subset : ls3_datei.children_SubSet) {
+    SubsetGeometrie geometrie;
+    geometrie.vertices = pos;
+    geometrie.anzahlVertices = mesh_subset->MeshV;
+    pos += geometrie.vertexBytes();
+    geometrie.faces = pos;
+    geometrie.anzahlFaces = mesh_subset->MeshI / 3;
+    pos += geometrie.faceBytes();
+    result->geometrie.push_back(geometrie);
+  }
+  return true;
+}
+
+// Bounding Box der von Faces verwendeten Vertices.
+// Erweitert min/max um die Positionen der Vertices [erster, ende). Liest nur die drei Positions-floats jedes
+// Vertex (im Abstand sizeof(Vertex)) statt des ganzen Vertex; ohne Verzweigungen, damit der Compiler
+// die Schleife vektorisieren kann.
+void erweitereBoundingBox(const SubsetGeometrie& geometrie, size_t erster, size_t ende, glm::vec3* min, glm::vec3* max) {
+  static_assert(sizeof(Vertex::p) == 3 * sizeof(float), "Vertex-Position sind drei floats");
+  float mn[3] = { min->x, min->y, min->z };
+  float mx[3] = { max->x, max->y, max->z };
+  const unsigned char* position = geometrie.vertices + erster * sizeof(Vertex) + offsetof(Vertex, p);
+  for (size_t i = erster; i < ende; ++i, position += sizeof(Vertex)) {
+    float p[3];
+    std::memcpy(p, position, sizeof(p));
+    for (size_t k = 0; k < 3; k++) {
+      mn[k] = std::min(mn[k], p[k]);
+      mx[k] = std::max(mx[k], p[k]);
+    }
+  }
+  *min = glm::vec3(mn[0], mn[1], mn[2]);
+  *max = glm::vec3(mx[0], mx[1], mx[2]);
+}
+
+// Bounding Box der von Dreiecken verwendeten Vertices. Einmal beim Laden berechnet, die Szene transformiert nur noch die Box.
+void berechneBoundingBox(SubsetGeometrie* geometrie) {
+  std::vector<unsigned char> verwendet(geometrie->anzahlVertices, 0);
+  for (size_t f = 0; f < geometrie->anzahlFaces; f++) {
+    const Face dreieck = geometrie->face(f);
+    for (size_t j = 0; j < 3; j++) {
+      if (dreieck.i[j] < geometrie->anzahlVertices) {
+        verwendet[dreieck.i[j]] = 1;
+      }
+    }
+  }
+
+  // Meist werden alle Vertices verwendet, dann ist das ein einziger zusammenhaengender Bereich
+  glm::vec3 min { std::numeric_limits<float>::max() };
+  glm::vec3 max { std::numeric_limits<float>::lowest() };
+  size_t i = 0;
+  while (i < geometrie->anzahlVertices) {
+    const auto erster = std::find(std::begin(verwendet) + i, std::end(verwendet), 1);
+    const auto ende = std::find(erster, std::end(verwendet), 0);
+    erweitereBoundingBox(*geometrie, erster - std::begin(verwendet), ende - std::begin(verwendet), &min, &max);
+    i = ende - std::begin(verwendet);
+  }
+  geometrie->aabbMin = min;
+  geometrie->aabbMax = max;
+}
+
+void berechneUvDichte(SubsetGeometrie* geometrie) {
+  for (size_t f = 0; f < geometrie->anzahlFaces; f++) {
+    const Face dreieck = geometrie->face(f);
+    if (dreieck.i[0] >= geometrie->anzahlVertices || dreieck.i[1] >= geometrie->anzahlVertices || dreieck.i[2] >= geometrie->anzahlVertices) {
+      continue;
+    }
+    const Vertex ecken[3] = { geometrie->vertex(dreieck.i[0]), geometrie->vertex(dreieck.i[1]), geometrie->vertex(dreieck.i[2]) };
+    for (size_t j = 0; j < 3; j++) {
+      const Vertex& a = ecken[j];
+      const Vertex& b = ecken[(j + 1) % 3];
+      const float laenge = glm::length(glm::vec3(a.p.x - b.p.x, a.p.y - b.p.y, a.p.z - b.p.z));
+      if (laenge < 1e-4f) {
+        continue;  // entartete Kante
+      }
+      geometrie->uvDichte[0] = std::max(geometrie->uvDichte[0], glm::length(glm::vec2(a.U - b.U, a.V - b.V)) / laenge);
+      geometrie->uvDichte[1] = std::max(geometrie->uvDichte[1], glm::length(glm::vec2(a.U2 - b.U2, a.V2 - b.V2)) / laenge);
+    }
+  }
+}
+
+SubsetMaterial material(const SubSet& mesh_subset) {
+  SubsetMaterial result;
+  result.typLs3 = mesh_subset.TypLs3;
+  result.texVoreinstellung = mesh_subset.RenderFlags->TexVoreinstellung == 5 ? mesh_subset.NachtEinstellung /* sollte heissen: TagVoreinstellung */ : mesh_subset.RenderFlags->TexVoreinstellung;
+  result.zBias = mesh_subset.zBias;
+  result.diffuseColor = glm::vec4(mesh_subset.Cd.r, mesh_subset.Cd.g, mesh_subset.Cd.b, mesh_subset.Cd.a) / 255.0f;
+  result.emissiveColor = glm::vec4(mesh_subset.Ce.r, mesh_subset.Ce.g, mesh_subset.Ce.b, mesh_subset.Ce.a) / 255.0f;
+  for (const auto& textur : mesh_subset.children_Textur) {
+    result.texturen.push_back(textur->Datei.Dateiname);
+  }
+  return result;
+}
+
+std::unique_ptr<Ls3Datei> ladeDatei(const zusixml::ZusiPfad& dateiname, const DateiStempel& stempel) {
+  const auto& dateinameOsPfad = dateiname.alsOsPfad();
+  std::unique_ptr<Zusi> zusi_datei = zusixml::tryParseFile(dateinameOsPfad);
+  if (!zusi_datei) {
+    std::cerr << "Error parsing " << dateinameOsPfad << "\n";
+    return nullptr;
+  }
+  auto* ls3_datei = zusi_datei->Landschaft.get();
+  if (!ls3_datei) {
+    std::cerr << "Not an LS3 file: " << dateinameOsPfad << "\n";
+    return nullptr;
+  }
+
+  auto result = std::make_unique<Ls3Datei>();
+
+  if (!ls3_datei->lsb.Dateiname.empty()) {
+    std::string lsb_pfad = zusixml::ZusiPfad::vonZusiPfad(ls3_datei->lsb.Dateiname, dateiname).alsOsPfad();
+    if (!mappeLsb(lsb_pfad, *ls3_datei, result.get())) {
+      return nullptr;
+    }
+  } else {
+    for (const auto& mesh_subset : ls3_datei->children_SubSet) {
+      result->geometrie.push_back(SubsetGeometrie {
+        reinterpret_cast<const unsigned char*>(mesh_subset->children_Vertex.data()), mesh_subset->children_Vertex.size(),
+        reinterpret_cast<const unsigned char*>(mesh_subset->children_Face.data()), mesh_subset->children_Face.size(),
+      });
+    }
+  }
+
+  for (auto& mesh_subset : ls3_datei->children_SubSet) {
+    for (auto& textur : mesh_subset->children_Textur) {
+      if (!textur->Datei.Dateiname.empty()) {
+        textur->Datei.Dateiname = zusixml::ZusiPfad::vonZusiPfad(textur->Datei.Dateiname, dateiname).alsOsPfad();
+      }
+    }
+    result->materialien.push_back(material(*mesh_subset));
+  }
+  for (auto& geometrie : result->geometrie) {
+    berechneBoundingBox(&geometrie);
+    berechneUvDichte(&geometrie);
+  }
+
+  result->subset_animationen = bindeAnimationen(*ls3_datei, ls3_datei->children_MeshAnimation, ls3_datei->children_SubSet.size(), &result->ani_ids);
+  result->verkn_animationen = bindeAnimationen(*ls3_datei, ls3_datei->children_VerknAnimation, ls3_datei->children_Verknuepfte.size(), &result->ani_ids);
+  result->zusi = std::move(zusi_datei);
+  result->stempel = stempel;
+  return result;
+}
+
+// Ob die LSB-Datei (falls vorhanden) seit dem Laden unveraendert ist. Die Geometrie steht nur dort,
+// und eine gekuerzte Datei wuerde beim Zugriff auf die gemappten Daten zum Absturz (SIGBUS) fuehren.
+bool lsbAktuell(const Ls3Datei& datei) {
+  if (datei.lsb_stempel.pfad.empty()) {
+    return true;
+  }
+  DateiStempel aktuell;
+  return stempel(datei.lsb_stempel.pfad, &aktuell) && aktuell == datei.lsb_stempel;
+}
+
+}  // namespace
+
+std::vector<float> Ls3Datei::spurPositionen(const std::unordered_map<int, float>& ani_positionen) const {
+  std::vector<float> result(ani_ids.size(), 0.0f);
+  for (size_t i = 0; i < ani_ids.size(); i++) {
+    const auto it = ani_positionen.find(ani_ids[i]);
+    if (it != std::end(ani_positionen)) {
+      result[i] = it->second;
+    }
+  }
+  return result;
+}
+
+std::optional<AniPunkt> Ls3Datei::animation(const AnimationsBindung& bindung, const std::vector<float>& spur_positionen) {
+  if (!bindung.ani_punkte) {
+    return bindung.fest;
+  }
+  return interpoliere(*bindung.ani_punkte, spur_positionen[bindung.spur]);
+}
+
+Ls3Cache& Ls3Cache::instance() {
+  static Ls3Cache instance;
+  return instance;
+}
+
+std::shared_ptr<const Ls3Datei> Ls3Cache::lade(const zusixml::ZusiPfad& dateiname) {
+  const auto& dateinameOsPfad = dateiname.alsOsPfad();
+  DateiStempel stempel;
+  if (!ls3render::stempel(dateinameOsPfad, &stempel)) {
+    std::cerr << "Error opening " << dateinameOsPfad << "\n";
+    return nullptr;
+  }
+
+  std::shared_ptr<const Ls3Datei> vorhanden;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_dateien.find(stempel.pfad);
+    if (it != std::end(m_dateien) && it->second->stempel == stempel) {
+      vorhanden = it->second;
+    }
+  }
+  if (vorhanden && lsbAktuell(*vorhanden)) {
+    return vorhanden;
+  }
+
+  // Parsen ausserhalb des Locks; laden zwei Threads gleichzeitig dieselbe Datei, gewinnt der letzte.
+  std::shared_ptr<const Ls3Datei> datei = ladeDatei(dateiname, stempel);
+  if (!datei) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_dateien[stempel.pfad] = datei;
+  return datei;
+}
+
+void Ls3Cache::leere() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_dateien.clear();
+}
+
+}
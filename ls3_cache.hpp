@@ -0,0 +1,131 @@
+#pragma once
+
+#include "./filesystem.hpp"
+#include "./mapped_file.hpp"
+
+#include "zusi_parser/zusi_types.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace zusixml {
+  class ZusiPfad;
+}
+
+namespace ls3render {
+
+// Beim Laden aufgeloeste Zuordnung eines Subsets oder einer Verknuepfung zu ihrer Animation.
+struct AnimationsBindung {
+  const std::vector<std::unique_ptr<AniPunkt>>* ani_punkte { nullptr };  // nullptr: nicht animiert
+  size_t spur { 0 };  // Index in Ls3Datei::ani_ids
+  // Feste Lage, falls ani_punkte == nullptr (bei Dateien aus dem Szenencache bereits ausgewertet).
+  std::optional<AniPunkt> fest;
+};
+
+// Beim Laden aufgeloeste Darstellungsparameter eines Subsets.
+struct SubsetMaterial {
+  int typLs3 { 0 };
+  int texVoreinstellung { 0 };  // TexVoreinstellung 5 bereits durch NachtEinstellung ersetzt
+  int zBias { 0 };
+  glm::vec4 diffuseColor { 0 };  // Cd/255
+  glm::vec4 emissiveColor { 0 };  // Ce/255
+  std::vector<std::string> texturen;  // Betriebssystempfade; leer, wenn das Textur-Element keine Datei angibt
+
+  bool operator==(const SubsetMaterial& other) const {
+    return typLs3 == other.typLs3 && texVoreinstellung == other.texVoreinstellung && zBias == other.zBias
+      && diffuseColor == other.diffuseColor && emissiveColor == other.emissiveColor && texturen == other.texturen;
+  }
+};
+
+// Vertex- und Indexdaten eines Subsets, direkt in der gemappten LSB-Datei oder (ohne LSB-Datei) im geparsten XML.
+// In der LSB-Datei liegen die Daten nicht unbedingt passend ausgerichtet, daher Einzelzugriff nur ueber memcpy.
+struct SubsetGeometrie {
+  const unsigned char* vertices { nullptr };
+  size_t anzahlVertices { 0 };
+  const unsigned char* faces { nullptr };
+  size_t anzahlFaces { 0 };
+  // Bounding Box der von Faces verwendeten Vertices (nur gueltig, wenn anzahlFaces > 0)
+  glm::vec3 aabbMin { 0 };
+  glm::vec3 aabbMax { 0 };
+  // Groesste Texturkoordinaten-Aenderung pro Meter entlang einer Dreieckskante, fuer UV1 und UV2.
+  // Bestimmt, welche Mip-Stufe der Texturen bei gegebener Ausgabeaufloesung hoechstens abgetastet wird.
+  float uvDichte[2] { 0, 0 };
+
+  size_t vertexBytes() const { return anzahlVertices * sizeof(Vertex); }
+  size_t faceBytes() const { return anzahlFaces * sizeof(Face); }
+
+  Vertex vertex(size_t i) const {
+    Vertex result;
+    std::memcpy(&result, vertices + i * sizeof(Vertex), sizeof(Vertex));
+    return result;
+  }
+
+  Face face(size_t i) const {
+    Face result;
+    std::memcpy(&result, faces + i * sizeof(Face), sizeof(Face));
+    return result;
+  }
+};
+
+// Eine vollstaendig geladene LS3-Datei: geparstes XML, Geometrie aus der (gemappten) LSB-Datei
+// und Texturpfade, die bereits in Betriebssystempfade umgewandelt sind.
+// Nach dem Laden unveraenderlich, kann also von beliebig vielen Render-Objekten geteilt werden.
+// Dateien aus dem Szenencache haben kein geparstes XML (zusi == nullptr); Render-Objekte verwenden daher
+// nur geometrie, materialien und subset_animationen.
+struct Ls3Datei {
+  std::unique_ptr<Zusi> zusi;
+  DateiStempel stempel;
+  DateiStempel lsb_stempel;  // pfad leer, wenn es keine LSB-Datei gibt
+
+  // Die LSB-Datei (bzw. die Szenencache-Datei), falls vorhanden. Muss so lange leben wie geometrie.
+  std::shared_ptr<const GemappteDatei> lsb;
+  // Eine pro Subset. Zur Geometrie immer diese verwenden, SubSet::children_Vertex/children_Face sind bei LSB-Dateien leer.
+  std::vector<SubsetGeometrie> geometrie;
+  // Eine pro Subset.
+  std::vector<SubsetMaterial> materialien;
+
+  // Von Subset- und Verknuepfungsanimationen verwendete AniIDs ("Spuren").
+  std::vector<int> ani_ids;
+  // Eine Bindung pro Subset bzw. pro Verknuepfung.
+  std::vector<AnimationsBindung> subset_animationen;
+  std::vector<AnimationsBindung> verkn_animationen;
+
+  const Landschaft& landschaft() const {
+    return *zusi->Landschaft;
+  }
+
+  // Position jeder Spur fuer die angegebenen Animationspositionen (nicht angegebene AniIDs: 0).
+  std::vector<float> spurPositionen(const std::unordered_map<int, float>& ani_positionen) const;
+
+  // Animierte Lage fuer die Bindung bei den angegebenen Spurpositionen; nullopt, wenn nicht animiert.
+  static std::optional<AniPunkt> animation(const AnimationsBindung& bindung, const std::vector<float>& spur_positionen);
+};
+
+// Prozessweiter Cache geladener LS3-Dateien, der ls3render_Reset ueberlebt.
+// Schluessel ist der kanonische Pfad; geaenderte Dateien (Groesse/Aenderungszeit) werden neu geladen.
+class Ls3Cache {
+ public:
+  static Ls3Cache& instance();
+
+  // Gibt die Datei aus dem Cache zurueck oder laedt sie. nullptr bei Fehlschlag.
+  std::shared_ptr<const Ls3Datei> lade(const zusixml::ZusiPfad& dateiname);
+
+  // Entfernt alle Eintraege. Dateien, die noch von einer Szene verwendet werden, bleiben bis dahin gueltig.
+  void leere();
+
+ private:
+  Ls3Cache() = default;
+
+  std::mutex m_mutex;
+  std::unordered_map<std::string, std::shared_ptr<const Ls3Datei>> m_dateien;
+};
+
+}
@@ -6,7 +6,6 @@
 
 #define GLEW_STATIC
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -19,20 +18,37 @@
 #include "zusi_parser/zusi_types.hpp"
 #include "zusi_parser/utils.hpp"
 
+#include "./gl_context.hpp"
 #include "./macros.hpp"
 #include "./texture.hpp"
 #include "./scene.hpp"
+#include "./ls3_cache.hpp"
+#include "./mesh_simplifier.hpp"
+#include "./readback.hpp"
+#include "./render_target.hpp"
+#include "./scene_cache.hpp"
+#include "./software_renderer.hpp"
+#include "./texture_manager.hpp"
+#include "./shader_manager.hpp"
 #include "./shader_parameters.hpp"
 #include "./render_object.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <utility>
 
 #ifdef HAVE_RENDERDOC
@@ -43,89 +59,155 @@ using namespace ls3render;
 
 namespace {
 
-static const std::string vs_source = 
-#include "./assets/vertex_shader.glsl"
-;
-
-static const std::string fs_source = 
-#include "./assets/fragment_shader.glsl"
-;
-
-void glfw_error_callback(int error, const char* description) {
-  std::cerr << "GLFW error " << error << ": " << description << std::endl;
-}
-
-}
-
-static Scene m_Scene {};
-static ShaderParameters m_ShaderParameters {};
-static std::unordered_map<int, float> m_AniPositionen {
-  { 6, 0.5f },   // Gleiskruemmung
-  { 7, 0.5f },   // Gleiskruemmung
-  { 14, 0.5f },  // Neigetechnik
-};
-static int m_PixelProMeter { 50 };
-static int m_Multisampling { 0 };
-static auto m_BBox = std::make_pair<glm::vec3, glm::vec3>({}, {});
-
-static float m_ModelBackX { 0 };
-static float m_ModelFrontX { 0 };
-
-// Fixed values to allow aligning of separately generated images.
-static float m_ModelTopZ = { 5.5 };
-static float m_ModelBottomZ = { 0 };
-static float m_ModelLeftY = { -1.862 }; // loading gauge G2
-static float m_ModelRightY = { 1.862 }; // loading gauge G2
-
-static short m_OutputHeight { 0 };
-static short m_OutputWidth { 0 };
-static float m_cabinetAngle { glm::radians(45.0f) };  // Typically around 45 degrees
-static float m_cabinetScale { 0 }; // Foreshortening factor for the Y axis, typically 0.5
-static glm::mat4 m_lastFahrzeugTransform { 1 };
-static GLFWwindow* m_Window { nullptr };
 #ifdef HAVE_RENDERDOC
 RENDERDOC_API_1_3_0 *renderdoc_api { nullptr };
+std::once_flag renderdoc_geladen;
 #endif
 
-ls3render_EXPORT int ls3render_Init() {
+}  // namespace
+
+// Der gesamte Zustand eines Renderers. Geparste Dateien (Ls3Cache) und gelesene Texturen (DdsCache)
+// sind prozessweit und werden zwischen den Kontexten geteilt, alles GL-bezogene gehoert genau einem Kontext.
+struct ls3render_Context {
+  // Zuerst deklariert, damit der GL-Kontext erst nach allen GL-Objekten zerstoert wird
+  std::unique_ptr<GLKontext> kontext;
+  std::unique_ptr<ShaderManager> shaderManager;
+  TextureManager textureManager {};
+  RenderTargetPool renderTargets {};
+  ReadbackRing readback {};
+  // Statt des GL-Kontexts, wenn ohne OpenGL gezeichnet wird (LS3RENDER_KONTEXT=software)
+  std::unique_ptr<SoftwareRenderer> software;
+  Scene scene {};
+
+  std::unordered_map<int, float> aniPositionen {
+    { 6, 0.5f },   // Gleiskruemmung
+    { 7, 0.5f },   // Gleiskruemmung
+    { 14, 0.5f },  // Neigetechnik
+  };
+  int pixelProMeter { 50 };
+  int multisampling { 0 };
+  std::pair<glm::vec3, glm::vec3> bbox { {}, {} };
+
+  float modelBackX { 0 };
+  float modelFrontX { 0 };
+
+  // Fixed values to allow aligning of separately generated images.
+  float modelTopZ = { 5.5 };
+  float modelBottomZ = { 0 };
+  float modelLeftY = { -1.862 }; // loading gauge G2
+  float modelRightY = { 1.862 }; // loading gauge G2
+
+  int outputHeight { 0 };
+  int outputWidth { 0 };
+  // Vorgegebene Kachelgroesse, 0: automatisch (siehe kachelGroesse())
+  int kachelBreite { 0 };
+  int kachelHoehe { 0 };
+  // Groesste Render-Target-Kantenlaenge (Renderbuffer und Viewport), in init() abgefragt
+  int maxTargetGroesse { 0 };
+  // Subsets mit kleinerer projizierter Ausdehnung werden nicht gezeichnet, 0: aus
+  float mindestPixel { 0 };
+  // Zulaessige Abweichung vereinfachter Geometrie in Pixeln, 0: aus
+  float vereinfachungPixel { 0 };
+  float cabinetAngle { glm::radians(45.0f) };  // Typically around 45 degrees
+  float cabinetScale { 0 }; // Foreshortening factor for the Y axis, typically 0.5
+  glm::mat4 lastFahrzeugTransform { 1 };
+  // Von ls3render_BehalteBild behaltene Bilder aus renderBatch, die nicht im ReadbackRing liegen (ohne GL oder
+  // gekachelt gezeichnet). Kennungen unterhalb von readback.groesse() bezeichnen Slots des Rings.
+  std::map<int, std::vector<unsigned char>> behalteneBilder;
+  int naechsteBildKennung { 0 };
+  std::mutex bilderMutex;
+  std::condition_variable bildFreigegeben;
+  // Waehrend eines ErgebnisCallbacks: Kennung, unter der ls3render_BehalteBild das Bild behaelt, -1: keine
+  int callbackKennung { -1 };
+  bool callbackBehalten { false };
+
+  bool init();
+  void cleanup();
+
+  // Macht den GL-Kontext im aufrufenden Thread aktuell.
+  bool aktiviere();
+
+  void setOutputSize();
+  int addFahrzeug(const char* Dateiname, float OffsetX, float Fahrzeuglaenge, int Gedreht, float StromabnehmerHoehe, int Stromabnehmer1Oben, int Stromabnehmer2Oben, int Stromabnehmer3Oben, int Stromabnehmer4Oben, int SpitzenlichtVorneAn, int SpitzenlichtHintenAn, int SchlusslichtVorneAn, int SchlusslichtHintenAn);
+  int addBeladung(const char* Dateiname, float OffsetX, float OffsetY, float OffsetZ, float PhiX, float PhiY, float PhiZ);
+  // Groesse der Kacheln, in die das Bild zerlegt wird. Ohne Vorgabe das ganze Bild, soweit es in ein Render-Target passt.
+  std::pair<int, int> kachelGroesse() const;
+  bool einzelneKachel() const;
+  // Prueft die Bildgroesse, aktiviert den Kontext und laedt die Szene in den Grafikspeicher
+  // bzw. uebergibt sie an den Software-Renderer.
+  bool bereiteZeichnenVor();
+  // View- und Projektionsmatrix fuer den Bildausschnitt ab Pixel (x, y) (von unten links).
+  glm::mat4 ansicht(int x, int y, int breite, int hoehe) const;
+  // Zeichnet den Bildausschnitt ab Pixel (x, y) (von unten links) in das Render-Target;
+  // danach ist der Framebuffer mit dem Ergebnis als GL_FRAMEBUFFER gebunden.
+  bool zeichneKachel(RenderTarget& target, int x, int y, int breite, int hoehe);
+  // Zeichnet die Szene als eine Kachel; danach ist der Framebuffer mit dem Ergebnis als GL_FRAMEBUFFER gebunden.
+  bool zeichne();
+  // Zeichnet die Szene kachelweise, Streifen fuer Streifen von unten nach oben. Die Kacheln eines Streifens
+  // werden nach streifen(ersteZeile, anzahlZeilen) gelesen (Zeilenlaenge outputWidth), danach wird fertig(...) aufgerufen.
+  // Der Software-Renderer zeichnet jeden Streifen in ganzer Breite.
+  bool zeichneKacheln(const std::function<unsigned char*(int, int)>& streifen, const std::function<void(int, int)>& fertig);
+  int render(void* Ausgabepuffer);
+  int renderZeilen(ls3render_ZeilenCallback Callback, void* Benutzerdaten);
+  int renderBatch(const ls3render_Zug* Zuege, int AnzahlZuege, ls3render_ErgebnisCallback Callback, void* Benutzerdaten);
+  // Ruft Callback auf; gibt zurueck, ob das Bild dabei unter kennung behalten wurde.
+  bool meldeErgebnis(ls3render_ErgebnisCallback Callback, void* Benutzerdaten, int index, const void* bild, int breite, int hoehe, int verworfen, int kennung);
+  int behalteBild();
+  void gibBildFrei(int kennung);
+  void reset();
+};
+
+bool ls3render_Context::init() {
 #ifdef HAVE_RENDERDOC
-  if(void *mod = dlopen("librenderdoc.so", RTLD_NOW | RTLD_NOLOAD))
-  {
-    auto RENDERDOC_GetAPI = reinterpret_cast<pRENDERDOC_GetAPI>(dlsym(mod, "RENDERDOC_GetAPI"));
-    [[maybe_unused]] const int ret = RENDERDOC_GetAPI(eRENDERDOC_API_Version_1_3_0, (void **)&renderdoc_api);
-    assert(ret == 1);
-  }
+  std::call_once(renderdoc_geladen, []() {
+    if(void *mod = dlopen("librenderdoc.so", RTLD_NOW | RTLD_NOLOAD))
+    {
+      auto RENDERDOC_GetAPI = reinterpret_cast<pRENDERDOC_GetAPI>(dlsym(mod, "RENDERDOC_GetAPI"));
+      [[maybe_unused]] const int ret = RENDERDOC_GetAPI(eRENDERDOC_API_Version_1_3_0, (void **)&renderdoc_api);
+      assert(ret == 1);
+    }
+  });
 #endif
 
-  glfwSetErrorCallback(glfw_error_callback);
-  if (!glfwInit()) {
-    std::cerr << "Error initializing GLFW" << std::endl;
-    return false;
+  const char* backend_name = std::getenv("LS3RENDER_KONTEXT");
+  if (backend_name && std::string(backend_name) == "software") {
+    // Ohne OpenGL: keine Shader, Texturen und Render-Targets, Bilder beliebiger Groesse am Stueck
+    software = std::make_unique<SoftwareRenderer>();
+    maxTargetGroesse = std::numeric_limits<int>::max();
+    return true;
   }
 
-  // Require the OpenGL context to support at least OpenGL 3.2
-  TRY_GLFW(glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3));
-  TRY_GLFW(glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2));
-
-  // We want a context that supports only the new core functionality
-  TRY_GLFW(glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE));
-
-  TRY_GLFW(glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE));
-
-  TRY_GLFW(glfwWindowHint(GLFW_RESIZABLE, GL_FALSE));
-  TRY_GLFW(glfwWindowHint(GLFW_VISIBLE, GL_FALSE));
+  // GL_KHR_debug-Ausgabe in Debug-Builds oder mit gesetzter Umgebungsvariable LS3RENDER_GL_DEBUG
+#ifdef NDEBUG
+  const bool gl_debug = std::getenv("LS3RENDER_GL_DEBUG") != nullptr;
+#else
+  const bool gl_debug = true;
+#endif
 
-  // The GLFWwindow object encapsulates both a window and a context
-  // (which are inseparably linked).
-  m_Window = TRY_GLFW(glfwCreateWindow(1, 1, "ls3render",
-          nullptr,  // monitor if fullscreen
-          nullptr   // existing OpenGL context to share resources with
-          ));
-  TRY_GLFW(glfwMakeContextCurrent(m_Window));
+  // Kontext-Backend aus LS3RENDER_KONTEXT (glfw, egl, osmesa), sonst das erste, das funktioniert
+  if (backend_name) {
+    const auto backend = backendAusName(backend_name);
+    if (!backend) {
+      std::cerr << "Unknown LS3RENDER_KONTEXT " << backend_name << "\n";
+      return false;
+    }
+    kontext = erzeugeKontext(*backend, gl_debug);
+  } else {
+    for (const auto backend : standardBackends()) {
+      kontext = erzeugeKontext(backend, gl_debug);
+      if (kontext) {
+        break;
+      }
+    }
+  }
+  if (!kontext) {
+    std::cerr << "Error creating OpenGL context" << std::endl;
+    return false;
+  }
 
-  // Init GLEW
-  TRY_GLEW(glewInit());
-  // std::cerr << "Using GLEW " << glewGetString(GLEW_VERSION) << std::endl;
+  if (gl_debug) {
+    gldebug::aktiviereDebugAusgabe();
+  }
 
   if (!glewIsSupported("GL_EXT_texture_filter_anisotropic")) {
     std::cerr << "GLEW extension GL_EXT_texture_filter_anisotropic not supported\n";
@@ -138,89 +220,13 @@ ls3render_EXPORT int ls3render_Init() {
   }
 
   // Load shaders
-  GLuint vertex_shader;
-  TRY(vertex_shader = glCreateShader(GL_VERTEX_SHADER));
-  const char* c_str = vs_source.c_str();
-  TRY(glShaderSource(vertex_shader, 1, &c_str, nullptr));
-
-  GLuint fragment_shader;
-  TRY(fragment_shader = glCreateShader(GL_FRAGMENT_SHADER));
-  c_str = fs_source.c_str();
-  TRY(glShaderSource(fragment_shader, 1, &c_str, nullptr));
-
-  // Compile shaders
-  TRY(glCompileShader(vertex_shader));
-
-  GLint buflen;
-  TRY(glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &buflen));
-  if (buflen > 1) {
-    std::string buf;
-    buf.resize(buflen);
-    glGetShaderInfoLog(vertex_shader, buflen, nullptr, buf.data());
-    std::cerr << "Compiling vertex shader produced warnings or errors: " << buf << "\n";
-  }
-
-  GLint status;
-  TRY(glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &status));
-  if (status != GL_TRUE) {
-    std::cerr << "Compiling vertex shader failed.\n";
-    return false;
-  }
-
-  TRY(glCompileShader(fragment_shader));
-
-  TRY(glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &buflen));
-  if (buflen > 1) {
-    std::string buf;
-    buf.resize(buflen);
-    glGetShaderInfoLog(fragment_shader, buflen, nullptr, buf.data());
-    std::cerr << "Compiling fragment shader produced warnings or errors: " << buf << "\n";
-  }
-
-  TRY(glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &status));
-  if (status != GL_TRUE) {
-    std::cerr << "Compiling fragment shader failed.\n";
+  try {
+    shaderManager = std::make_unique<ShaderManager>();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
     return false;
   }
 
-  // Combine vertex and fragment shaders into a program
-  GLuint shader_program = glCreateProgram();
-  TRY(glAttachShader(shader_program, vertex_shader));
-  TRY(glAttachShader(shader_program, fragment_shader));
-
-  // Bind output of fragment shader to buffer
-  // TODO: only after creating frame-/renderbuffers?
-  TRY(glBindFragDataLocation(shader_program, 0, "outColor"));  // not necessary because there is only one output
-
-  // Link and use program
-  TRY(glLinkProgram(shader_program));
-  TRY(glUseProgram(shader_program));
-
-  // Vertex shader inputs
-  m_ShaderParameters.attrib_pos = glGetAttribLocation(shader_program, "position");
-  m_ShaderParameters.attrib_nor = glGetAttribLocation(shader_program, "normal");
-  m_ShaderParameters.attrib_uv1 = glGetAttribLocation(shader_program, "uv1");
-  m_ShaderParameters.attrib_uv2 = glGetAttribLocation(shader_program, "uv2");
-
-  // Bind uniform variables
-  // Vertex shader
-  m_ShaderParameters.uni_nor = glGetUniformLocation(shader_program, "nor");
-  m_ShaderParameters.uni_model = glGetUniformLocation(shader_program, "model");
-  m_ShaderParameters.uni_view = glGetUniformLocation(shader_program, "view");
-  m_ShaderParameters.uni_proj = glGetUniformLocation(shader_program, "proj");
-  m_ShaderParameters.uni_shear = glGetUniformLocation(shader_program, "shear");
-  m_ShaderParameters.uni_diffuse_color = glGetUniformLocation(shader_program, "diffuseColor");
-  m_ShaderParameters.uni_emissive_color = glGetUniformLocation(shader_program, "emissiveColor");
-
-  // Fragment shader
-  m_ShaderParameters.uni_tex.push_back(glGetUniformLocation(shader_program, "tex1"));
-  m_ShaderParameters.uni_tex.push_back(glGetUniformLocation(shader_program, "tex2"));
-  m_ShaderParameters.uni_numTextures = glGetUniformLocation(shader_program, "numTextures");
-  m_ShaderParameters.uni_alphaCutoff = glGetUniformLocation(shader_program, "alphaCutoff");
-  m_ShaderParameters.uni_texVoreinstellung = glGetUniformLocation(shader_program, "texVoreinstellung");
-
-  m_ShaderParameters.validate();
-
   // Enable depth test
   TRY(glEnable(GL_DEPTH_TEST));
 
@@ -231,58 +237,69 @@ ls3render_EXPORT int ls3render_Init() {
   // Enable depth offset
   TRY(glEnable(GL_POLYGON_OFFSET_FILL));
 
-  return true;
-}
+  // Groessere Bilder werden gekachelt
+  GLint renderbuffer = 0;
+  GLint viewport[2] = { 0, 0 };
+  TRY(glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer));
+  TRY(glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport));
+  maxTargetGroesse = std::max(1, std::min({ renderbuffer, viewport[0], viewport[1] }));
 
-ls3render_EXPORT int ls3render_Cleanup() {
-  TRY_GLFW(glfwTerminate());  // Destroys any remaining windows
+  TRY_CHECKPOINT("ls3render_Init");
   return true;
 }
 
-void SetOutputSize() {
-  assert(m_ModelBackX <= m_ModelFrontX);
-  assert(m_ModelTopZ >= m_ModelBottomZ);
-
-  m_OutputHeight = (m_ModelTopZ - m_ModelBottomZ) * m_PixelProMeter;
-  m_OutputWidth = (m_ModelFrontX - m_ModelBackX) * m_PixelProMeter;
-
-  const float cabinetX = m_cabinetScale * cos(m_cabinetAngle);
-  const float cabinetY = m_cabinetScale * sin(m_cabinetAngle);
-  m_OutputWidth += std::abs(cabinetX) * (std::abs(m_ModelRightY) + std::abs(m_ModelLeftY)) * m_PixelProMeter;
-  m_OutputHeight += std::abs(cabinetY) * (std::abs(m_ModelRightY) + std::abs(m_ModelLeftY)) * m_PixelProMeter;
+void ls3render_Context::cleanup() {
+  // GL-Objekte freigeben, solange der Kontext noch existiert
+  if (kontext) {
+    kontext->makeCurrent();
+  }
+  scene = Scene {};
+  if (!software) {
+    // Ohne GL-Kontext sind die Funktionszeiger von GLEW nicht initialisiert
+    textureManager.clear();
+    renderTargets.clear();
+    readback.clear();
+  }
+  shaderManager.reset();
+  software.reset();
+  kontext.reset();
 }
 
-ls3render_EXPORT void ls3render_SetPixelProMeter(int PixelProMeter) {
-  assert(PixelProMeter > 0);
-  m_PixelProMeter = PixelProMeter;
-  SetOutputSize();
+bool ls3render_Context::aktiviere() {
+  if (!kontext) {
+    std::cerr << "ls3render context is not initialized" << std::endl;
+    return false;
+  }
+  return kontext->makeCurrent();
 }
 
-ls3render_EXPORT void ls3render_SetMultisampling(int Samples) {
-  assert(Samples >= 0);
-  m_Multisampling = Samples;
-}
+void ls3render_Context::setOutputSize() {
+  assert(modelBackX <= modelFrontX);
+  assert(modelTopZ >= modelBottomZ);
 
-ls3render_EXPORT void ls3render_SetAxonometrieParameter(float Winkel, float Skalierung) {
-  m_cabinetAngle = Winkel;
-  m_cabinetScale = Skalierung;
-  SetOutputSize();
+  outputHeight = (modelTopZ - modelBottomZ) * pixelProMeter;
+  outputWidth = (modelFrontX - modelBackX) * pixelProMeter;
+
+  const float cabinetX = cabinetScale * cos(cabinetAngle);
+  const float cabinetY = cabinetScale * sin(cabinetAngle);
+  outputWidth += std::abs(cabinetX) * (std::abs(modelRightY) + std::abs(modelLeftY)) * pixelProMeter;
+  outputHeight += std::abs(cabinetY) * (std::abs(modelRightY) + std::abs(modelLeftY)) * pixelProMeter;
 }
 
-ls3render_EXPORT int ls3render_AddFahrzeug(const char* Dateiname, float OffsetX, float Fahrzeuglaenge, int Gedreht, float StromabnehmerHoehe, int Stromabnehmer1Oben, int Stromabnehmer2Oben, int Stromabnehmer3Oben, int Stromabnehmer4Oben, int SpitzenlichtVorneAn, int SpitzenlichtHintenAn, int SchlusslichtVorneAn, int SchlusslichtHintenAn) {
+int ls3render_Context::addFahrzeug(const char* Dateiname, float OffsetX, float Fahrzeuglaenge, int Gedreht, float StromabnehmerHoehe, int Stromabnehmer1Oben, int Stromabnehmer2Oben, int Stromabnehmer3Oben, int Stromabnehmer4Oben, int SpitzenlichtVorneAn, int SpitzenlichtHintenAn, int SchlusslichtVorneAn, int SchlusslichtHintenAn) {
   try {
     constexpr float kMaxStromabnehmerHoehe = 2.5;
-    const float stromabnehmerAniPos = glm::clamp((m_ModelTopZ - StromabnehmerHoehe) / kMaxStromabnehmerHoehe, 0.0f, 1.0f);
-    m_AniPositionen[8] = Stromabnehmer1Oben ? stromabnehmerAniPos : 0.0f;
-    m_AniPositionen[9] = Stromabnehmer2Oben ? stromabnehmerAniPos : 0.0f;
-    m_AniPositionen[10] = Stromabnehmer3Oben ? stromabnehmerAniPos : 0.0f;
-    m_AniPositionen[11] = Stromabnehmer4Oben ? stromabnehmerAniPos : 0.0f;
-
-    m_lastFahrzeugTransform = glm::mat4 { 1 };
-    m_lastFahrzeugTransform = glm::translate(m_lastFahrzeugTransform, glm::vec3(-OffsetX, 0.0f, 0.0f));
+    const float stromabnehmerAniPos = glm::clamp((modelTopZ - StromabnehmerHoehe) / kMaxStromabnehmerHoehe, 0.0f, 1.0f);
+    aniPositionen[8] = Stromabnehmer1Oben ? stromabnehmerAniPos : 0.0f;
+    aniPositionen[9] = Stromabnehmer2Oben ? stromabnehmerAniPos : 0.0f;
+    aniPositionen[10] = Stromabnehmer3Oben ? stromabnehmerAniPos : 0.0f;
+    aniPositionen[11] = Stromabnehmer4Oben ? stromabnehmerAniPos : 0.0f;
+
+    lastFahrzeugTransform = glm::mat4 { 1 };
+    lastFahrzeugTransform = glm::translate(lastFahrzeugTransform, glm::vec3(-OffsetX, 0.0f, 0.0f));
     if (Gedreht) {
-      m_lastFahrzeugTransform = glm::translate(m_lastFahrzeugTransform, glm::vec3(-Fahrzeuglaenge, 0.0f, 0.0f));
-      m_lastFahrzeugTransform = glm::rotate(m_lastFahrzeugTransform, 3.141592f, glm::vec3(0.0f, 0.0f, 1.0f));
+      lastFahrzeugTransform = glm::translate(lastFahrzeugTransform, glm::vec3(-Fahrzeuglaenge, 0.0f, 0.0f));
+      lastFahrzeugTransform = glm::rotate(lastFahrzeugTransform, 3.141592f, glm::vec3(0.0f, 0.0f, 1.0f));
     }
 
     const LichterSchaltung lichterSchaltung {
@@ -291,15 +308,15 @@ ls3render_EXPORT int ls3render_AddFahrzeug(const char* Dateiname, float OffsetX,
       SchlusslichtVorneAn != 0,
       SchlusslichtHintenAn != 0,
     };
-    if (!m_Scene.LadeLandschaft(zusixml::ZusiPfad::vonOsPfad(Dateiname), m_lastFahrzeugTransform, m_AniPositionen, lichterSchaltung)) {
+    if (!scene.LadeLandschaft(zusixml::ZusiPfad::vonOsPfad(Dateiname), lastFahrzeugTransform, aniPositionen, lichterSchaltung)) {
       return false;
     }
 
-    m_Scene.UpdateBoundingBox(&m_BBox);
+    scene.UpdateBoundingBox(&bbox);
 
-    m_ModelBackX = m_BBox.first.x;
-    m_ModelFrontX = m_BBox.second.x;
-    SetOutputSize();
+    modelBackX = bbox.first.x;
+    modelFrontX = bbox.second.x;
+    setOutputSize();
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return false;
@@ -310,27 +327,27 @@ ls3render_EXPORT int ls3render_AddFahrzeug(const char* Dateiname, float OffsetX,
   return true;
 }
 
-ls3render_EXPORT int ls3render_AddBeladung(const char* Dateiname, float OffsetX, float OffsetY, float OffsetZ, float PhiX, float PhiY, float PhiZ)
+int ls3render_Context::addBeladung(const char* Dateiname, float OffsetX, float OffsetY, float OffsetZ, float PhiX, float PhiY, float PhiZ)
 {
   try {
-    m_AniPositionen[8] = 0;
-    m_AniPositionen[9] = 0;
-    m_AniPositionen[10] = 0;
-    m_AniPositionen[11] = 0;
+    aniPositionen[8] = 0;
+    aniPositionen[9] = 0;
+    aniPositionen[10] = 0;
+    aniPositionen[11] = 0;
 
     const glm::mat4 transform = glm::translate(glm::vec3(-OffsetX, OffsetY, OffsetZ))
       * glm::eulerAngleXYZ(PhiX, PhiY, PhiZ)
-      * m_lastFahrzeugTransform;
+      * lastFahrzeugTransform;
 
-    if (!m_Scene.LadeLandschaft(zusixml::ZusiPfad::vonOsPfad(Dateiname), transform, m_AniPositionen, LichterSchaltung{})) {
+    if (!scene.LadeLandschaft(zusixml::ZusiPfad::vonOsPfad(Dateiname), transform, aniPositionen, LichterSchaltung{})) {
       return false;
     }
 
-    m_Scene.UpdateBoundingBox(&m_BBox);
+    scene.UpdateBoundingBox(&bbox);
 
-    m_ModelBackX = m_BBox.first.x;
-    m_ModelFrontX = m_BBox.second.x;
-    SetOutputSize();
+    modelBackX = bbox.first.x;
+    modelFrontX = bbox.second.x;
+    setOutputSize();
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return false;
@@ -341,136 +358,122 @@ ls3render_EXPORT int ls3render_AddBeladung(const char* Dateiname, float OffsetX,
   return true;
 }
 
-ls3render_EXPORT int ls3render_GetBildbreite() {
-  return m_OutputWidth;
-}
-
-ls3render_EXPORT int ls3render_GetBildhoehe() {
-  return m_OutputHeight;
+std::pair<int, int> ls3render_Context::kachelGroesse() const {
+  // Ohne Vorgabe werden zu grosse Kanten in Kacheln dieser Laenge zerlegt
+  static constexpr int kAutomatischeKachel = 4096;
+  const auto kante = [this](int bild, int vorgabe) {
+    if (vorgabe > 0) {
+      return std::min({ bild, vorgabe, maxTargetGroesse });
+    }
+    return bild <= maxTargetGroesse ? bild : std::min(kAutomatischeKachel, maxTargetGroesse);
+  };
+  return { kante(outputWidth, kachelBreite), kante(outputHeight, kachelHoehe) };
 }
 
-ls3render_EXPORT int ls3render_GetAusgabepufferGroesse() {
-  return m_OutputWidth * m_OutputHeight * 4;
+bool ls3render_Context::einzelneKachel() const {
+  return kachelGroesse() == std::make_pair(outputWidth, outputHeight);
 }
 
-ls3render_EXPORT int ls3render_Render(void* Ausgabepuffer) {
-  if (m_OutputWidth <= 0 || m_OutputHeight <= 0) {
+bool ls3render_Context::bereiteZeichnenVor() {
+  if (outputWidth <= 0 || outputHeight <= 0) {
     std::cerr << "Output width and height must both be > 0" << std::endl;
     return false;
   }
 
-#ifdef HAVE_RENDERDOC
-  if (renderdoc_api) {
-    renderdoc_api->StartFrameCapture(nullptr, nullptr);
-  }
-#endif
-
-  // Create and bind framebuffer & renderbuffer
-  GLuint framebuffer;
-  TRY(glGenFramebuffers(1, &framebuffer));
-  TRY(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
-
-  GLuint color_renderbuffer;
-  TRY(glGenRenderbuffers(1, &color_renderbuffer));
-  TRY(glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer));
-
-  TRY(glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, m_OutputWidth, m_OutputHeight));
-  TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));  // don't know why that is necessary
-
-  TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer));
-
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "Non-multisampling framebuffer is not complete" << std::endl;
-    return false;
+  // Subsets werden gegen das ganze Bild geprueft, nicht gegen einzelne Kacheln
+  SichtVolumen sicht;
+  sicht.viewProj = ansicht(0, 0, outputWidth, outputHeight);
+  sicht.bildBreite = static_cast<float>(outputWidth);
+  sicht.bildHoehe = static_cast<float>(outputHeight);
+  sicht.mindestPixel = mindestPixel;
+
+  if (software) {
+    std::vector<SoftwareDraw> draws;
+    scene.SammleSoftwareDraws(static_cast<float>(pixelProMeter), vereinfachungPixel, sicht, &draws);
+    if (!software->bereiteVor(draws, sicht.viewProj, outputWidth, outputHeight, multisampling)) {
+      std::cerr << "Preparing software rendering failed\n";
+      return false;
+    }
+    return true;
   }
 
-  // Create and bind multisampling framebuffer & renderbuffers
-  GLuint framebuffer_multisample;
-  TRY(glGenFramebuffers(1, &framebuffer_multisample));
-  TRY(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_multisample));
-
-  GLuint color_renderbuffer_multisample;
-  TRY(glGenRenderbuffers(1, &color_renderbuffer_multisample));
-  TRY(glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer_multisample));
-
-  TRY(glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_Multisampling, GL_RGBA, m_OutputWidth, m_OutputHeight));
-  TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));  // don't know why that is necessary
-
-  TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer_multisample));
-
-  GLuint depth_renderbuffer_multisample;
-  TRY(glGenRenderbuffers(1, &depth_renderbuffer_multisample));
-  TRY(glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer_multisample));
-
-  TRY(glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_Multisampling, GL_DEPTH_COMPONENT, m_OutputWidth, m_OutputHeight));
-  TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));
-
-  TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer_multisample));
-
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    std::cerr << "Multisampling framebuffer is not complete" << std::endl;
+  if (!aktiviere()) {
     return false;
   }
 
   // Load data into graphics card memory
-  if (!m_Scene.LoadIntoGraphicsCardMemory()) {
+  if (!scene.LoadIntoGraphicsCardMemory(textureManager, shaderManager->getShaderParameters(), static_cast<float>(pixelProMeter), vereinfachungPixel, sicht)) {
     std::cerr << "Loading data into graphics card memory failed\n";
     return false;
   }
+  TRY_CHECKPOINT("LoadIntoGraphicsCardMemory");
+  return true;
+}
 
+glm::mat4 ls3render_Context::ansicht(int x, int y, int breite, int hoehe) const {
   // Right-side view.
   const glm::mat4 view = glm::lookAt(
       glm::vec3(0.0f,  0.0f, 0.0f),  // position
       glm::vec3(0.0f, -1.0f, 0.0f),  // lookat
       glm::vec3(0.0f,  0.0f, 1.0f));  // up
-  TRY(glUniformMatrix4fv(m_ShaderParameters.uni_view, 1, GL_FALSE, glm::value_ptr(view)));
 
   // Create an oblique projection matrix (cabinet effect) by shearing the model along the Z-axis.
   // After the view transform, we are in camera space: camera at origin facing -z, y up, x right.
   glm::mat4 shear{1};
-  const float cabinetX = m_cabinetScale * cos(m_cabinetAngle);
-  const float cabinetY = m_cabinetScale * sin(m_cabinetAngle);
+  const float cabinetX = cabinetScale * cos(cabinetAngle);
+  const float cabinetY = cabinetScale * sin(cabinetAngle);
   shear[2][0] = -cabinetX; // X axis distortion: x += scale * -z * cos(alpha).
   shear[2][1] = -cabinetY; // Y axis distortion: y += scale * -z * sin(alpha).
 
-  TRY(glUniformMatrix4fv(m_ShaderParameters.uni_shear, 1, GL_FALSE, glm::value_ptr(shear)));
-
   // World space x coordinates are in the range (-oo, 0).
   // Camera space x coordinates are in the range (0, oo).
-  const float left = -m_ModelFrontX - std::abs(cabinetX) * m_ModelRightY; // left
-  const float right = -m_ModelBackX - std::abs(cabinetX) * m_ModelLeftY; // right
+  const float left = -modelFrontX - std::abs(cabinetX) * modelRightY; // left
+  const float right = -modelBackX - std::abs(cabinetX) * modelLeftY; // right
 
   // Camera space y coordinates correspond to world space z coordinates.
-  const float bottom = m_ModelBottomZ - std::abs(cabinetY) * m_ModelRightY; // bottom
-  const float top = m_ModelTopZ - std::abs(cabinetY) * m_ModelLeftY; // top
+  const float bottom = modelBottomZ - std::abs(cabinetY) * modelRightY; // bottom
+  const float top = modelTopZ - std::abs(cabinetY) * modelLeftY; // top
 
   // Camera space z coordinates correspond to world space y coordinates.
-  const float zNear = m_BBox.first.y - .01f; // zNear
-  const float zFar = m_BBox.second.y + .01f; // zFar
+  const float zNear = bbox.first.y - .01f; // zNear
+  const float zFar = bbox.second.y + .01f; // zFar
+
+  // Die Projektion ist linear, der Ausschnitt einer Kachel ergibt sich also anteilig aus dem ganzen Bild
+  const auto teil = [](float von, float bis, int pixel, int gesamt) {
+    return von + (bis - von) * (static_cast<float>(pixel) / static_cast<float>(gesamt));
+  };
+  const glm::mat4 proj = glm::ortho(
+      teil(left, right, x, outputWidth), teil(left, right, x + breite, outputWidth),
+      teil(bottom, top, y, outputHeight), teil(bottom, top, y + hoehe, outputHeight),
+      zNear, zFar);
+  return proj * shear * view;
+}
 
-  const glm::mat4 proj = glm::ortho(left, right, bottom, top, zNear, zFar);
-  TRY(glUniformMatrix4fv(m_ShaderParameters.uni_proj, 1, GL_FALSE, glm::value_ptr(proj)));
+bool ls3render_Context::zeichneKachel(RenderTarget& render_target, int x, int y, int breite, int hoehe) {
+#ifdef HAVE_RENDERDOC
+  if (renderdoc_api) {
+    renderdoc_api->StartFrameCapture(nullptr, nullptr);
+  }
+#endif
 
-  TRY(glViewport(0, 0, m_OutputWidth, m_OutputHeight));
+  const ShaderParameters& shader_parameters = shaderManager->getShaderParameters();
+  TRY(glBindFramebuffer(GL_FRAMEBUFFER, render_target.drawFramebuffer()));
+
+  const glm::mat4 viewProj = ansicht(x, y, breite, hoehe);
+  TRY(glUniformMatrix4fv(shader_parameters.uni_viewProj, 1, GL_FALSE, glm::value_ptr(viewProj)));
+
+  TRY(glViewport(0, 0, breite, hoehe));
   TRY(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
   TRY(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
-  m_Scene.Render(m_ShaderParameters);
-  m_Scene.FreeGraphicsCardMemory();
+  scene.Render(shader_parameters);
+  TRY_CHECKPOINT("Scene::Render");
 
-  TRY(glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_multisample));
-  TRY(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer));
-  TRY(glBlitFramebuffer(0, 0, m_OutputWidth, m_OutputHeight, 0, 0, m_OutputWidth, m_OutputHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR));
-
-  TRY(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
-  TRY(glReadBuffer(GL_COLOR_ATTACHMENT0));
-  TRY(glReadPixels(0, 0, m_OutputWidth, m_OutputHeight, GL_BGRA, GL_UNSIGNED_BYTE, Ausgabepuffer));
+  if (!render_target.resolve()) {
+    return false;
+  }
 
-  TRY(glDeleteFramebuffers(1, &framebuffer));
-  TRY(glDeleteRenderbuffers(1, &color_renderbuffer));
-  TRY(glDeleteFramebuffers(1, &framebuffer_multisample));
-  TRY(glDeleteRenderbuffers(1, &color_renderbuffer_multisample));
-  TRY(glDeleteRenderbuffers(1, &depth_renderbuffer_multisample));
+  TRY(glBindFramebuffer(GL_FRAMEBUFFER, render_target.readFramebuffer()));
 
 #ifdef HAVE_RENDERDOC
   if (renderdoc_api) {
@@ -481,7 +484,457 @@ ls3render_EXPORT int ls3render_Render(void* Ausgabepuffer) {
   return true;
 }
 
+bool ls3render_Context::zeichne() {
+  if (!bereiteZeichnenVor()) {
+    return false;
+  }
+
+  RenderTarget* render_target = renderTargets.get(outputWidth, outputHeight, multisampling);
+  if (!render_target) {
+    std::cerr << "Creating render target failed\n";
+    return false;
+  }
+  return zeichneKachel(*render_target, 0, 0, outputWidth, outputHeight);
+}
+
+bool ls3render_Context::zeichneKacheln(const std::function<unsigned char*(int, int)>& streifen, const std::function<void(int, int)>& fertig) {
+  if (!bereiteZeichnenVor()) {
+    return false;
+  }
+
+  if (software) {
+    const int kachel_hoehe = kachelGroesse().second;
+    for (int y = 0; y < outputHeight; y += kachel_hoehe) {
+      const int hoehe = std::min(kachel_hoehe, outputHeight - y);
+      software->zeichne(y, hoehe, streifen(y, hoehe));
+      fertig(y, hoehe);
+    }
+    return true;
+  }
+
+  // Alle Kacheln teilen sich ein Render-Target; die Kacheln am rechten und oberen Rand nutzen es nur teilweise
+  const auto [kachel_breite, kachel_hoehe] = kachelGroesse();
+  RenderTarget* render_target = renderTargets.get(kachel_breite, kachel_hoehe, multisampling);
+  if (!render_target) {
+    std::cerr << "Creating render target failed\n";
+    return false;
+  }
+
+  for (int y = 0; y < outputHeight; y += kachel_hoehe) {
+    const int hoehe = std::min(kachel_hoehe, outputHeight - y);
+    unsigned char* ziel = streifen(y, hoehe);
+    for (int x = 0; x < outputWidth; x += kachel_breite) {
+      const int breite = std::min(kachel_breite, outputWidth - x);
+      if (!zeichneKachel(*render_target, x, y, breite, hoehe)) {
+        return false;
+      }
+      TRY(glReadBuffer(GL_COLOR_ATTACHMENT0));
+      TRY(glPixelStorei(GL_PACK_ROW_LENGTH, outputWidth));
+      TRY(glReadPixels(0, 0, breite, hoehe, GL_BGRA, GL_UNSIGNED_BYTE, ziel + static_cast<size_t>(x) * 4));
+      TRY(glPixelStorei(GL_PACK_ROW_LENGTH, 0));
+      TRY_CHECKPOINT("glReadPixels");
+    }
+    fertig(y, hoehe);
+  }
+  return true;
+}
+
+int ls3render_Context::render(void* Ausgabepuffer) {
+  if (software || !einzelneKachel()) {
+    // Direkt in den Ausgabepuffer, Zeile fuer Zeile an die richtige Stelle
+    auto* ausgabe = static_cast<unsigned char*>(Ausgabepuffer);
+    return zeichneKacheln(
+        [&](int zeile, int) { return ausgabe + static_cast<size_t>(zeile) * outputWidth * 4; },
+        [](int, int) {});
+  }
+
+  if (!zeichne()) {
+    return false;
+  }
+
+  TRY(glReadBuffer(GL_COLOR_ATTACHMENT0));
+  TRY(glReadPixels(0, 0, outputWidth, outputHeight, GL_BGRA, GL_UNSIGNED_BYTE, Ausgabepuffer));
+  TRY_CHECKPOINT("glReadPixels");
+  return true;
+}
+
+int ls3render_Context::renderZeilen(ls3render_ZeilenCallback Callback, void* Benutzerdaten) {
+  // Im Speicher liegt immer nur ein Streifen von Kachelhoehe Zeilen
+  std::vector<unsigned char> streifen;
+  return zeichneKacheln(
+      [&](int, int anzahl) {
+        streifen.resize(static_cast<size_t>(anzahl) * outputWidth * 4);
+        return streifen.data();
+      },
+      [&](int zeile, int anzahl) {
+        Callback(Benutzerdaten, zeile, anzahl, streifen.data(), outputWidth);
+      });
+}
+
+void ls3render_Context::reset() {
+  // Die Szene gibt beim Zerstoeren ihre GL-Objekte frei
+  if (kontext) {
+    kontext->makeCurrent();
+  }
+  scene = Scene {};
+  bbox = std::make_pair<glm::vec3, glm::vec3>({}, {});
+  modelBackX = 0;
+  modelFrontX = 0;
+  setOutputSize();
+}
+
+int ls3render_Context::renderBatch(const ls3render_Zug* Zuege, int AnzahlZuege, ls3render_ErgebnisCallback Callback, void* Benutzerdaten) {
+  // Die Pixel eines Zuges werden asynchron ausgelesen und erst abgeholt, wenn der Ring voll ist
+  // oder ein Zug fehlschlaegt, damit die Callbacks in der Reihenfolge der Zuege kommen.
+  // Mit ls3render_BehalteBild behaltene Bilder bleiben im Auslesepuffer, bis sie freigegeben werden.
+  // Die Szene wird fuer jeden Zug ersetzt, die Anzahl verworfener Subsets daher bis zum Callback aufbewahrt.
+  int erfolgreich = 0;
+  std::vector<int> verworfen(static_cast<size_t>(std::max(AnzahlZuege, 0)), 0);
+  naechsteBildKennung = 0;
+  const auto abholen = [&]() {
+    const bool ok = readback.holeAb([&](size_t slot, int index, const void* bild, int breite, int hoehe) {
+      if (bild) {
+        ++erfolgreich;
+      }
+      return meldeErgebnis(Callback, Benutzerdaten, index, bild, breite, hoehe, verworfen[index], static_cast<int>(slot));
+    });
+    if (!ok) {
+      std::cerr << "Reading back rendered image failed\n";
+    }
+  };
+
+  for (int i = 0; i < AnzahlZuege; i++) {
+    const ls3render_Zug& zug = Zuege[i];
+    reset();
+
+    assert(zug.PixelProMeter > 0);
+    assert(zug.Multisampling >= 0);
+    pixelProMeter = zug.PixelProMeter;
+    multisampling = zug.Multisampling;
+    cabinetAngle = zug.AxonometrieWinkel;
+    cabinetScale = zug.AxonometrieSkalierung;
+    setOutputSize();
+
+    bool ok = true;
+    for (int f = 0; ok && f < zug.AnzahlFahrzeuge; f++) {
+      const ls3render_Fahrzeug& fz = zug.Fahrzeuge[f];
+      ok = addFahrzeug(fz.Dateiname, fz.OffsetX, fz.Fahrzeuglaenge, fz.Gedreht, fz.StromabnehmerHoehe,
+          fz.Stromabnehmer1Oben, fz.Stromabnehmer2Oben, fz.Stromabnehmer3Oben, fz.Stromabnehmer4Oben,
+          fz.SpitzenlichtVorneAn, fz.SpitzenlichtHintenAn, fz.SchlusslichtVorneAn, fz.SchlusslichtHintenAn);
+      for (int b = 0; ok && b < fz.AnzahlBeladungen; b++) {
+        const ls3render_Beladung& bel = fz.Beladungen[b];
+        ok = addBeladung(bel.Dateiname, bel.OffsetX, bel.OffsetY, bel.OffsetZ, bel.PhiX, bel.PhiY, bel.PhiZ);
+      }
+    }
+
+    if (ok && (software || !einzelneKachel())) {
+      // Zu gross fuer ein Render-Target oder ohne GL: Direkt in ein eigenes Bild, vorher den Ring leeren,
+      // damit die Callbacks in der Reihenfolge der Zuege bleiben
+      while (!readback.leer()) {
+        abholen();
+      }
+      // Behaltene Bilder belegen wie im Ring hoechstens readback.groesse() Puffer
+      std::unique_lock<std::mutex> lock(bilderMutex);
+      bildFreigegeben.wait(lock, [this]() { return behalteneBilder.size() < readback.groesse(); });
+      lock.unlock();
+      std::vector<unsigned char> bild(static_cast<size_t>(outputWidth) * outputHeight * 4);
+      if (render(bild.data())) {
+        ++erfolgreich;
+        verworfen[i] = static_cast<int>(scene.VerworfeneSubsets());
+        // Vor dem Callback einsortieren, die Freigabe kann schon waehrend des Aufrufs kommen
+        const int kennung = static_cast<int>(readback.groesse()) + naechsteBildKennung++;
+        lock.lock();
+        const void* daten = behalteneBilder.emplace(kennung, std::move(bild)).first->second.data();
+        lock.unlock();
+        if (!meldeErgebnis(Callback, Benutzerdaten, i, daten, outputWidth, outputHeight, verworfen[i], kennung)) {
+          lock.lock();
+          behalteneBilder.erase(kennung);
+        }
+        continue;
+      }
+      ok = false;
+    }
+
+    ok = ok && zeichne();
+    if (ok) {
+      verworfen[i] = static_cast<int>(scene.VerworfeneSubsets());
+      if (readback.voll()) {
+        abholen();
+      }
+      ok = readback.starte(outputWidth, outputHeight, i);
+    }
+
+    if (!ok) {
+      while (!readback.leer()) {
+        abholen();
+      }
+      meldeErgebnis(Callback, Benutzerdaten, i, nullptr, outputWidth, outputHeight, verworfen[i], -1);
+    }
+  }
+
+  while (!readback.leer()) {
+    abholen();
+  }
+  if (!readback.warteAufFreigabe()) {
+    std::cerr << "Unmapping readback buffer failed\n";
+  }
+  {
+    std::unique_lock<std::mutex> lock(bilderMutex);
+    bildFreigegeben.wait(lock, [this]() { return behalteneBilder.empty(); });
+  }
+
+  reset();
+  return erfolgreich;
+}
+
+bool ls3render_Context::meldeErgebnis(ls3render_ErgebnisCallback Callback, void* Benutzerdaten, int index, const void* bild, int breite, int hoehe, int verworfen, int kennung) {
+  if (!Callback) {
+    return false;
+  }
+  callbackKennung = bild ? kennung : -1;
+  callbackBehalten = false;
+  Callback(Benutzerdaten, index, bild != nullptr, bild, breite, hoehe, verworfen);
+  callbackKennung = -1;
+  return callbackBehalten;
+}
+
+int ls3render_Context::behalteBild() {
+  if (callbackKennung < 0) {
+    return -1;
+  }
+  callbackBehalten = true;
+  return callbackKennung;
+}
+
+void ls3render_Context::gibBildFrei(int kennung) {
+  if (kennung < 0) {
+    return;
+  }
+  if (static_cast<size_t>(kennung) < readback.groesse()) {
+    readback.gibFrei(static_cast<size_t>(kennung));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(bilderMutex);
+    behalteneBilder.erase(kennung);
+  }
+  bildFreigegeben.notify_all();
+}
+
+ls3render_EXPORT ls3render_Context* ls3render_CreateContext() {
+  auto result = std::make_unique<ls3render_Context>();
+  if (!result->init()) {
+    result->cleanup();
+    return nullptr;
+  }
+  // Nicht im erzeugenden Thread aktuell lassen, damit der Kontext an einen anderen Thread uebergeben werden kann
+  if (result->kontext) {
+    result->kontext->gibFrei();
+  }
+  return result.release();
+}
+
+ls3render_EXPORT void ls3render_DestroyContext(ls3render_Context* Kontext) {
+  if (!Kontext) {
+    return;
+  }
+  Kontext->cleanup();
+  delete Kontext;
+}
+
+ls3render_EXPORT void ls3render_Context_SetPixelProMeter(ls3render_Context* Kontext, int PixelProMeter) {
+  assert(PixelProMeter > 0);
+  Kontext->pixelProMeter = PixelProMeter;
+  Kontext->setOutputSize();
+}
+
+ls3render_EXPORT void ls3render_Context_SetMultisampling(ls3render_Context* Kontext, int Samples) {
+  assert(Samples >= 0);
+  Kontext->multisampling = Samples;
+}
+
+ls3render_EXPORT void ls3render_Context_SetAxonometrieParameter(ls3render_Context* Kontext, float Winkel, float Skalierung) {
+  Kontext->cabinetAngle = Winkel;
+  Kontext->cabinetScale = Skalierung;
+  Kontext->setOutputSize();
+}
+
+ls3render_EXPORT int ls3render_Context_AddFahrzeug(ls3render_Context* Kontext, const char* Dateiname, float OffsetX, float Fahrzeuglaenge, int Gedreht, float StromabnehmerHoehe, int Stromabnehmer1Oben, int Stromabnehmer2Oben, int Stromabnehmer3Oben, int Stromabnehmer4Oben, int SpitzenlichtVorneAn, int SpitzenlichtHintenAn, int SchlusslichtVorneAn, int SchlusslichtHintenAn) {
+  return Kontext->addFahrzeug(Dateiname, OffsetX, Fahrzeuglaenge, Gedreht, StromabnehmerHoehe, Stromabnehmer1Oben, Stromabnehmer2Oben, Stromabnehmer3Oben, Stromabnehmer4Oben, SpitzenlichtVorneAn, SpitzenlichtHintenAn, SchlusslichtVorneAn, SchlusslichtHintenAn);
+}
+
+ls3render_EXPORT int ls3render_Context_AddBeladung(ls3render_Context* Kontext, const char* Dateiname, float OffsetX, float OffsetY, float OffsetZ, float PhiX, float PhiY, float PhiZ) {
+  return Kontext->addBeladung(Dateiname, OffsetX, OffsetY, OffsetZ, PhiX, PhiY, PhiZ);
+}
+
+ls3render_EXPORT int ls3render_Context_GetBildbreite(const ls3render_Context* Kontext) {
+  return Kontext->outputWidth;
+}
+
+ls3render_EXPORT int ls3render_Context_GetBildhoehe(const ls3render_Context* Kontext) {
+  return Kontext->outputHeight;
+}
+
+ls3render_EXPORT int ls3render_Context_GetAusgabepufferGroesse(const ls3render_Context* Kontext) {
+  const int64_t groesse = static_cast<int64_t>(Kontext->outputWidth) * Kontext->outputHeight * 4;
+  return groesse <= std::numeric_limits<int>::max() ? static_cast<int>(groesse) : -1;
+}
+
+ls3render_EXPORT int ls3render_Context_Render(ls3render_Context* Kontext, void* Ausgabepuffer) {
+  return Kontext->render(Ausgabepuffer);
+}
+
+ls3render_EXPORT void ls3render_Context_SetKachelgroesse(ls3render_Context* Kontext, int Breite, int Hoehe) {
+  assert(Breite >= 0 && Hoehe >= 0);
+  Kontext->kachelBreite = Breite;
+  Kontext->kachelHoehe = Hoehe;
+}
+
+ls3render_EXPORT void ls3render_Context_SetMindestgroesse(ls3render_Context* Kontext, float Pixel) {
+  assert(Pixel >= 0);
+  Kontext->mindestPixel = Pixel;
+}
+
+ls3render_EXPORT void ls3render_Context_SetVereinfachung(ls3render_Context* Kontext, float Pixel) {
+  assert(Pixel >= 0);
+  Kontext->vereinfachungPixel = Pixel;
+}
+
+ls3render_EXPORT int ls3render_Context_GetVerworfeneSubsets(const ls3render_Context* Kontext) {
+  return static_cast<int>(Kontext->scene.VerworfeneSubsets());
+}
+
+ls3render_EXPORT int ls3render_Context_RenderZeilen(ls3render_Context* Kontext, ls3render_ZeilenCallback Callback, void* Benutzerdaten) {
+  return Kontext->renderZeilen(Callback, Benutzerdaten);
+}
+
+ls3render_EXPORT int ls3render_Context_RenderBatch(ls3render_Context* Kontext, const ls3render_Zug* Zuege, int AnzahlZuege, ls3render_ErgebnisCallback Callback, void* Benutzerdaten) {
+  return Kontext->renderBatch(Zuege, AnzahlZuege, Callback, Benutzerdaten);
+}
+
+ls3render_EXPORT int ls3render_Context_BehalteBild(ls3render_Context* Kontext) {
+  return Kontext->behalteBild();
+}
+
+ls3render_EXPORT void ls3render_Context_GibBildFrei(ls3render_Context* Kontext, int Kennung) {
+  Kontext->gibBildFrei(Kennung);
+}
+
+ls3render_EXPORT void ls3render_Context_Reset(ls3render_Context* Kontext) {
+  Kontext->reset();
+}
+
+ls3render_EXPORT void ls3render_Context_FreeGrafikspeicher(ls3render_Context* Kontext) {
+  if (Kontext->kontext) {
+    Kontext->kontext->makeCurrent();
+  }
+  Kontext->scene.FreeGraphicsCardMemory();
+}
+
+ls3render_EXPORT void ls3render_Context_LeereCaches(ls3render_Context* Kontext) {
+  Ls3Cache::instance().leere();
+  DdsCache::instance().leere();
+  VereinfachungsCache::instance().leere();
+  if (SzenenCache* szenen_cache = SzenenCache::instance()) {
+    szenen_cache->leere();
+  }
+  if (Kontext->kontext) {
+    Kontext->kontext->makeCurrent();
+  }
+  Kontext->textureManager.evictUnused();
+  if (Kontext->software) {
+    Kontext->software->evictUnused();
+  }
+}
+
+// Der Standardkontext der globalen Funktionen
+static ls3render_Context m_Standard {};
+
+ls3render_EXPORT int ls3render_Init() {
+  return m_Standard.init();
+}
+
+ls3render_EXPORT int ls3render_Cleanup() {
+  m_Standard.cleanup();
+  return true;
+}
+
+ls3render_EXPORT void ls3render_SetPixelProMeter(int PixelProMeter) {
+  ls3render_Context_SetPixelProMeter(&m_Standard, PixelProMeter);
+}
+
+ls3render_EXPORT void ls3render_SetMultisampling(int Samples) {
+  ls3render_Context_SetMultisampling(&m_Standard, Samples);
+}
+
+ls3render_EXPORT void ls3render_SetAxonometrieParameter(float Winkel, float Skalierung) {
+  ls3render_Context_SetAxonometrieParameter(&m_Standard, Winkel, Skalierung);
+}
+
+ls3render_EXPORT int ls3render_AddFahrzeug(const char* Dateiname, float OffsetX, float Fahrzeuglaenge, int Gedreht, float StromabnehmerHoehe, int Stromabnehmer1Oben, int Stromabnehmer2Oben, int Stromabnehmer3Oben, int Stromabnehmer4Oben, int SpitzenlichtVorneAn, int SpitzenlichtHintenAn, int SchlusslichtVorneAn, int SchlusslichtHintenAn) {
+  return ls3render_Context_AddFahrzeug(&m_Standard, Dateiname, OffsetX, Fahrzeuglaenge, Gedreht, StromabnehmerHoehe, Stromabnehmer1Oben, Stromabnehmer2Oben, Stromabnehmer3Oben, Stromabnehmer4Oben, SpitzenlichtVorneAn, SpitzenlichtHintenAn, SchlusslichtVorneAn, SchlusslichtHintenAn);
+}
+
+ls3render_EXPORT int ls3render_AddBeladung(const char* Dateiname, float OffsetX, float OffsetY, float OffsetZ, float PhiX, float PhiY, float PhiZ) {
+  return ls3render_Context_AddBeladung(&m_Standard, Dateiname, OffsetX, OffsetY, OffsetZ, PhiX, PhiY, PhiZ);
+}
+
+ls3render_EXPORT int ls3render_GetBildbreite() {
+  return ls3render_Context_GetBildbreite(&m_Standard);
+}
+
+ls3render_EXPORT int ls3render_GetBildhoehe() {
+  return ls3render_Context_GetBildhoehe(&m_Standard);
+}
+
+ls3render_EXPORT int ls3render_GetAusgabepufferGroesse() {
+  return ls3render_Context_GetAusgabepufferGroesse(&m_Standard);
+}
+
+ls3render_EXPORT int ls3render_Render(void* Ausgabepuffer) {
+  return ls3render_Context_Render(&m_Standard, Ausgabepuffer);
+}
+
+ls3render_EXPORT void ls3render_SetKachelgroesse(int Breite, int Hoehe) {
+  ls3render_Context_SetKachelgroesse(&m_Standard, Breite, Hoehe);
+}
+
+ls3render_EXPORT void ls3render_SetMindestgroesse(float Pixel) {
+  ls3render_Context_SetMindestgroesse(&m_Standard, Pixel);
+}
+
+ls3render_EXPORT void ls3render_SetVereinfachung(float Pixel) {
+  ls3render_Context_SetVereinfachung(&m_Standard, Pixel);
+}
+
+ls3render_EXPORT int ls3render_GetVerworfeneSubsets() {
+  return ls3render_Context_GetVerworfeneSubsets(&m_Standard);
+}
+
+ls3render_EXPORT int ls3render_RenderZeilen(ls3render_ZeilenCallback Callback, void* Benutzerdaten) {
+  return ls3render_Context_RenderZeilen(&m_Standard, Callback, Benutzerdaten);
+}
+
+ls3render_EXPORT int ls3render_RenderBatch(const ls3render_Zug* Zuege, int AnzahlZuege, ls3render_ErgebnisCallback Callback, void* Benutzerdaten) {
+  return ls3render_Context_RenderBatch(&m_Standard, Zuege, AnzahlZuege, Callback, Benutzerdaten);
+}
+
+ls3render_EXPORT int ls3render_BehalteBild() {
+  return ls3render_Context_BehalteBild(&m_Standard);
+}
+
+ls3render_EXPORT void ls3render_GibBildFrei(int Kennung) {
+  ls3render_Context_GibBildFrei(&m_Standard, Kennung);
+}
+
 ls3render_EXPORT void ls3render_Reset() {
-  m_Scene = Scene {};
-  m_BBox = std::make_pair<glm::vec3, glm::vec3>({}, {});
+  ls3render_Context_Reset(&m_Standard);
+}
+
+ls3render_EXPORT void ls3render_FreeGrafikspeicher() {
+  ls3render_Context_FreeGrafikspeicher(&m_Standard);
+}
+
+ls3render_EXPORT void ls3render_LeereCaches() {
+  ls3render_Context_LeereCaches(&m_Standard);
 }
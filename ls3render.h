@@ -18,6 +18,14 @@ extern "C" {
 /**
  * Initialisiert die OpenGL-Umgebung.
  *
+ * Der OpenGL-Kontext wird ohne Display-Server ueber EGL (EGL_MESA_platform_surfaceless) oder OSMesa
+ * erzeugt, sofern ls3render mit WITH_EGL bzw. WITH_OSMESA gebaut wurde, sonst ueber ein verstecktes GLFW-Fenster.
+ * Die Umgebungsvariable LS3RENDER_KONTEXT (glfw, egl, osmesa) erzwingt ein bestimmtes Backend.
+ *
+ * Mit LS3RENDER_KONTEXT=software wird ganz ohne OpenGL auf der CPU gezeichnet, verteilt auf alle Prozessorkerne.
+ * Das Ergebnis entspricht bis auf Rundungsunterschiede dem OpenGL-Pfad; Multisampling wird dabei auf 2, 4 oder 8
+ * Samples aufgerundet. Bilder werden unabhaengig von @ref ls3render_SetKachelgroesse in ganzer Breite gezeichnet.
+ *
  * @return 1 bei Erfolg, 0 bei Fehlschlag.
  */
 ls3render_EXPORT int ls3render_Init();
@@ -52,6 +60,9 @@ ls3render_EXPORT void ls3render_SetAxonometrieParameter(float Winkel, float Skal
 /**
  * Fuegt ein neues Fahrzeug hinzu.
  *
+ * Zeigt die Umgebungsvariable LS3RENDER_SZENENCACHE auf ein Verzeichnis, wird der aufgeloeste Verknuepfungsbaum
+ * jeder Fahrzeugdatei dort zwischengespeichert und bei unveraenderten Dateien beim naechsten Mal nur noch gemappt.
+ *
  * Macht vorherige Rueckgabewerte von @ref ls3render_GetBildbreite, @ref ls3render_GetBildhoehe und @ref ls3render_GetAusgabepufferGroesse ungueltig.
  *
  * @param Dateiname Der Dateiname des Fahrzeugs (Dateisystempfad, kein Zusi-Pfad)
@@ -105,7 +116,8 @@ ls3render_EXPORT int ls3render_GetBildbreite();
 ls3render_EXPORT int ls3render_GetBildhoehe();
 
 /**
- * @return Die Groesse des notwendigen Ausgabepuffers in Bytes.
+ * @return Die Groesse des notwendigen Ausgabepuffers in Bytes, -1 wenn sie nicht als int darstellbar ist
+ *   (dann @ref ls3render_RenderZeilen verwenden).
  */
 ls3render_EXPORT int ls3render_GetAusgabepufferGroesse();
 
@@ -117,10 +129,279 @@ ls3render_EXPORT int ls3render_GetAusgabepufferGroesse();
 ls3render_EXPORT int ls3render_Render(void* Ausgabepuffer);
 
 /**
- * Entfernt alle Fahrzeuge.
+ * Legt fest, in welche Kacheln das Bild beim Rendern zerlegt wird.
+ *
+ * Jede Kachel wird einzeln in ein Render-Target dieser Groesse gezeichnet, der Grafikspeicherbedarf haengt
+ * dann nur von der Kachelgroesse ab und nicht von der Bildgroesse. Das Ergebnis ist dasselbe wie ohne Kacheln.
+ * Standardmaessig (0) wird nur gekachelt, wenn das Bild groesser ist, als die Grafikkarte in einem Stueck zeichnen kann.
+ *
+ * @param Breite Die Breite einer Kachel in Pixeln. 0 = automatisch.
+ * @param Hoehe Die Hoehe einer Kachel in Pixeln. 0 = automatisch.
+ */
+ls3render_EXPORT void ls3render_SetKachelgroesse(int Breite, int Hoehe);
+
+/**
+ * Subsets, deren Bounding Box im Bild in beiden Richtungen kleiner als die angegebene Pixelzahl ist,
+ * werden nicht gezeichnet (z.B. Schrauben und Armaturen bei kleinen Bildern). Subsets ausserhalb des Bildes
+ * werden immer verworfen. Kann das Bild veraendern, da auch kleine Subsets einzelne Pixel faerben koennen.
+ *
+ * @param Pixel Die Mindestgroesse in Pixeln. 0 (Standard) = alle sichtbaren Subsets zeichnen.
+ */
+ls3render_EXPORT void ls3render_SetMindestgroesse(float Pixel);
+
+/**
+ * Vereinfacht die Geometrie vor dem Rendern, soweit sie dadurch im Bild um hoechstens die angegebene Pixelzahl
+ * abweicht. Lohnt sich fuer Vorschaubilder mit wenigen Pixeln pro Meter. Raender von Subsets und Textur-Naehte
+ * bleiben unveraendert. Die vereinfachte Geometrie wird pro Datei und Toleranzstufe bis zu @ref ls3render_LeereCaches
+ * aufbewahrt, weitere Bilder mit aehnlicher Aufloesung verwenden sie wieder.
+ *
+ * @param Pixel Die zulaessige Abweichung in Pixeln, z.B. 0.5. 0 (Standard) = Originalgeometrie.
+ */
+ls3render_EXPORT void ls3render_SetVereinfachung(float Pixel);
+
+/**
+ * @return Die Anzahl der beim letzten Rendern nicht gezeichneten Subsets (ausserhalb des Bildes oder
+ *   kleiner als @ref ls3render_SetMindestgroesse). Mehrfach vorkommende Dateien werden nur einmal gezaehlt,
+ *   wenn sie gemeinsam gezeichnet werden. Nach @ref ls3render_RenderBatch 0, dort erhaelt der Callback die Anzahl fuer jeden Zug.
+ */
+ls3render_EXPORT int ls3render_GetVerworfeneSubsets();
+
+/**
+ * Wird von @ref ls3render_RenderZeilen fuer jeden fertigen Streifen des Bildes aufgerufen, von unten nach oben.
+ *
+ * @param Benutzerdaten Der an @ref ls3render_RenderZeilen uebergebene Zeiger.
+ * @param ErsteZeile Die erste Zeile des Streifens. Zeile 0 ist wie im Ausgabepuffer von @ref ls3render_Render die unterste.
+ * @param AnzahlZeilen Die Anzahl der Zeilen im Streifen.
+ * @param Pixel Die Zeilen im Format von @ref ls3render_Render, ohne Luecken hintereinander. Nur bis zum Ende des Aufrufs gueltig.
+ * @param Breite Die Breite einer Zeile in Pixeln.
+ */
+typedef void (*ls3render_ZeilenCallback)(void* Benutzerdaten, int ErsteZeile, int AnzahlZeilen, const void* Pixel, int Breite);
+
+/**
+ * Rendert die Szene wie @ref ls3render_Render, uebergibt das Ergebnis aber streifenweise an einen Callback.
+ * Es wird nie das ganze Bild im Speicher gehalten, nur jeweils ein Streifen in Kachelhoehe (siehe @ref ls3render_SetKachelgroesse).
+ * Damit lassen sich auch Bilder rendern, deren Ausgabepuffer zu gross waere.
+ *
+ * @return 1 bei Erfolg, 0 bei Fehlschlag. Bei Fehlschlag kann der Callback bereits fuer einige Streifen aufgerufen worden sein.
+ */
+ls3render_EXPORT int ls3render_RenderZeilen(ls3render_ZeilenCallback Callback, void* Benutzerdaten);
+
+/**
+ * Entfernt alle Fahrzeuge und gibt deren Geometriedaten im Grafikspeicher frei.
  *
  * Macht vorherige Rueckgabewerte von @ref ls3render_GetBildbreite, @ref ls3render_GetBildhoehe und @ref ls3render_GetAusgabepufferGroesse ungueltig.
  */
 ls3render_EXPORT void ls3render_Reset();
 
+/**
+ * Gibt die Geometriedaten der aktuellen Szene im Grafikspeicher frei.
+ *
+ * Die Geometrie bleibt normalerweise zwischen mehreren Aufrufen von @ref ls3render_Render im Grafikspeicher,
+ * bis @ref ls3render_Reset aufgerufen wird. Nach dieser Funktion wird sie beim naechsten Rendern erneut hochgeladen.
+ */
+ls3render_EXPORT void ls3render_FreeGrafikspeicher();
+
+/**
+ * Leert die Caches fuer geladene LS3-Dateien, Texturen und vereinfachte Geometrie.
+ *
+ * Dateien und Texturen bleiben normalerweise auch nach @ref ls3render_Reset geladen,
+ * damit sie beim naechsten Fahrzeug nicht erneut gelesen werden muessen.
+ * Eintraege, die von der aktuellen Szene noch verwendet werden, bleiben bis zum naechsten Reset gueltig.
+ */
+ls3render_EXPORT void ls3render_LeereCaches();
+
+/**
+ * Eine Fahrzeugbeladung, siehe @ref ls3render_AddBeladung.
+ */
+typedef struct ls3render_Beladung {
+  const char* Dateiname;
+  float OffsetX;
+  float OffsetY;
+  float OffsetZ;
+  float PhiX;
+  float PhiY;
+  float PhiZ;
+} ls3render_Beladung;
+
+/**
+ * Ein Fahrzeug samt Beladungen, siehe @ref ls3render_AddFahrzeug.
+ */
+typedef struct ls3render_Fahrzeug {
+  const char* Dateiname;
+  float OffsetX;
+  float Fahrzeuglaenge;
+  int Gedreht;
+  float StromabnehmerHoehe;
+  int Stromabnehmer1Oben;
+  int Stromabnehmer2Oben;
+  int Stromabnehmer3Oben;
+  int Stromabnehmer4Oben;
+  int SpitzenlichtVorneAn;
+  int SpitzenlichtHintenAn;
+  int SchlusslichtVorneAn;
+  int SchlusslichtHintenAn;
+  const ls3render_Beladung* Beladungen;
+  int AnzahlBeladungen;
+} ls3render_Fahrzeug;
+
+/**
+ * Ein zu rendernder Zug mit allen Einstellungen, siehe @ref ls3render_RenderBatch.
+ */
+typedef struct ls3render_Zug {
+  const ls3render_Fahrzeug* Fahrzeuge;
+  int AnzahlFahrzeuge;
+  int PixelProMeter;  ///< siehe @ref ls3render_SetPixelProMeter
+  int Multisampling;  ///< siehe @ref ls3render_SetMultisampling
+  float AxonometrieWinkel;  ///< siehe @ref ls3render_SetAxonometrieParameter
+  float AxonometrieSkalierung;  ///< siehe @ref ls3render_SetAxonometrieParameter
+} ls3render_Zug;
+
+/**
+ * Wird von @ref ls3render_RenderBatch fuer jeden Zug in der Reihenfolge der Zuege aufgerufen.
+ * Die Bilder werden asynchron ausgelesen, der Aufruf kann also erst erfolgen, nachdem bereits weitere Zuege gezeichnet wurden.
+ *
+ * @param Benutzerdaten Der an @ref ls3render_RenderBatch uebergebene Zeiger.
+ * @param Index Der Index des Zuges.
+ * @param Erfolg 1 bei Erfolg, 0 bei Fehlschlag.
+ * @param Bild Das Ergebnis im Format von @ref ls3render_Render, NULL bei Fehlschlag. Nur bis zum Ende des Aufrufs gueltig,
+ *   ausser es wird mit @ref ls3render_BehalteBild behalten.
+ * @param Breite Die Breite des Bildes in Pixeln.
+ * @param Hoehe Die Hoehe des Bildes in Pixeln.
+ * @param VerworfeneSubsets Die Anzahl der nicht gezeichneten Subsets dieses Zuges, siehe @ref ls3render_GetVerworfeneSubsets.
+ */
+typedef void (*ls3render_ErgebnisCallback)(void* Benutzerdaten, int Index, int Erfolg, const void* Bild, int Breite, int Hoehe, int VerworfeneSubsets);
+
+/**
+ * Rendert mehrere Zuege nacheinander.
+ *
+ * Entspricht fuer jeden Zug @ref ls3render_Reset, den Einstellungsfunktionen, @ref ls3render_AddFahrzeug
+ * und @ref ls3render_AddBeladung fuer alle Fahrzeuge sowie @ref ls3render_Render.
+ * Geladene Dateien, Texturen, Render-Targets und Auslesepuffer werden dabei weiterverwendet.
+ * Die Szene ist danach leer, die Einstellungen sind die des letzten Zuges.
+ *
+ * @param Zuege Die zu rendernden Zuege.
+ * @param AnzahlZuege Die Anzahl der Zuege.
+ * @param Callback Wird nach jedem Zug mit dem Ergebnis aufgerufen. Darf NULL sein.
+ * @param Benutzerdaten Wird an Callback durchgereicht.
+ *
+ * @return Die Anzahl der erfolgreich gerenderten Zuege.
+ */
+ls3render_EXPORT int ls3render_RenderBatch(const ls3render_Zug* Zuege, int AnzahlZuege, ls3render_ErgebnisCallback Callback, void* Benutzerdaten);
+
+/**
+ * Behaelt das Bild, das dem gerade laufenden @ref ls3render_ErgebnisCallback uebergeben wurde, ueber das Ende des Aufrufs hinaus.
+ * Damit kann es z.B. in einem anderen Thread ohne Kopie kodiert werden, waehrend schon die naechsten Zuege gezeichnet werden.
+ * Darf nur innerhalb des Callbacks aufgerufen werden.
+ *
+ * Jedes behaltene Bild muss genau einmal mit @ref ls3render_GibBildFrei freigegeben werden. Bis dahin belegt es einen
+ * der Auslesepuffer; sind alle belegt, wartet @ref ls3render_RenderBatch auf eine Freigabe und kehrt auch erst zurueck,
+ * wenn alle Bilder freigegeben sind. Die Freigabe muss also im Callback oder in einem anderen Thread erfolgen.
+ *
+ * @return Eine Kennung fuer @ref ls3render_GibBildFrei, -1 wenn das Bild nicht behalten werden kann (bei Fehlschlag).
+ */
+ls3render_EXPORT int ls3render_BehalteBild();
+
+/**
+ * Gibt ein mit @ref ls3render_BehalteBild behaltenes Bild frei. Darf aus jedem Thread aufgerufen werden.
+ *
+ * @param Kennung Der Rueckgabewert von @ref ls3render_BehalteBild.
+ */
+ls3render_EXPORT void ls3render_GibBildFrei(int Kennung);
+
+/**
+ * @name Kontext-API
+ *
+ * Jeder Kontext hat einen eigenen OpenGL-Kontext, eine eigene Szene und eigene Einstellungen.
+ * Mehrere Threads koennen so gleichzeitig rendern, jeder mit seinem eigenen Kontext.
+ * Geparste LS3-Dateien und gelesene Texturen werden zwischen allen Kontexten geteilt.
+ *
+ * Ein Kontext darf nicht gleichzeitig von mehreren Threads verwendet werden,
+ * kann aber nacheinander in verschiedenen Threads verwendet werden.
+ * Das GLFW-Backend ist dafuer nur bedingt geeignet, fuer paralleles Rendern sollte EGL oder OSMesa verwendet werden.
+ *
+ * Die Funktionen ohne Kontext-Parameter verwenden einen Standardkontext,
+ * der mit @ref ls3render_Init erzeugt und mit @ref ls3render_Cleanup zerstoert wird.
+ * @{
+ */
+
+typedef struct ls3render_Context ls3render_Context;
+
+/**
+ * Erzeugt einen neuen Kontext wie @ref ls3render_Init.
+ * Der OpenGL-Kontext ist danach in keinem Thread aktuell und kann an einen anderen Thread uebergeben werden.
+ *
+ * @return Der neue Kontext oder NULL bei Fehlschlag.
+ */
+ls3render_EXPORT ls3render_Context* ls3render_CreateContext();
+
+/**
+ * Zerstoert einen mit @ref ls3render_CreateContext erzeugten Kontext und gibt dessen Grafikspeicher frei.
+ */
+ls3render_EXPORT void ls3render_DestroyContext(ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_SetPixelProMeter. */
+ls3render_EXPORT void ls3render_Context_SetPixelProMeter(ls3render_Context* Kontext, int PixelProMeter);
+
+/** Wie @ref ls3render_SetMultisampling. */
+ls3render_EXPORT void ls3render_Context_SetMultisampling(ls3render_Context* Kontext, int Samples);
+
+/** Wie @ref ls3render_SetAxonometrieParameter. */
+ls3render_EXPORT void ls3render_Context_SetAxonometrieParameter(ls3render_Context* Kontext, float Winkel, float Skalierung);
+
+/** Wie @ref ls3render_AddFahrzeug. */
+ls3render_EXPORT int ls3render_Context_AddFahrzeug(ls3render_Context* Kontext, const char* Dateiname, float OffsetX, float Fahrzeuglaenge, int Gedreht, float StromabnehmerHoehe, int Stromabnehmer1Oben, int Stromabnehmer2Oben, int Stromabnehmer3Oben, int Stromabnehmer4Oben, int SpitzenlichtVorneAn, int SpitzenlichtHintenAn, int SchlusslichtVorneAn, int SchlusslichtHintenAn);
+
+/** Wie @ref ls3render_AddBeladung. */
+ls3render_EXPORT int ls3render_Context_AddBeladung(ls3render_Context* Kontext, const char* Dateiname, float OffsetX, float OffsetY, float OffsetZ, float PhiX, float PhiY, float PhiZ);
+
+/** Wie @ref ls3render_GetBildbreite. */
+ls3render_EXPORT int ls3render_Context_GetBildbreite(const ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_GetBildhoehe. */
+ls3render_EXPORT int ls3render_Context_GetBildhoehe(const ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_GetAusgabepufferGroesse. */
+ls3render_EXPORT int ls3render_Context_GetAusgabepufferGroesse(const ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_Render. Macht den OpenGL-Kontext im aufrufenden Thread aktuell. */
+ls3render_EXPORT int ls3render_Context_Render(ls3render_Context* Kontext, void* Ausgabepuffer);
+
+/** Wie @ref ls3render_SetKachelgroesse. */
+ls3render_EXPORT void ls3render_Context_SetKachelgroesse(ls3render_Context* Kontext, int Breite, int Hoehe);
+
+/** Wie @ref ls3render_SetMindestgroesse. */
+ls3render_EXPORT void ls3render_Context_SetMindestgroesse(ls3render_Context* Kontext, float Pixel);
+
+/** Wie @ref ls3render_SetVereinfachung. */
+ls3render_EXPORT void ls3render_Context_SetVereinfachung(ls3render_Context* Kontext, float Pixel);
+
+/** Wie @ref ls3render_GetVerworfeneSubsets. */
+ls3render_EXPORT int ls3render_Context_GetVerworfeneSubsets(const ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_RenderZeilen. Macht den OpenGL-Kontext im aufrufenden Thread aktuell. */
+ls3render_EXPORT int ls3render_Context_RenderZeilen(ls3render_Context* Kontext, ls3render_ZeilenCallback Callback, void* Benutzerdaten);
+
+/** Wie @ref ls3render_RenderBatch. */
+ls3render_EXPORT int ls3render_Context_RenderBatch(ls3render_Context* Kontext, const ls3render_Zug* Zuege, int AnzahlZuege, ls3render_ErgebnisCallback Callback, void* Benutzerdaten);
+
+/** Wie @ref ls3render_BehalteBild. */
+ls3render_EXPORT int ls3render_Context_BehalteBild(ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_GibBildFrei. */
+ls3render_EXPORT void ls3render_Context_GibBildFrei(ls3render_Context* Kontext, int Kennung);
+
+/** Wie @ref ls3render_Reset. */
+ls3render_EXPORT void ls3render_Context_Reset(ls3render_Context* Kontext);
+
+/** Wie @ref ls3render_FreeGrafikspeicher. */
+ls3render_EXPORT void ls3render_Context_FreeGrafikspeicher(ls3render_Context* Kontext);
+
+/**
+ * Wie @ref ls3render_LeereCaches.
+ * Die gemeinsamen Caches werden fuer alle Kontexte geleert, die Texturen im Grafikspeicher nur fuer diesen.
+ */
+ls3render_EXPORT void ls3render_Context_LeereCaches(ls3render_Context* Kontext);
+
+/** @} */
+
 }
@@ -1,22 +1,46 @@
 #pragma once
 
+#include "./gl_debug.hpp"
+
 #define GLEW_STATIC
 #include <GL/glew.h>
 
 #include <iostream>
 
+// Fehlerbehandlung fuer GL-Aufrufe:
+//  - Mit LS3RENDER_GL_CHECK_ALL_CALLS (CMake-Option GL_CHECK_ALL_CALLS, in Debug-Builds immer)
+//    prueft TRY nach jedem Aufruf glGetError und kehrt bei einem Fehler mit false zurueck.
+//  - Sonst fuehrt TRY den Aufruf nur aus; Fehler werden an wenigen Stellen pro Bild mit
+//    TRY_CHECKPOINT abgeholt, damit nicht jeder Aufruf auf den Treiber warten muss.
+// In beiden Faellen merkt sich TRY die Aufrufstelle fuer die GL_KHR_debug-Ausgabe
+// (siehe gldebug::aktiviereDebugAusgabe).
+#if !defined(NDEBUG) && !defined(LS3RENDER_GL_CHECK_ALL_CALLS)
+#define LS3RENDER_GL_CHECK_ALL_CALLS
+#endif
+
+#ifdef LS3RENDER_GL_CHECK_ALL_CALLS
 #define TRY(glDoSomething) { \
   do { \
+    ::ls3render::gldebug::setzeAufrufstelle(__FILE__, __LINE__, #glDoSomething); \
     glDoSomething; \
-    GLenum error = glGetError(); \
-    if (error == GL_NO_ERROR) { \
-      break; \
+    if (!::ls3render::gldebug::pruefeFehler(__FILE__, __LINE__, #glDoSomething)) { \
+      return false; \
+    } \
+  } while (0); }
+#else
+#define TRY(glDoSomething) { \
+  do { \
+    ::ls3render::gldebug::setzeAufrufstelle(__FILE__, __LINE__, #glDoSomething); \
+    glDoSomething; \
+  } while (0); }
+#endif
+
+// Holt alle seit dem letzten Checkpoint aufgelaufenen GL-Fehler ab und kehrt bei einem Fehler mit false zurueck.
+#define TRY_CHECKPOINT(kontext) { \
+  do { \
+    if (!::ls3render::gldebug::pruefeFehler(__FILE__, __LINE__, "checkpoint " kontext)) { \
+      return false; \
     } \
-    do { \
-      std::cerr << __FILE__ ":" << std::dec << __LINE__ << ": Error executing " #glDoSomething ": 0x" << std::hex << error << std::endl; \
-      error = glGetError(); \
-    } while (error != GL_NO_ERROR); \
-    return false; \
   } while (0); }
 
 #define TRY_GLEW(glewDoSomething) { \
@@ -29,4 +53,3 @@
   } while (0); }
 
 #define TRY_GLFW(glfwDoSomething) glfwDoSomething
-
@@ -0,0 +1,114 @@
+#include "./mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace ls3render {
+
+#ifdef _WIN32
+
+GemappteDatei::~GemappteDatei() {
+  if (m_daten) {
+    UnmapViewOfFile(m_daten);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_datei && m_datei != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_datei);
+  }
+}
+
+std::unique_ptr<GemappteDatei> GemappteDatei::oeffne(const std::string& pfad, bool vorauslesen) {
+  std::unique_ptr<GemappteDatei> result(new GemappteDatei());
+  result->m_datei = CreateFileA(pfad.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (result->m_datei == INVALID_HANDLE_VALUE) {
+    std::cerr << pfad << ": CreateFile() failed: " << GetLastError() << "\n";
+    return nullptr;
+  }
+  LARGE_INTEGER groesse;
+  if (!GetFileSizeEx(result->m_datei, &groesse)) {
+    std::cerr << pfad << ": GetFileSizeEx() failed: " << GetLastError() << "\n";
+    return nullptr;
+  }
+  result->m_groesse = static_cast<size_t>(groesse.QuadPart);
+  if (result->m_groesse == 0) {
+    return result;
+  }
+  result->m_mapping = CreateFileMappingA(result->m_datei, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!result->m_mapping) {
+    std::cerr << pfad << ": CreateFileMapping() failed: " << GetLastError() << "\n";
+    return nullptr;
+  }
+  result->m_daten = static_cast<const unsigned char*>(MapViewOfFile(result->m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!result->m_daten) {
+    std::cerr << pfad << ": MapViewOfFile() failed: " << GetLastError() << "\n";
+    return nullptr;
+  }
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+  if (vorauslesen) {
+    WIN32_MEMORY_RANGE_ENTRY bereich { const_cast<unsigned char*>(result->m_daten), result->m_groesse };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &bereich, 0);
+  }
+#else
+  (void)vorauslesen;  // PrefetchVirtualMemory gibt es erst ab Windows 8
+#endif
+  return result;
+}
+
+#else
+
+GemappteDatei::~GemappteDatei() {
+  if (m_daten) {
+    munmap(const_cast<unsigned char*>(m_daten), m_groesse);
+  }
+}
+
+std::unique_ptr<GemappteDatei> GemappteDatei::oeffne(const std::string& pfad, bool vorauslesen) {
+  const int fd = open(pfad.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << pfad << ": open() failed: " << std::strerror(errno) << "\n";
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    std::cerr << pfad << ": fstat() failed: " << std::strerror(errno) << "\n";
+    close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<GemappteDatei> result(new GemappteDatei());
+  result->m_groesse = static_cast<size_t>(st.st_size);
+  if (result->m_groesse > 0) {
+    void* daten = mmap(nullptr, result->m_groesse, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (daten == MAP_FAILED) {
+      std::cerr << pfad << ": mmap() failed: " << std::strerror(errno) << "\n";
+      close(fd);
+      return nullptr;
+    }
+    if (vorauslesen) {
+      madvise(daten, result->m_groesse, MADV_WILLNEED);
+    }
+    result->m_daten = static_cast<const unsigned char*>(daten);
+  }
+  close(fd);  // Das Mapping bleibt auch ohne Dateideskriptor gueltig
+  return result;
+}
+
+#endif
+
+}
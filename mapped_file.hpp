@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace ls3render {
+
+// Eine schreibgeschuetzt in den Speicher gemappte Datei. Die Daten bleiben gueltig, solange das Objekt existiert.
+class GemappteDatei {
+ public:
+  ~GemappteDatei();
+  GemappteDatei(const GemappteDatei&) = delete;
+  GemappteDatei& operator=(const GemappteDatei&) = delete;
+
+  // nullptr bei Fehlschlag (Fehlermeldung auf std::cerr).
+  // vorauslesen: Die Datei wird ohnehin vollstaendig gelesen, das Betriebssystem soll sie schon vorab einlesen.
+  // Sonst werden nur die tatsaechlich zugegriffenen Seiten gelesen.
+  static std::unique_ptr<GemappteDatei> oeffne(const std::string& pfad, bool vorauslesen = true);
+
+  const unsigned char* daten() const { return m_daten; }
+  size_t groesse() const { return m_groesse; }
+
+ private:
+  GemappteDatei() = default;
+
+  const unsigned char* m_daten { nullptr };
+  size_t m_groesse { 0 };
+#ifdef _WIN32
+  void* m_datei { nullptr };
+  void* m_mapping { nullptr };
+#endif
+};
+
+}
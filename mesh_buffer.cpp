@@ -0,0 +1,199 @@
+#include "./mesh_buffer.hpp"
+
+#include "./ls3_cache.hpp"
+#include "./macros.hpp"
+#include "./mesh_simplifier.hpp"
+#include "./shader_parameters.hpp"
+
+#include "zusi_parser/zusi_types.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace ls3render {
+
+MeshBuffer::MeshBuffer() : m_shaderParameters(nullptr), m_vao(), m_vbo(), m_ebo(),
+    m_vertexCapacity(0), m_indexCapacity(0), m_uploadedVertices(0), m_uploadedIndices(0), m_vertexCount(0), m_indexCount(0),
+    m_ranges(), m_pending(), m_vereinfacht() {}
+
+MeshBuffer::~MeshBuffer() {
+  glDeleteBuffers(1, &m_vbo);
+  glDeleteBuffers(1, &m_ebo);
+  glDeleteVertexArrays(1, &m_vao);
+}
+
+bool MeshBuffer::init(const ShaderParameters& shaderParameters) {
+  m_shaderParameters = &shaderParameters;
+  TRY(glGenVertexArrays(1, &m_vao));
+  return true;
+}
+
+const std::vector<DrawRange>& MeshBuffer::add(const Ls3Datei& ls3_datei) {
+  return add(&ls3_datei, ls3_datei.geometrie);
+}
+
+const std::vector<DrawRange>& MeshBuffer::add(const std::shared_ptr<const VereinfachteGeometrie>& geometrie) {
+  const auto& result = add(geometrie.get(), geometrie->geometrie);
+  if (std::find(std::begin(m_vereinfacht), std::end(m_vereinfacht), geometrie) == std::end(m_vereinfacht)) {
+    m_vereinfacht.push_back(geometrie);
+  }
+  return result;
+}
+
+const std::vector<DrawRange>& MeshBuffer::add(const void* schluessel, const std::vector<SubsetGeometrie>& subsets) {
+  const auto [it, inserted] = m_ranges.try_emplace(schluessel);
+  if (!inserted) {
+    return it->second;
+  }
+
+  static_assert(sizeof(Face) == 3 * sizeof(GLushort), "Wrong size of Face");
+  for (const auto& geometrie : subsets) {
+    it->second.push_back(DrawRange {
+      static_cast<GLint>(m_vertexCount),
+      static_cast<GLsizei>(geometrie.anzahlFaces * 3),
+      reinterpret_cast<const void*>(m_indexCount * sizeof(GLushort)),
+    });
+    m_vertexCount += geometrie.anzahlVertices;
+    m_indexCount += geometrie.anzahlFaces * 3;
+  }
+
+  m_pending.emplace_back(schluessel, &subsets);
+  return it->second;
+}
+
+bool MeshBuffer::upload() {
+  if (m_pending.empty()) {
+    return true;
+  }
+
+  if (m_vertexCount > m_vertexCapacity || m_indexCount > m_indexCapacity) {
+    if (!reserve(std::max(m_vertexCount, 2 * m_vertexCapacity), std::max(m_indexCount, 2 * m_indexCapacity))) {
+      return false;
+    }
+  }
+
+  // The element array buffer binding is part of the VAO state
+  TRY(glBindVertexArray(m_vao));
+  TRY(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+
+  for (const auto& [schluessel, subsets] : m_pending) {
+    const auto& ranges = m_ranges.at(schluessel);
+    for (size_t i = 0, n_subsets = subsets->size(); i < n_subsets; i++) {
+      const auto& geometrie = (*subsets)[i];
+      TRY(glBufferSubData(GL_ARRAY_BUFFER,
+            ranges[i].baseVertex * sizeof(Vertex),
+            geometrie.vertexBytes(),
+            geometrie.vertices));
+      TRY(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+            reinterpret_cast<GLintptr>(ranges[i].indexOffset),
+            geometrie.faceBytes(),
+            geometrie.faces));
+    }
+  }
+
+  m_pending.clear();
+  m_uploadedVertices = m_vertexCount;
+  m_uploadedIndices = m_indexCount;
+  return true;
+}
+
+bool MeshBuffer::bind() const {
+  TRY(glBindVertexArray(m_vao));
+  return true;
+}
+
+bool MeshBuffer::reserve(size_t vertexCapacity, size_t indexCapacity) {
+  GLuint vbo;
+  GLuint ebo;
+  TRY(glGenBuffers(1, &vbo));
+  TRY(glGenBuffers(1, &ebo));
+
+  // Bereits hochgeladene Daten in die groesseren Puffer kopieren
+  TRY(glBindBuffer(GL_COPY_WRITE_BUFFER, vbo));
+  TRY(glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW));
+  if (m_uploadedVertices > 0) {
+    TRY(glBindBuffer(GL_COPY_READ_BUFFER, m_vbo));
+    TRY(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_uploadedVertices * sizeof(Vertex)));
+  }
+
+  TRY(glBindBuffer(GL_COPY_WRITE_BUFFER, ebo));
+  TRY(glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(GLushort), nullptr, GL_STATIC_DRAW));
+  if (m_uploadedIndices > 0) {
+    TRY(glBindBuffer(GL_COPY_READ_BUFFER, m_ebo));
+    TRY(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_uploadedIndices * sizeof(GLushort)));
+  }
+
+  TRY(glDeleteBuffers(1, &m_vbo));
+  TRY(glDeleteBuffers(1, &m_ebo));
+  m_vbo = vbo;
+  m_ebo = ebo;
+  m_vertexCapacity = vertexCapacity;
+  m_indexCapacity = indexCapacity;
+
+  TRY(glBindVertexArray(m_vao));
+  TRY(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+  TRY(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo));
+
+  const auto& shaderParameters = *m_shaderParameters;
+
+  static_assert(std::is_standard_layout<Vertex>::value, "Vertex must conform to StandardLayoutType");  // for offsetof
+
+  static_assert(sizeof(Vec3::x) == sizeof(GL_FLOAT), "Wrong size of Vec3::X");
+  static_assert(sizeof(Vec3::y) == sizeof(GL_FLOAT), "Wrong size of Vec3::Y");
+  static_assert(sizeof(Vec3::z) == sizeof(GL_FLOAT), "Wrong size of Vec3::Z");
+  static_assert(offsetof(Vec3, x) == 0 * sizeof(GL_FLOAT), "Wrong offset of Vec3::X");
+  static_assert(offsetof(Vec3, y) == 1 * sizeof(GL_FLOAT), "Wrong offset of Vec3::Y");
+  static_assert(offsetof(Vec3, z) == 2 * sizeof(GL_FLOAT), "Wrong offset of Vec3::Z");
+
+  TRY(glEnableVertexAttribArray(shaderParameters.attrib_pos));
+  // This also stores the VBO that is currently bound to GL_ARRAY_BUFFER
+  TRY(glVertexAttribPointer(
+      shaderParameters.attrib_pos,  // Input contains ...
+      3,           // ... three values ..
+      GL_FLOAT,    // ... of type GL_FLOAT ...
+      GL_FALSE,    // ... which should not be normalized.
+      sizeof(Vertex),  // stride
+      reinterpret_cast<const GLvoid*>(offsetof(Vertex, p))));         // offset
+
+  TRY(glEnableVertexAttribArray(shaderParameters.attrib_nor));
+  TRY(glVertexAttribPointer(
+      shaderParameters.attrib_nor,  // Input contains ...
+      3,           // ... three values ..
+      GL_FLOAT,    // ... of type GL_FLOAT ...
+      GL_FALSE,    // ... which should not be normalized.
+      sizeof(Vertex),  // stride
+      reinterpret_cast<const GLvoid*>(offsetof(Vertex, n))));         // offset
+
+  static_assert(sizeof(Vertex::U) == sizeof(GL_FLOAT), "Wrong size of Vertex::U");
+  static_assert(sizeof(Vertex::V) == sizeof(GL_FLOAT), "Wrong size of Vertex::V");
+  static_assert(offsetof(Vertex, V) - offsetof(Vertex, U) == sizeof(GL_FLOAT), "Wrong offset of Vertex::V");
+
+  TRY(glEnableVertexAttribArray(shaderParameters.attrib_uv1));
+  TRY(glVertexAttribPointer(
+      shaderParameters.attrib_uv1,
+      2,
+      GL_FLOAT,
+      GL_FALSE,
+      sizeof(Vertex),
+      reinterpret_cast<const GLvoid*>(offsetof(Vertex, U))));
+
+  static_assert(sizeof(Vertex::U2) == sizeof(GL_FLOAT), "Wrong size of Vertex::U2");
+  static_assert(sizeof(Vertex::V2) == sizeof(GL_FLOAT), "Wrong size of Vertex::V2");
+  static_assert(offsetof(Vertex, V2) - offsetof(Vertex, U2) == sizeof(GL_FLOAT), "Wrong offset of Vertex::V2");
+
+  TRY(glEnableVertexAttribArray(shaderParameters.attrib_uv2));
+  TRY(glVertexAttribPointer(
+      shaderParameters.attrib_uv2,
+      2,
+      GL_FLOAT,
+      GL_FALSE,
+      sizeof(Vertex),
+      reinterpret_cast<const GLvoid*>(offsetof(Vertex, U2))));
+
+  return true;
+}
+
+}
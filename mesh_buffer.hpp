@@ -0,0 +1,73 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+struct Ls3Datei;
+struct ShaderParameters;
+struct SubsetGeometrie;
+struct VereinfachteGeometrie;
+
+// Lage eines Subsets im gemeinsamen Vertex- und Indexpuffer.
+struct DrawRange {
+  GLint baseVertex;
+  GLsizei count;  // Anzahl Indizes
+  const void* indexOffset;  // Byte-Offset im Indexpuffer
+};
+
+// Gemeinsamer Vertex- und Indexpuffer fuer alle Dateien einer Szene.
+// Das Vertexformat wird einmalig in einem einzigen VAO festgelegt; Subsets werden
+// ueber ihre DrawRange mit glDrawElementsBaseVertex und Co. gezeichnet.
+class MeshBuffer {
+ public:
+  MeshBuffer();
+  ~MeshBuffer();
+  MeshBuffer(const MeshBuffer&) = delete;
+  MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+  bool init(const ShaderParameters& shaderParameters);
+  bool isInitialized() const { return m_vao != 0; }
+
+  // Reserviert Platz fuer die Subsets der Datei und gibt deren Lage zurueck (eine DrawRange pro Subset).
+  // Jede Datei wird nur einmal aufgenommen. Die Daten werden erst mit upload() hochgeladen.
+  const std::vector<DrawRange>& add(const Ls3Datei& ls3_datei);
+  // Wie oben fuer vereinfachte Geometrie, die bis zur Zerstoerung des MeshBuffers erhalten bleibt.
+  const std::vector<DrawRange>& add(const std::shared_ptr<const VereinfachteGeometrie>& geometrie);
+
+  // Laedt alle seit dem letzten Aufruf hinzugefuegten Dateien hoch und vergroessert die Puffer bei Bedarf.
+  // Hochgeladen wird direkt aus der gemappten LSB-Datei bzw. der vereinfachten Geometrie.
+  bool upload();
+
+  bool bind() const;
+
+ private:
+  bool reserve(size_t vertexCapacity, size_t indexCapacity);
+  // schluessel: Datei oder vereinfachte Geometrie, der die Subsets gehoeren
+  const std::vector<DrawRange>& add(const void* schluessel, const std::vector<SubsetGeometrie>& geometrie);
+
+  const ShaderParameters* m_shaderParameters;
+
+  GLuint m_vao;
+  GLuint m_vbo;
+  GLuint m_ebo;
+  size_t m_vertexCapacity;
+  size_t m_indexCapacity;
+  size_t m_uploadedVertices;
+  size_t m_uploadedIndices;
+  size_t m_vertexCount;
+  size_t m_indexCount;
+
+  std::unordered_map<const void*, std::vector<DrawRange>> m_ranges;
+  std::vector<std::pair<const void*, const std::vector<SubsetGeometrie>*>> m_pending;
+  std::vector<std::shared_ptr<const VereinfachteGeometrie>> m_vereinfacht;
+};
+
+}
@@ -0,0 +1,353 @@
+#include "./mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+struct Punkt {
+  double x, y, z;
+};
+
+Punkt operator-(const Punkt& a, const Punkt& b) {
+  return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+Punkt kreuz(const Punkt& a, const Punkt& b) {
+  return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+double skalar(const Punkt& a, const Punkt& b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Summe der quadrierten Abstaende zu einer Menge von Ebenen, als symmetrische 4x4-Matrix
+struct Quadrik {
+  double a[10] {};  // xx xy xz xd yy yz yd zz zd dd
+
+  void addiereEbene(const Punkt& n, double d) {
+    const double e[10] = { n.x * n.x, n.x * n.y, n.x * n.z, n.x * d, n.y * n.y, n.y * n.z, n.y * d, n.z * n.z, n.z * d, d * d };
+    for (size_t i = 0; i < 10; i++) {
+      a[i] += e[i];
+    }
+  }
+
+  void addiere(const Quadrik& other) {
+    for (size_t i = 0; i < 10; i++) {
+      a[i] += other.a[i];
+    }
+  }
+
+  double fehler(const Punkt& p) const {
+    return a[0] * p.x * p.x + 2 * a[1] * p.x * p.y + 2 * a[2] * p.x * p.z + 2 * a[3] * p.x
+      + a[4] * p.y * p.y + 2 * a[5] * p.y * p.z + 2 * a[6] * p.y
+      + a[7] * p.z * p.z + 2 * a[8] * p.z
+      + a[9];
+  }
+};
+
+// Verschiebt Vertex von auf den Vertex nach; gueltig, solange von seit dem Einreihen nicht veraendert wurde.
+struct Kandidat {
+  double kosten;
+  uint32_t von;
+  uint32_t nach;
+  uint32_t version;
+
+  bool operator>(const Kandidat& other) const { return kosten > other.kosten; }
+};
+
+class Vereinfacher {
+ public:
+  explicit Vereinfacher(const SubsetGeometrie& geometrie) {
+    const size_t n = geometrie.anzahlVertices;
+    m_positionen.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      const Vertex vertex = geometrie.vertex(i);
+      m_positionen.push_back(Punkt { vertex.p.x, vertex.p.y, vertex.p.z });
+    }
+    m_quadriken.resize(n);
+    m_vertexFaces.resize(n);
+    m_gesperrt.assign(n, 0);
+    m_lebt.assign(n, 1);
+    m_version.assign(n, 0);
+
+    for (size_t f = 0; f < geometrie.anzahlFaces; f++) {
+      const Face face = geometrie.face(f);
+      if (face.i[0] >= n || face.i[1] >= n || face.i[2] >= n) {
+        continue;
+      }
+      const auto index = static_cast<uint32_t>(m_faces.size());
+      m_faces.push_back({ face.i[0], face.i[1], face.i[2] });
+      m_faceLebt.push_back(1);
+      for (const auto v : m_faces.back()) {
+        m_vertexFaces[v].push_back(index);
+      }
+    }
+
+    // Jede Flaeche traegt ihre Ebene zur Quadrik ihrer Ecken bei
+    for (const auto& face : m_faces) {
+      Punkt normale = kreuz(m_positionen[face[1]] - m_positionen[face[0]], m_positionen[face[2]] - m_positionen[face[0]]);
+      const double laenge = std::sqrt(skalar(normale, normale));
+      if (laenge == 0) {
+        continue;
+      }
+      normale = { normale.x / laenge, normale.y / laenge, normale.z / laenge };
+      const double d = -skalar(normale, m_positionen[face[0]]);
+      for (const auto v : face) {
+        m_quadriken[v].addiereEbene(normale, d);
+      }
+    }
+
+    // Vertices an Kanten, die nicht genau zwei Dreiecke verbinden, bleiben fest (Subsetrand, UV-Naehte, nicht mannigfaltige Stellen)
+    std::unordered_map<uint64_t, uint32_t> kanten;
+    for (const auto& face : m_faces) {
+      for (size_t j = 0; j < 3; j++) {
+        kanten[kante(face[j], face[(j + 1) % 3])]++;
+      }
+    }
+    for (const auto& [schluessel, anzahl] : kanten) {
+      if (anzahl != 2) {
+        m_gesperrt[static_cast<uint32_t>(schluessel >> 32)] = 1;
+        m_gesperrt[static_cast<uint32_t>(schluessel)] = 1;
+      }
+    }
+  }
+
+  // Legt Kanten zusammen, solange der Fehler hoechstens maxFehler betraegt. Gibt die Anzahl der Zusammenlegungen zurueck.
+  size_t vereinfache(double maxFehler) {
+    for (uint32_t v = 0; v < m_positionen.size(); v++) {
+      if (m_gesperrt[v]) {
+        continue;
+      }
+      for (const auto w : nachbarn(v)) {
+        m_kandidaten.push(Kandidat { m_quadriken[v].fehler(m_positionen[w]), v, w, m_version[v] });
+      }
+    }
+
+    size_t result = 0;
+    while (!m_kandidaten.empty()) {
+      const Kandidat kandidat = m_kandidaten.top();
+      m_kandidaten.pop();
+      if (kandidat.kosten > maxFehler) {
+        break;
+      }
+      if (!m_lebt[kandidat.von] || !m_lebt[kandidat.nach] || m_version[kandidat.von] != kandidat.version) {
+        continue;
+      }
+      if (!kannZusammenlegen(kandidat.von, kandidat.nach)) {
+        continue;
+      }
+      legeZusammen(kandidat.von, kandidat.nach);
+      result++;
+    }
+    return result;
+  }
+
+  void ergebnis(const SubsetGeometrie& geometrie, std::vector<Vertex>* vertices, std::vector<Face>* faces) const {
+    // Reihenfolge der Vertices und Dreiecke bleibt erhalten
+    std::vector<unsigned char> verwendet(m_positionen.size(), 0);
+    for (size_t f = 0; f < m_faces.size(); f++) {
+      if (m_faceLebt[f]) {
+        for (const auto v : m_faces[f]) {
+          verwendet[v] = 1;
+        }
+      }
+    }
+    std::vector<uint32_t> neuerIndex(m_positionen.size(), 0);
+    vertices->clear();
+    for (size_t v = 0; v < verwendet.size(); v++) {
+      if (verwendet[v]) {
+        neuerIndex[v] = static_cast<uint32_t>(vertices->size());
+        vertices->push_back(geometrie.vertex(v));
+      }
+    }
+    faces->clear();
+    for (size_t f = 0; f < m_faces.size(); f++) {
+      if (m_faceLebt[f]) {
+        Face face;
+        for (size_t j = 0; j < 3; j++) {
+          face.i[j] = static_cast<uint16_t>(neuerIndex[m_faces[f][j]]);  // hoechstens so viele Vertices wie vorher
+        }
+        faces->push_back(face);
+      }
+    }
+  }
+
+ private:
+  static uint64_t kante(uint32_t a, uint32_t b) {
+    return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+  }
+
+  std::vector<uint32_t> nachbarn(uint32_t v) const {
+    std::vector<uint32_t> result;
+    for (const auto f : m_vertexFaces[v]) {
+      if (!m_faceLebt[f]) {
+        continue;
+      }
+      for (const auto w : m_faces[f]) {
+        if (w != v) {
+          result.push_back(w);
+        }
+      }
+    }
+    std::sort(std::begin(result), std::end(result));
+    result.erase(std::unique(std::begin(result), std::end(result)), std::end(result));
+    return result;
+  }
+
+  void reiheEin(uint32_t v) {
+    for (const auto w : nachbarn(v)) {
+      if (!m_gesperrt[v]) {
+        m_kandidaten.push(Kandidat { m_quadriken[v].fehler(m_positionen[w]), v, w, m_version[v] });
+      }
+      if (!m_gesperrt[w]) {
+        m_kandidaten.push(Kandidat { m_quadriken[w].fehler(m_positionen[v]), w, v, m_version[w] });
+      }
+    }
+  }
+
+  bool kannZusammenlegen(uint32_t von, uint32_t nach) const {
+    // Die Kante darf nur an den beiden gemeinsamen Dreiecken haengen, sonst entstuenden doppelte Dreiecke
+    size_t gemeinsameFaces = 0;
+    for (const auto f : m_vertexFaces[von]) {
+      if (m_faceLebt[f] && std::find(std::begin(m_faces[f]), std::end(m_faces[f]), nach) != std::end(m_faces[f])) {
+        gemeinsameFaces++;
+      }
+    }
+    const auto nachbarnVon = nachbarn(von);
+    const auto nachbarnNach = nachbarn(nach);
+    std::vector<uint32_t> gemeinsam;
+    std::set_intersection(std::begin(nachbarnVon), std::end(nachbarnVon), std::begin(nachbarnNach), std::end(nachbarnNach),
+        std::back_inserter(gemeinsam));
+    if (gemeinsameFaces != 2 || gemeinsam.size() != 2) {
+      return false;
+    }
+
+    // Kein verbleibendes Dreieck darf umklappen, hochkant gestellt werden oder zu einer Linie entarten
+    for (const auto f : m_vertexFaces[von]) {
+      const auto& face = m_faces[f];
+      if (!m_faceLebt[f] || std::find(std::begin(face), std::end(face), nach) != std::end(face)) {
+        continue;
+      }
+      Punkt alt[3];
+      Punkt neu[3];
+      for (size_t j = 0; j < 3; j++) {
+        alt[j] = m_positionen[face[j]];
+        neu[j] = face[j] == von ? m_positionen[nach] : alt[j];
+      }
+      const Punkt normaleAlt = kreuz(alt[1] - alt[0], alt[2] - alt[0]);
+      const Punkt normaleNeu = kreuz(neu[1] - neu[0], neu[2] - neu[0]);
+      // Normale darf sich um hoechstens 60 Grad drehen (cos^2 = 1/4)
+      const double produkt = skalar(normaleAlt, normaleNeu);
+      if (produkt <= 0 || produkt * produkt < 0.25 * skalar(normaleAlt, normaleAlt) * skalar(normaleNeu, normaleNeu)
+          || skalar(normaleNeu, normaleNeu) <= 1e-6 * skalar(normaleAlt, normaleAlt)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void legeZusammen(uint32_t von, uint32_t nach) {
+    for (const auto f : m_vertexFaces[von]) {
+      if (!m_faceLebt[f]) {
+        continue;
+      }
+      auto& face = m_faces[f];
+      if (std::find(std::begin(face), std::end(face), nach) != std::end(face)) {
+        m_faceLebt[f] = 0;
+        continue;
+      }
+      std::replace(std::begin(face), std::end(face), von, nach);
+      m_vertexFaces[nach].push_back(f);
+    }
+    m_vertexFaces[von].clear();
+    m_lebt[von] = 0;
+    m_quadriken[nach].addiere(m_quadriken[von]);
+    m_version[nach]++;
+    reiheEin(nach);
+  }
+
+  std::vector<Punkt> m_positionen;
+  std::vector<Quadrik> m_quadriken;
+  std::vector<std::array<uint32_t, 3>> m_faces;
+  std::vector<unsigned char> m_faceLebt;
+  std::vector<std::vector<uint32_t>> m_vertexFaces;
+  std::vector<unsigned char> m_gesperrt;
+  std::vector<unsigned char> m_lebt;
+  std::vector<uint32_t> m_version;
+  std::priority_queue<Kandidat, std::vector<Kandidat>, std::greater<Kandidat>> m_kandidaten;
+};
+
+}  // namespace
+
+bool vereinfache(const SubsetGeometrie& geometrie, float toleranz, std::vector<Vertex>* vertices, std::vector<Face>* faces) {
+  if (geometrie.anzahlFaces == 0 || !(toleranz > 0)) {
+    return false;
+  }
+  Vereinfacher vereinfacher(geometrie);
+  // Der Quadrik-Fehler ist eine Summe quadrierter Abstaende, begrenzt also auch jeden einzelnen Abstand
+  if (vereinfacher.vereinfache(static_cast<double>(toleranz) * toleranz) == 0) {
+    return false;
+  }
+  vereinfacher.ergebnis(geometrie, vertices, faces);
+  return true;
+}
+
+VereinfachungsCache& VereinfachungsCache::instance() {
+  static VereinfachungsCache cache;
+  return cache;
+}
+
+std::shared_ptr<const VereinfachteGeometrie> VereinfachungsCache::get(const std::shared_ptr<const Ls3Datei>& datei, float toleranz) {
+  const int stufe = static_cast<int>(std::floor(std::log2(toleranz)));
+  const auto schluessel = std::make_pair(datei.get(), stufe);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_eintraege.find(schluessel);
+    if (it != std::end(m_eintraege)) {
+      return it->second;
+    }
+  }
+
+  // Ausserhalb der Sperre; rechnen zwei Threads gleichzeitig, gewinnt der erste
+  auto result = std::make_shared<VereinfachteGeometrie>();
+  result->datei = datei;
+  const size_t n_subsets = datei->geometrie.size();
+  result->geometrie = datei->geometrie;  // Bounding Box und UV-Dichte bleiben als obere Schranke gueltig
+  result->vertices.resize(n_subsets);
+  result->faces.resize(n_subsets);
+  for (size_t i = 0; i < n_subsets; i++) {
+    if (!vereinfache(datei->geometrie[i], std::ldexp(1.0f, stufe), &result->vertices[i], &result->faces[i])) {
+      continue;
+    }
+    auto& geometrie = result->geometrie[i];
+    geometrie.vertices = reinterpret_cast<const unsigned char*>(result->vertices[i].data());
+    geometrie.anzahlVertices = result->vertices[i].size();
+    geometrie.faces = reinterpret_cast<const unsigned char*>(result->faces[i].data());
+    geometrie.anzahlFaces = result->faces[i].size();
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_eintraege.try_emplace(schluessel, std::move(result)).first->second;
+}
+
+void VereinfachungsCache::leere() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_eintraege.clear();
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "./ls3_cache.hpp"
+
+#include "zusi_parser/zusi_types.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+// Vereinfachte Geometrie einer Datei, ein Eintrag pro Subset wie Ls3Datei::geometrie.
+// Nicht vereinfachte Subsets zeigen weiter in die Datei, die anderen in die eigenen Vertex- und Indexdaten.
+struct VereinfachteGeometrie {
+  // Haelt die Datei am Leben: nicht vereinfachte Subsets zeigen in ihre Daten, und ihre Adresse ist Teil des Cache-Schluessels
+  std::shared_ptr<const Ls3Datei> datei;
+  std::vector<SubsetGeometrie> geometrie;
+  std::vector<std::vector<Vertex>> vertices;
+  std::vector<std::vector<Face>> faces;
+};
+
+// Vereinfacht ein Subset durch Zusammenlegen von Kanten (Quadrik-Fehlermass nach Garland/Heckbert),
+// solange keine Flaeche um mehr als toleranz (Dateikoordinaten) verschoben wird. Ein Vertex wird immer
+// auf einen Nachbarn verschoben, Normalen und Texturkoordinaten bleiben also unveraendert.
+// Vertices an offenen Kanten bleiben, wo sie sind: Dazu gehoeren der Rand des Subsets und UV-Naehte,
+// an denen die Dreiecke keine gemeinsamen Vertices haben. Gibt false zurueck, wenn nichts vereinfacht wurde.
+bool vereinfache(const SubsetGeometrie& geometrie, float toleranz, std::vector<Vertex>* vertices, std::vector<Face>* faces);
+
+// Prozessweiter Cache vereinfachter Geometrie, je Datei und Toleranzstufe. Die Toleranz wird auf eine
+// Zweierpotenz abgerundet, damit Auftraege mit aehnlicher Aufloesung dieselbe Geometrie verwenden.
+class VereinfachungsCache {
+ public:
+  static VereinfachungsCache& instance();
+
+  // Geometrie der Datei, vereinfacht mit hoechstens toleranz Abweichung (Meter in Dateikoordinaten).
+  std::shared_ptr<const VereinfachteGeometrie> get(const std::shared_ptr<const Ls3Datei>& datei, float toleranz);
+
+  // Entfernt alle Eintraege. Noch verwendete Geometrie bleibt bis dahin gueltig.
+  void leere();
+
+ private:
+  VereinfachungsCache() = default;
+
+  std::mutex m_mutex;
+  // Schluessel: Datei und Zweierlogarithmus der Toleranz
+  std::map<std::pair<const Ls3Datei*, int>, std::shared_ptr<const VereinfachteGeometrie>> m_eintraege;
+};
+
+}
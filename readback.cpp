@@ -0,0 +1,145 @@
+#include "./readback.hpp"
+
+#include "./macros.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+
+namespace ls3render {
+
+ReadbackRing::~ReadbackRing() {
+  clear();
+}
+
+bool ReadbackRing::starte(int width, int height, int tag) {
+  assert(!voll());
+  Slot& slot = m_slots[(m_anfang + m_anzahl) % m_slots.size()];
+  if (!warteAufFreigabe(&slot)) {
+    return false;
+  }
+
+  const size_t groesse = static_cast<size_t>(width) * height * 4;
+  if (slot.pbo == 0) {
+    TRY(glGenBuffers(1, &slot.pbo));
+  }
+  TRY(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo));
+  if (groesse > slot.kapazitaet) {
+    TRY(glBufferData(GL_PIXEL_PACK_BUFFER, groesse, nullptr, GL_STREAM_READ));
+    slot.kapazitaet = groesse;
+  }
+
+  TRY(glReadBuffer(GL_COLOR_ATTACHMENT0));
+  TRY(glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+  TRY(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  if (!slot.fence) {
+    std::cerr << "glFenceSync failed" << std::endl;
+    return false;
+  }
+  slot.width = width;
+  slot.height = height;
+  slot.tag = tag;
+  ++m_anzahl;
+
+  TRY_CHECKPOINT("ReadbackRing::starte");
+  return true;
+}
+
+bool ReadbackRing::mappe(Slot* slot, const void** daten) {
+  assert(!leer());
+  constexpr GLuint64 kTimeoutNs = 1000000000;
+  GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+  while (true) {
+    const GLenum status = glClientWaitSync(slot->fence, flags, kTimeoutNs);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+      break;
+    } else if (status == GL_WAIT_FAILED) {
+      std::cerr << "glClientWaitSync failed" << std::endl;
+      return false;
+    }
+    flags = 0;  // nur beim ersten Warten flushen
+  }
+
+  TRY(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo));
+  *daten = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<size_t>(slot->width) * slot->height * 4, GL_MAP_READ_BIT);
+  if (!*daten) {
+    std::cerr << "Mapping pixel pack buffer failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ReadbackRing::schliesseAb(Slot* slot, bool behalten) {
+  // Der Slot wird auch bei Fehlern frei, sonst bliebe der Ring voll
+  glDeleteSync(slot->fence);
+  slot->fence = nullptr;
+  m_anfang = (m_anfang + 1) % m_slots.size();
+  --m_anzahl;
+
+  if (behalten) {
+    // freigegeben kann schon gesetzt sein, wenn gibFrei noch waehrend des Abholens aufgerufen wurde
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot->behalten = true;
+    return true;
+  }
+  return unmappe(slot);
+}
+
+void ReadbackRing::gibFrei(size_t slot) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots[slot].freigegeben = true;
+  }
+  m_freigegeben.notify_all();
+}
+
+bool ReadbackRing::warteAufFreigabe(Slot* slot) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!slot->behalten) {
+      slot->freigegeben = false;
+      return true;
+    }
+    m_freigegeben.wait(lock, [slot]() { return slot->freigegeben; });
+    slot->behalten = false;
+    slot->freigegeben = false;
+  }
+  return unmappe(slot);
+}
+
+bool ReadbackRing::warteAufFreigabe() {
+  bool ok = true;
+  for (auto& slot : m_slots) {
+    ok = warteAufFreigabe(&slot) && ok;
+  }
+  return ok;
+}
+
+bool ReadbackRing::unmappe(Slot* slot) {
+  GLint gemappt = GL_FALSE;
+  TRY(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo));
+  TRY(glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER, GL_BUFFER_MAPPED, &gemappt));
+  const bool ok = !gemappt || glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+  TRY(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+  return ok;
+}
+
+void ReadbackRing::clear() {
+  for (auto& slot : m_slots) {
+    if (slot.fence) {
+      glDeleteSync(slot.fence);
+    }
+    // Loeschen unmappt auch behaltene Puffer. Ohne Puffer kein GL-Aufruf, der Software-Renderer hat kein OpenGL.
+    if (slot.pbo) {
+      glDeleteBuffers(1, &slot.pbo);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot = Slot {};
+  }
+  m_anfang = 0;
+  m_anzahl = 0;
+}
+
+}
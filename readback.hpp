@@ -0,0 +1,82 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace ls3render {
+
+// Asynchrones Auslesen von Framebuffern ueber einen Ring von Pixel-Pack-Puffern.
+// glReadPixels in einen Puffer kehrt sofort zurueck, die GPU kann also schon den naechsten Auftrag zeichnen,
+// waehrend die Pixel des vorigen noch kopiert werden. Abgeholt wird erst, wenn der zugehoerige Fence signalisiert ist.
+// Abgeholte Puffer koennen gemappt behalten werden, bis sie (aus einem beliebigen Thread) freigegeben werden,
+// z.B. um sie ohne Kopie zu kodieren, waehrend schon weitere Auftraege laufen.
+class ReadbackRing {
+ public:
+  explicit ReadbackRing(size_t groesse = 3) : m_slots(groesse) {}
+  ~ReadbackRing();
+  ReadbackRing(const ReadbackRing&) = delete;
+  ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+  size_t groesse() const { return m_slots.size(); }
+  bool leer() const { return m_anzahl == 0; }
+  bool voll() const { return m_anzahl == m_slots.size(); }
+
+  // Liest COLOR_ATTACHMENT0 des gebundenen Read-Framebuffers als BGRA in den naechsten freien Puffer.
+  // Darf nur aufgerufen werden, wenn der Ring nicht voll ist. Wird der Puffer noch behalten,
+  // wird vorher gewartet, bis er freigegeben ist.
+  bool starte(int width, int height, int tag);
+
+  // Wartet auf den aeltesten Auftrag und ruft ziel(slot, tag, daten, width, height) mit den Pixeldaten auf,
+  // bei Fehlschlag mit daten == nullptr. Gibt ziel true zurueck, bleiben die Daten gueltig, bis gibFrei(slot)
+  // aufgerufen wurde, sonst nur waehrend des Aufrufs.
+  template <typename Ziel>
+  bool holeAb(Ziel&& ziel) {
+    const size_t index = m_anfang;
+    Slot& slot = m_slots[index];
+    const void* daten = nullptr;
+    const bool ok = mappe(&slot, &daten);
+    const bool behalten = ziel(index, slot.tag, ok ? daten : nullptr, slot.width, slot.height) && ok;
+    return schliesseAb(&slot, behalten) && ok;
+  }
+
+  // Gibt einen behaltenen Puffer frei. Darf aus jedem Thread aufgerufen werden, auch bevor holeAb zurueckkehrt.
+  void gibFrei(size_t slot);
+  // Wartet, bis alle behaltenen Puffer freigegeben sind, und unmappt sie.
+  bool warteAufFreigabe();
+
+  // Gibt alle Puffer frei. Noch nicht abgeholte Auftraege gehen verloren, behaltene Daten werden ungueltig.
+  void clear();
+
+ private:
+  struct Slot {
+    GLuint pbo { 0 };
+    size_t kapazitaet { 0 };
+    GLsync fence { nullptr };
+    int width { 0 };
+    int height { 0 };
+    int tag { 0 };
+    // Nach holeAb noch gemappt, bis freigegeben gesetzt ist (beides unter m_mutex)
+    bool behalten { false };
+    bool freigegeben { false };
+  };
+
+  bool mappe(Slot* slot, const void** daten);
+  // Gibt den Slot fuer den naechsten Auftrag frei und unmappt den Puffer, ausser er wird behalten.
+  bool schliesseAb(Slot* slot, bool behalten);
+  // Wartet, bis ein behaltener Puffer freigegeben ist, und unmappt ihn.
+  bool warteAufFreigabe(Slot* slot);
+  bool unmappe(Slot* slot);
+
+  std::vector<Slot> m_slots;
+  size_t m_anfang { 0 };  // aeltester Auftrag
+  size_t m_anzahl { 0 };
+  std::mutex m_mutex;
+  std::condition_variable m_freigegeben;
+};
+
+}
@@ -1,5 +1,8 @@
 #include "./render_object.hpp"
 
+#include "./ls3_cache.hpp"
+#include "./mesh_simplifier.hpp"
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/rotate_vector.hpp>
@@ -10,9 +13,8 @@
 #include <GLFW/glfw3.h>
 
 #include "./shader_parameters.hpp"
-#include "./utils.hpp"
 #include "./macros.hpp"
-#include "./texture.hpp"
+#include "./texture_manager.hpp"
 
 #include "zusi_parser/zusi_types.hpp"
 
@@ -24,27 +26,88 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <string>
-#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace ls3render {
 
-GLRenderObject::GLRenderObject() : m_vao(), m_vbos(), m_ebos(), m_texs(), m_initialized(false) {}
+namespace {
+
+// Achsenparallele Huelle der mit transform (affin) abgebildeten Box,
+// gleichwertig zur Transformation aller 8 Eckpunkte.
+std::pair<glm::vec3, glm::vec3> transformiereBox(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max) {
+  const glm::vec3 mitte = (min + max) * 0.5f;
+  const glm::vec3 halbe_groesse = (max - min) * 0.5f;
+  const glm::vec3 neue_mitte { transform * glm::vec4 { mitte, 1 } };
+  glm::vec3 neue_halbe_groesse { 0 };
+  for (int spalte = 0; spalte < 3; spalte++) {
+    neue_halbe_groesse += glm::abs(glm::vec3 { transform[spalte] }) * halbe_groesse[spalte];
+  }
+  return { neue_mitte - neue_halbe_groesse, neue_mitte + neue_halbe_groesse };
+}
+
+// Depth-Bias fuer glPolygonOffset (units) zum zBias eines Materials
+float polygonOffset(int zBias) {
+  // Faktor fuer Depth-Bias bei Zusi: 0.000033 - bezieht sich aber auf Direct3D
+
+  // Wine-Source-Code:
+  /* The Direct3D depth bias is specified in normalized depth coordinates. In
+   * OpenGL the bias is specified in units of "the smallest value that is
+   * guaranteed to produce a resolvable offset for a given implementation". To
+   * convert from D3D to GL we need to divide the D3D depth bias by that value.
+   * We try to detect the value from GL with test draws. On most drivers (r300g,
+   * 600g, Nvidia, i965 on Mesa) the value is 2^23 for fixed point depth buffers,
+   * for r200 and i965 on OSX it is 2^24, for r500 on OSX it is 2^22. For floating
+   * point buffers it is 2^22, 2^23 or 2^24 depending on the GPU. The value does
+   * not depend on the depth buffer precision on any driver.
+   * [...]
+   * Note that SLOPESCALEDEPTHBIAS is a scaling factor for the depth slope, and
+   * doesn't need to be scaled to account for GL vs D3D differences. */
+
+  // Auf meinem Computer: scale 2^23 = 8388608, ergibt zusammen mit dem Zusi-Faktor
+  // einen Faktor von ~275 fuer den in der LS3-Datei angegebenen Bias.
+  return 275 * zBias;
+}
 
-bool GLRenderObject::cleanup() {
-  TRY(glDeleteBuffers(m_vbos.size(), m_vbos.data()));
-  TRY(glDeleteBuffers(m_ebos.size(), m_ebos.data()));
-  for (const auto& texs : m_texs) {
-    TRY(glDeleteTextures(texs.size(), texs.data()));
+float alphaCutoff(int texVoreinstellung, bool texturiert) {
+  if (!texturiert) {
+    return 0;
+  } else if (texVoreinstellung == 8) {
+    // Laubaehnliche Strukturen, Alpharef 100
+    return 100.0 / 255.0;
+  } else if (texVoreinstellung == 12) {
+    // Laubaehnliche Strukturen, Alpharef 150
+    return 150.0 / 255.0;
+  } else if (texVoreinstellung == 1 || texVoreinstellung == 3) {
+    return 0;
+  } else {
+    return 1.0 / 255.0;
   }
-  TRY(glDeleteVertexArrays(1, &m_vao));
+}
+
+}  // namespace
+
+GLRenderObject::GLRenderObject() : m_ranges(), m_texs(), m_instance_buffer(), m_instance_texture(), m_initialized(false) {}
+
+bool GLRenderObject::cleanup() {
+  m_ranges.clear();
+  m_texs.clear();
+  TRY(glDeleteTextures(1, &m_instance_texture));
+  m_instance_texture = 0;
+  TRY(glDeleteBuffers(1, &m_instance_buffer));
+  m_instance_buffer = 0;
   m_initialized = false;
   return true;
 }
 
+bool GLRenderObject::isInitialized() const {
+  return m_initialized;
+}
+
 GLRenderObject::~GLRenderObject() {
   if (!m_initialized) {
     return;
@@ -53,337 +116,341 @@ GLRenderObject::~GLRenderObject() {
   cleanup();
 }
 
-Ls3RenderObject::Ls3RenderObject(const Landschaft& ls3_datei, const std::unordered_map<int, float>& ani_positionen, const LichterSchaltung& lichterSchaltung) : GLRenderObject(),
-    m_ls3_datei(ls3_datei), m_ani_positionen(ani_positionen), m_lichter_schaltung{lichterSchaltung} {}
+Ls3RenderObject::Ls3RenderObject(std::shared_ptr<const Ls3Datei> ls3_datei, const std::unordered_map<int, float>& ani_positionen, const LichterSchaltung& lichterSchaltung) : GLRenderObject(),
+    m_datei(std::move(ls3_datei)), m_batches(), m_instances(), m_spur_positionen(m_datei->spurPositionen(ani_positionen)),
+    m_lichter_schaltung{lichterSchaltung}, m_z_offset_summe(std::accumulate(
+        std::begin(m_datei->materialien), std::end(m_datei->materialien), 0,
+        [](int summe, const auto& material) { return summe + material.zBias; })),
+    m_subset_transforms(), m_subset_normals() {
+  m_bounding_box = { glm::vec3 { std::numeric_limits<float>::max() }, glm::vec3 { std::numeric_limits<float>::lowest() } };
+  updateSubsetTransforms();
+}
+
+bool Ls3RenderObject::init(TextureManager& textureManager, MeshBuffer& meshBuffer, float pixelProMeter, float vereinfachungPixel) {
+  // Je groesser das Objekt abgebildet wird, desto feiner muss die Textur bzw. die Geometrie sein.
+  // Spaeter hinzukommende Instanzen werden nicht mehr beruecksichtigt.
+  const float pixel_pro_einheit = pixelProEinheit(pixelProMeter);
 
-bool Ls3RenderObject::init() {
-  TRY(glGenVertexArrays(1, &m_vao));
-  TRY(glBindVertexArray(m_vao));
+  // Geometrie wird von allen Objekten derselben Datei (und Toleranzstufe) gemeinsam genutzt
+  if (vereinfachungPixel > 0 && pixel_pro_einheit > 0) {
+    m_ranges = meshBuffer.add(VereinfachungsCache::instance().get(m_datei, vereinfachungPixel / pixel_pro_einheit));
+  } else {
+    m_ranges = meshBuffer.add(*m_datei);
+  }
 
-  auto n_subsets = m_ls3_datei.children_SubSet.size();
-  m_vbos.resize(n_subsets);
-  m_ebos.resize(n_subsets);
+  auto n_subsets = m_datei->materialien.size();
   m_texs.resize(n_subsets);
 
-  TRY(glGenBuffers(n_subsets, m_vbos.data()));
-  TRY(glGenBuffers(n_subsets, m_ebos.data()));
-
   for (size_t i = 0; i < n_subsets; i++) {
-    const auto& mesh_subset = m_ls3_datei.children_SubSet[i];
-
-    // Create Vertex Buffer Object and copy the vertex data into it
-    TRY(glBindBuffer(GL_ARRAY_BUFFER, m_vbos[i]));  // Make vbo the active object
-    TRY(glBufferData(GL_ARRAY_BUFFER, mesh_subset->children_Vertex.size() * sizeof(Vertex), mesh_subset->children_Vertex.data(), GL_STATIC_DRAW));  // GL_STATIC_DRAW: vertex data will be uploaded once, drawn many times
-
-    // Create Element Buffer Object
-    TRY(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebos[i]));
-    TRY(glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh_subset->children_Face.size() * sizeof(Face), mesh_subset->children_Face.data(), GL_STATIC_DRAW));
-
-    auto n_texturen = mesh_subset->children_Textur.size();
-    m_texs[i].resize(n_texturen);
-    TRY(glGenTextures(n_texturen, m_texs[i].data()));
-    for (size_t j = 0; j < n_texturen; j++) {
-      Texture texture;
-#ifndef NDEBUG
-      std::cerr << "Loading image " << mesh_subset->children_Textur[j]->Datei.Dateiname << std::endl;
-#endif
-      TRY(glBindTexture(GL_TEXTURE_2D, m_texs[i][j]));
-      if (!texture.load_DDS(mesh_subset->children_Textur[j]->Datei.Dateiname)) {
-        std::cerr << "Loading image " << mesh_subset->children_Textur[j]->Datei.Dateiname << " failed" << std::endl;
+    const auto& texturen = m_datei->materialien[i].texturen;
+    for (size_t t = 0; t < texturen.size(); t++) {
+      // Textur 1 wird mit UV1 abgetastet, Textur 2 mit UV2
+      const float uvDichte = m_datei->geometrie[i].uvDichte[std::min<size_t>(t, 1)];
+      auto texture = textureManager.get(texturen[t], pixel_pro_einheit > 0 ? uvDichte / pixel_pro_einheit : 0.0f);
+      if (!texture) {
         return false;
       }
+      m_texs[i].push_back(std::move(texture));
+    }
+  }
+
+  m_batches.clear();
+  for (size_t i = 0; i < n_subsets; i++) {
+    const auto& range = m_ranges[i];
+    if (range.count == 0) {
+      continue;
     }
+    if (m_batches.empty() || !hasSameState(m_batches.back().subset, i)) {
+      m_batches.push_back(DrawBatch { i, {}, {}, {}, {} });
+    }
+    auto& batch = m_batches.back();
+    batch.subsets.push_back(i);
+    batch.counts.push_back(range.count);
+    batch.indexOffsets.push_back(range.indexOffset);
+    batch.baseVertices.push_back(range.baseVertex);
   }
+  m_sichtbare_batches = m_batches;
+
+  TRY(glGenBuffers(1, &m_instance_buffer));
+  TRY(glGenTextures(1, &m_instance_texture));
+  TRY(glBindBuffer(GL_TEXTURE_BUFFER, m_instance_buffer));
+  TRY(glBindTexture(GL_TEXTURE_BUFFER, m_instance_texture));
+  TRY(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instance_buffer));
+  TRY(glBindTexture(GL_TEXTURE_BUFFER, 0));
+  TRY_CHECKPOINT("Ls3RenderObject::init");
+  m_uploaded_instances = 0;
 
   m_initialized = true;
+  return updateInstances();
+}
+
+bool Ls3RenderObject::updateInstances() {
+  if (m_uploaded_instances == m_instances.size()) {
+    return true;
+  }
+
+  // Layout muss zum Vertex-Shader passen: Modellmatrix, dann Normalenmatrix (je 4 RGBA32F-Texel)
+  std::vector<glm::mat4> instance_data;
+  instance_data.reserve(2 * m_instances.size());
+  for (const auto& transform : m_instances) {
+    instance_data.push_back(transform);
+    instance_data.push_back(glm::transpose(glm::inverse(transform)));
+  }
+
+  TRY(glBindBuffer(GL_TEXTURE_BUFFER, m_instance_buffer));
+  TRY(glBufferData(GL_TEXTURE_BUFFER, instance_data.size() * sizeof(glm::mat4), instance_data.data(), GL_STATIC_DRAW));
+  TRY(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+  TRY_CHECKPOINT("Ls3RenderObject::updateInstances");
+
+  m_uploaded_instances = m_instances.size();
   return true;
 }
 
-void Ls3RenderObject::setTransform(glm::mat4 transform) {
-  m_transform = transform;
+void Ls3RenderObject::addInstance(const glm::mat4& transform) {
+  m_instances.push_back(transform);
+  const auto [min, max] = instanceBoundingBox(transform);
+  m_bounding_box.first = glm::min(m_bounding_box.first, min);
+  m_bounding_box.second = glm::max(m_bounding_box.second, max);
+}
+
+bool Ls3RenderObject::canInstance(const Ls3Datei& ls3_datei, const std::vector<float>& spur_positionen, const LichterSchaltung& lichterSchaltung) const {
+  return &ls3_datei == m_datei.get() && lichterSchaltung == m_lichter_schaltung && spur_positionen == m_spur_positionen;
+}
+
+std::pair<glm::vec3, glm::vec3> Ls3RenderObject::instanceBoundingBox(const glm::mat4& transform) const {
+  std::pair<glm::vec3, glm::vec3> result { glm::vec3 { std::numeric_limits<float>::max() }, glm::vec3 { std::numeric_limits<float>::lowest() } };
+  for (size_t i = 0, n_subsets = m_datei->geometrie.size(); i < n_subsets; i++) {
+    const auto& geometrie = m_datei->geometrie[i];
+    if (geometrie.anzahlFaces == 0) {
+      continue;
+    }
+    const auto [min, max] = transformiereBox(transform * m_subset_transforms[i], geometrie.aabbMin, geometrie.aabbMax);
+    result.first = glm::min(result.first, min);
+    result.second = glm::max(result.second, max);
+  }
+  return result;
+}
+
+std::pair<glm::vec3, glm::vec3> Ls3RenderObject::getBoundingBox() const {
+  return m_bounding_box;
 }
 
 void Ls3RenderObject::updateBoundingBox(std::pair<glm::vec3, glm::vec3>* boundingBox) {
-  for (size_t i = 0, n_subsets = m_ls3_datei.children_SubSet.size(); i < n_subsets; i++) {
-    const auto& mesh_subset = m_ls3_datei.children_SubSet[i];
-    if (mesh_subset->children_Face.empty()) {
+  // Bereits beruecksichtigte Instanzen aendern sich nicht mehr, die Box waechst nur
+  for (size_t i = 0, n_subsets = m_datei->geometrie.size(); i < n_subsets; i++) {
+    const auto& geometrie = m_datei->geometrie[i];
+    if (geometrie.anzahlFaces == 0) {
       continue;
     }
 
-    glm::mat4 transform = getTransform(i);
+    // Die lokale Bounding Box wird beim Laden berechnet und hier nur noch transformiert
+    for (size_t j = m_instances_in_bounding_box; j < m_instances.size(); j++) {
+      const auto [min, max] = transformiereBox(m_instances[j] * m_subset_transforms[i], geometrie.aabbMin, geometrie.aabbMax);
+      boundingBox->first = glm::min(boundingBox->first, min);
+      boundingBox->second = glm::max(boundingBox->second, max);
+    }
+  }
+  m_instances_in_bounding_box = m_instances.size();
+}
 
-    // Berechne Bounding Box zuerst lokal und transformiere dann
-    glm::vec4 min { std::numeric_limits<glm::vec4::value_type>::max(), std::numeric_limits<glm::vec4::value_type>::max(), std::numeric_limits<glm::vec4::value_type>::max(), 1 };
-    glm::vec4 max { std::numeric_limits<glm::vec4::value_type>::lowest(), std::numeric_limits<glm::vec4::value_type>::lowest(), std::numeric_limits<glm::vec4::value_type>::lowest(), 1 };
+int Ls3RenderObject::getSubsetZOffsetSumme() const {
+  return m_z_offset_summe;
+}
 
-    // Zaehle nur Vertices, die wirklich verwendet werden
-    std::vector<bool> used_vertices(mesh_subset->children_Vertex.size(), false);
-    for (const auto& dreieck : mesh_subset->children_Face) {
-      for (size_t j = 0; j < 3; j++) {
-        used_vertices[dreieck.i[j]] = true;
+size_t Ls3RenderObject::cull(const SichtVolumen& sicht) {
+  size_t verworfen = 0;
+  m_sichtbare_batches.clear();
+  for (const auto& batch : m_batches) {
+    DrawBatch result { batch.subset, {}, {}, {}, {} };
+    for (size_t k = 0; k < batch.subsets.size(); k++) {
+      if (!istSichtbar(sicht, batch.subsets[k])) {
+        verworfen++;
+        continue;
       }
+      result.subsets.push_back(batch.subsets[k]);
+      result.counts.push_back(batch.counts[k]);
+      result.indexOffsets.push_back(batch.indexOffsets[k]);
+      result.baseVertices.push_back(batch.baseVertices[k]);
+    }
+    if (!result.subsets.empty()) {
+      m_sichtbare_batches.push_back(std::move(result));
     }
+  }
+  return verworfen;
+}
 
-    auto updateBoundingBoxForVertex = [&](size_t i) {
-      const auto& vertex = mesh_subset->children_Vertex[i];
-      min.x = std::min(min.x, vertex.p.x);
-      max.x = std::max(max.x, vertex.p.x);
-      min.y = std::min(min.y, vertex.p.y);
-      max.y = std::max(max.y, vertex.p.y);
-      min.z = std::min(min.z, vertex.p.z);
-      max.z = std::max(max.z, vertex.p.z);
-    };
-
-    if (std::find(std::cbegin(used_vertices), std::cend(used_vertices), false) == std::cend(used_vertices)) {
-      // all vertices used
-      for (size_t i = 0; i < mesh_subset->children_Vertex.size(); ++i) {
-        updateBoundingBoxForVertex(i);
-      }
-    } else {
-      for (size_t i = 0; i < mesh_subset->children_Vertex.size(); ++i) {
-        if (__builtin_expect(used_vertices[i] == true, 1)) {
-          updateBoundingBoxForVertex(i);
-        }
+void Ls3RenderObject::appendDrawRecords(std::vector<DrawRecord>* records) const {
+  for (const auto& batch : m_sichtbare_batches) {
+    const size_t i = batch.subset;
+    if (!wirdGezeichnet(i)) {
+      continue;
+    }
+    const auto& material = m_datei->materialien[i];
+
+    DrawRecord record {};
+    record.instanceTexture = m_instance_texture;
+    record.instanceCount = m_instances.size();
+    record.model = &m_subset_transforms[i];
+    record.nor = &m_subset_normals[i];
+    record.textures = &m_texs[i];
+    record.diffuseColor = material.diffuseColor;
+    record.emissiveColor = material.emissiveColor;
+    record.texVoreinstellung = material.texVoreinstellung;
+    record.polygonOffset = polygonOffset(material.zBias);
+    record.blend = (material.texVoreinstellung == 4);
+    record.alphaCutoff = alphaCutoff(material.texVoreinstellung, !m_texs[i].empty());
+
+    record.boxMin = glm::vec3 { std::numeric_limits<float>::max() };
+    record.boxMax = glm::vec3 { std::numeric_limits<float>::lowest() };
+    for (size_t subset : batch.subsets) {
+      const auto& geometrie = m_datei->geometrie[subset];
+      for (const auto& instance : m_instances) {
+        const auto [min, max] = transformiereBox(instance * m_subset_transforms[subset], geometrie.aabbMin, geometrie.aabbMax);
+        record.boxMin = glm::min(record.boxMin, min);
+        record.boxMax = glm::max(record.boxMax, max);
       }
     }
 
-    // Transformiere gesamte Bounding Box (alle 8 Eckpunkte)
-    glm::vec4 v000 = transform * min;
-    glm::vec4 v001 = transform * glm::vec4 { min.x, min.y, max.z, 1 };
-    glm::vec4 v010 = transform * glm::vec4 { min.x, max.y, min.z, 1 };
-    glm::vec4 v011 = transform * glm::vec4 { min.x, max.y, max.z, 1 };
-    glm::vec4 v100 = transform * glm::vec4 { max.x, min.y, min.z, 1 };
-    glm::vec4 v101 = transform * glm::vec4 { max.x, min.y, max.z, 1 };
-    glm::vec4 v110 = transform * glm::vec4 { max.x, max.y, min.z, 1 };
-    glm::vec4 v111 = transform * max;
-
-    boundingBox->first[0] = std::min({ boundingBox->first.x, v000.x, v001.x, v010.x, v011.x, v100.x, v101.x, v110.x, v111.x });
-    boundingBox->first[1] = std::min({ boundingBox->first.y, v000.y, v001.y, v010.y, v011.y, v100.y, v101.y, v110.y, v111.y });
-    boundingBox->first[2] = std::min({ boundingBox->first.z, v000.z, v001.z, v010.z, v011.z, v100.z, v101.z, v110.z, v111.z });
-
-    boundingBox->second[0] = std::max({ boundingBox->second.x, v000.x, v001.x, v010.x, v011.x, v100.x, v101.x, v110.x, v111.x });
-    boundingBox->second[1] = std::max({ boundingBox->second.y, v000.y, v001.y, v010.y, v011.y, v100.y, v101.y, v110.y, v111.y });
-    boundingBox->second[2] = std::max({ boundingBox->second.z, v000.z, v001.z, v010.z, v011.z, v100.z, v101.z, v110.z, v111.z });
+    record.counts = batch.counts.data();
+    record.indexOffsets = batch.indexOffsets.data();
+    record.baseVertices = batch.baseVertices.data();
+    record.drawCount = batch.count();
+    records->push_back(record);
   }
 }
 
-int Ls3RenderObject::getSubsetZOffsetSumme() {
-  int result { 0 };
-  for (size_t i = 0, n_subsets = m_ls3_datei.children_SubSet.size(); i < n_subsets; i++) {
-    result += m_ls3_datei.children_SubSet[i]->zBias;
+size_t Ls3RenderObject::appendSoftwareDraws(const SichtVolumen& sicht, float pixelProMeter, float vereinfachungPixel, std::vector<SoftwareDraw>* draws) const {
+  const float pixel_pro_einheit = pixelProEinheit(pixelProMeter);
+  std::shared_ptr<const VereinfachteGeometrie> vereinfacht;
+  if (vereinfachungPixel > 0 && pixel_pro_einheit > 0) {
+    vereinfacht = VereinfachungsCache::instance().get(m_datei, vereinfachungPixel / pixel_pro_einheit);
   }
-  return result;
-}
-
-bool Ls3RenderObject::render(const ShaderParameters& shaderParameters) const {
-  TRY(glBindVertexArray(m_vao));
-
-  for (size_t i = 0, n_subsets = m_ls3_datei.children_SubSet.size(); i < n_subsets; i++) {
-    const auto& mesh_subset = m_ls3_datei.children_SubSet[i];
 
-    if (mesh_subset->TypLs3 == 16) { // Dummy
+  size_t verworfen = 0;
+  for (size_t i = 0, n_subsets = m_datei->materialien.size(); i < n_subsets; i++) {
+    const auto& geometrie = vereinfacht ? vereinfacht->geometrie[i] : m_datei->geometrie[i];
+    if (geometrie.anzahlFaces == 0) {
       continue;
     }
-    if (mesh_subset->TypLs3 == 17 && !m_lichter_schaltung.spitzenlichtVorne) {
+    if (!istSichtbar(sicht, i)) {
+      verworfen++;
       continue;
     }
-    if (mesh_subset->TypLs3 == 18 && !m_lichter_schaltung.schlusslichtVorne) {
+    if (!wirdGezeichnet(i)) {
       continue;
     }
-    if (mesh_subset->TypLs3 == 19 && !m_lichter_schaltung.spitzenlichtHinten) {
-      continue;
+    const auto& material = m_datei->materialien[i];
+
+    SoftwareDraw draw {};
+    draw.geometrie = &geometrie;
+    draw.halter = vereinfacht;
+    draw.texturen = &material.texturen;
+    for (size_t t = 0; t < 2; t++) {
+      draw.uvProPixel[t] = pixel_pro_einheit > 0 ? m_datei->geometrie[i].uvDichte[t] / pixel_pro_einheit : 0.0f;
     }
-    if (mesh_subset->TypLs3 == 20 && !m_lichter_schaltung.schlusslichtHinten) {
-      continue;
+    draw.diffuseColor = material.diffuseColor;
+    draw.emissiveColor = material.emissiveColor;
+    draw.texVoreinstellung = material.texVoreinstellung;
+    draw.polygonOffset = polygonOffset(material.zBias);
+    draw.blend = (material.texVoreinstellung == 4);
+    draw.alphaCutoff = alphaCutoff(material.texVoreinstellung, !material.texturen.empty());
+
+    // Wie beim instanzierten Zeichnen alle Instanzen eines Subsets nacheinander
+    for (const auto& instance : m_instances) {
+      draw.model = instance * m_subset_transforms[i];
+      draw.nor = glm::transpose(glm::inverse(instance)) * m_subset_normals[i];
+      draws->push_back(draw);
     }
+  }
+  return verworfen;
+}
 
-    auto texVoreinstellung = mesh_subset->RenderFlags->TexVoreinstellung == 5 ? mesh_subset->NachtEinstellung /* sollte heissen: TagVoreinstellung */ : mesh_subset->RenderFlags->TexVoreinstellung;
+bool Ls3RenderObject::hasSameState(size_t lhs, size_t rhs) const {
+  const auto& a = m_datei->materialien[lhs];
+  const auto& b = m_datei->materialien[rhs];
+  return a.typLs3 == b.typLs3
+    && a.texVoreinstellung == b.texVoreinstellung
+    && a.zBias == b.zBias
+    && a.diffuseColor == b.diffuseColor
+    && a.emissiveColor == b.emissiveColor
+    && m_texs[lhs] == m_texs[rhs]
+    && m_subset_transforms[lhs] == m_subset_transforms[rhs];
+}
 
-    if (texVoreinstellung == 9 || texVoreinstellung == 10 || texVoreinstellung == 11) {
-      // Nachtfenster, Nebelwand
-      continue;
+float Ls3RenderObject::pixelProEinheit(float pixelProMeter) const {
+  float skalierung = 0.0f;
+  for (const auto& instance : m_instances) {
+    for (int achse = 0; achse < 3; achse++) {
+      skalierung = std::max(skalierung, glm::length(glm::vec3(instance[achse])));
     }
+  }
+  return pixelProMeter * skalierung;
+}
 
-    glm::mat4 transform = getTransform(i);
-    TRY(glUniformMatrix4fv(shaderParameters.uni_model, 1, GL_FALSE, glm::value_ptr(transform)));
-
-    glm::mat4 transform_nor = glm::transpose(glm::inverse(transform));
-    TRY(glUniformMatrix4fv(shaderParameters.uni_nor, 1, GL_FALSE, glm::value_ptr(transform_nor)));
-
-    TRY(glBindBuffer(GL_ARRAY_BUFFER, m_vbos[i]));
-    TRY(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebos[i]));
-
-    const size_t numTextures = std::min(m_texs[i].size(), shaderParameters.uni_tex.size());
-    TRY(glUniform1i(shaderParameters.uni_numTextures, numTextures));
-    for (size_t j = 0; j < numTextures; j++) {
-      TRY(glActiveTexture(GL_TEXTURE0 + j));
-      TRY(glBindTexture(GL_TEXTURE_2D, m_texs[i][j]));
-
-      // https://gamedev.stackexchange.com/a/69397
-      float aniso = 0.0f;
-      glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &aniso);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
-
-      TRY(glUniform1i(shaderParameters.uni_tex[j], j));
+bool Ls3RenderObject::istSichtbar(const SichtVolumen& sicht, size_t i) const {
+  // Ein Subset wird gezeichnet, sobald es in einer Instanz sichtbar ist; Instanzen werden gemeinsam gezeichnet.
+  // Etwas Spielraum, damit Subsets genau am Bildrand nicht durch Rundungsfehler verschwinden.
+  constexpr float kRand = 1.0f + 1e-4f;
+  const auto& geometrie = m_datei->geometrie[i];
+  for (const auto& instance : m_instances) {
+    const auto [min, max] = transformiereBox(sicht.viewProj * instance * m_subset_transforms[i], geometrie.aabbMin, geometrie.aabbMax);
+    if (max.x < -kRand || min.x > kRand || max.y < -kRand || min.y > kRand || max.z < -kRand || min.z > kRand) {
+      continue;
     }
-
-    TRY(glUniform4f(shaderParameters.uni_diffuse_color,
-          mesh_subset->Cd.r / 255.0,
-          mesh_subset->Cd.g / 255.0,
-          mesh_subset->Cd.b / 255.0,
-          mesh_subset->Cd.a / 255.0));
-    TRY(glUniform4f(shaderParameters.uni_emissive_color,
-          mesh_subset->Ce.r / 255.0,
-          mesh_subset->Ce.g / 255.0,
-          mesh_subset->Ce.b / 255.0,
-          mesh_subset->Ce.a / 255.0));
-
-    TRY(glUniform1i(shaderParameters.uni_texVoreinstellung, texVoreinstellung));
-
-    static_assert(std::is_standard_layout<Vertex>::value, "Vertex must conform to StandardLayoutType");  // for offsetof
-
-    static_assert(sizeof(Vec3::x) == sizeof(GL_FLOAT), "Wrong size of Vec3::X");
-    static_assert(sizeof(Vec3::y) == sizeof(GL_FLOAT), "Wrong size of Vec3::Y");
-    static_assert(sizeof(Vec3::z) == sizeof(GL_FLOAT), "Wrong size of Vec3::Z");
-    static_assert(offsetof(Vec3, x) == 0 * sizeof(GL_FLOAT), "Wrong offset of Vec3::X");
-    static_assert(offsetof(Vec3, y) == 1 * sizeof(GL_FLOAT), "Wrong offset of Vec3::Y");
-    static_assert(offsetof(Vec3, z) == 2 * sizeof(GL_FLOAT), "Wrong offset of Vec3::Z");
-
-    TRY(glEnableVertexAttribArray(shaderParameters.attrib_pos));
-    // This also stores the VBO that is currently bound to GL_ARRAY_BUFFER
-    TRY(glVertexAttribPointer(
-        shaderParameters.attrib_pos,  // Input contains ...
-        3,           // ... three values ..
-        GL_FLOAT,    // ... of type GL_FLOAT ...
-        GL_FALSE,    // ... which should not be normalized.
-        sizeof(Vertex),  // stride
-        reinterpret_cast<const GLvoid*>(offsetof(Vertex, p))));         // offset
-
-    TRY(glEnableVertexAttribArray(shaderParameters.attrib_nor));
-    TRY(glVertexAttribPointer(
-        shaderParameters.attrib_nor,  // Input contains ...
-        3,           // ... three values ..
-        GL_FLOAT,    // ... of type GL_FLOAT ...
-        GL_FALSE,    // ... which should not be normalized.
-        sizeof(Vertex),  // stride
-        reinterpret_cast<const GLvoid*>(offsetof(Vertex, n))));         // offset
-
-    static_assert(sizeof(Vertex::U) == sizeof(GL_FLOAT), "Wrong size of Vertex::U");
-    static_assert(sizeof(Vertex::V) == sizeof(GL_FLOAT), "Wrong size of Vertex::V");
-    static_assert(offsetof(Vertex, V) - offsetof(Vertex, U) == sizeof(GL_FLOAT), "Wrong offset of Vertex::V");
-
-    TRY(glEnableVertexAttribArray(shaderParameters.attrib_uv1));
-    // This also stores the VBO that is currently bound to GL_ARRAY_BUFFER
-    TRY(glVertexAttribPointer(
-        shaderParameters.attrib_uv1,
-        2,
-        GL_FLOAT,
-        GL_FALSE,
-        sizeof(Vertex),
-        reinterpret_cast<const GLvoid*>(offsetof(Vertex, U))));
-
-    static_assert(sizeof(Vertex::U2) == sizeof(GL_FLOAT), "Wrong size of Vertex::U2");
-    static_assert(sizeof(Vertex::V2) == sizeof(GL_FLOAT), "Wrong size of Vertex::V2");
-    static_assert(offsetof(Vertex, V2) - offsetof(Vertex, U2) == sizeof(GL_FLOAT), "Wrong offset of Vertex::V2");
-
-    TRY(glEnableVertexAttribArray(shaderParameters.attrib_uv2));
-    TRY(glVertexAttribPointer(
-        shaderParameters.attrib_uv2,
-        2,
-        GL_FLOAT,
-        GL_FALSE,
-        sizeof(Vertex),
-        reinterpret_cast<const GLvoid*>(offsetof(Vertex, U2))));
-
-    auto bias = mesh_subset->zBias;
-
-    // Faktor fuer Depth-Bias bei Zusi: 0.000033 - bezieht sich aber auf Direct3D
-
-    // Wine-Source-Code:
-    /* The Direct3D depth bias is specified in normalized depth coordinates. In
-     * OpenGL the bias is specified in units of "the smallest value that is
-     * guaranteed to produce a resolvable offset for a given implementation". To
-     * convert from D3D to GL we need to divide the D3D depth bias by that value.
-     * We try to detect the value from GL with test draws. On most drivers (r300g,
-     * 600g, Nvidia, i965 on Mesa) the value is 2^23 for fixed point depth buffers,
-     * for r200 and i965 on OSX it is 2^24, for r500 on OSX it is 2^22. For floating
-     * point buffers it is 2^22, 2^23 or 2^24 depending on the GPU. The value does
-     * not depend on the depth buffer precision on any driver.
-     * [...]
-     * Note that SLOPESCALEDEPTHBIAS is a scaling factor for the depth slope, and
-     * doesn't need to be scaled to account for GL vs D3D differences. */
-
-    // Auf meinem Computer: scale 2^23 = 8388608, ergibt zusammen mit dem Zusi-Faktor
-    // einen Faktor von ~275 fuer den in der LS3-Datei angegebenen Bias.
-    TRY(glPolygonOffset(0, 275 * bias));
-
-    if (texVoreinstellung == 4) {
-        // Enable alpha blending
-        TRY(glEnable(GL_BLEND));
-        TRY(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    } else {
-        TRY(glDisable(GL_BLEND));
+    if (sicht.mindestPixel > 0
+        && (max.x - min.x) * 0.5f * sicht.bildBreite < sicht.mindestPixel
+        && (max.y - min.y) * 0.5f * sicht.bildHoehe < sicht.mindestPixel) {
+      continue;
     }
+    return true;
+  }
+  return false;
+}
 
-    // Alpha cutoff
-    if (numTextures == 0) {
-        TRY(glUniform1f(shaderParameters.uni_alphaCutoff, 0));
-    } else if (texVoreinstellung == 8) {
-        // Laubaehnliche Strukturen, Alpharef 100
-        TRY(glUniform1f(shaderParameters.uni_alphaCutoff, 100.0 / 255.0));
-    } else if (texVoreinstellung == 12) {
-        // Laubaehnliche Strukturen, Alpharef 150
-        TRY(glUniform1f(shaderParameters.uni_alphaCutoff, 150.0 / 255.0));
-    } else if (texVoreinstellung == 1 || texVoreinstellung == 3) {
-        TRY(glUniform1f(shaderParameters.uni_alphaCutoff, 0));
-    } else {
-        TRY(glUniform1f(shaderParameters.uni_alphaCutoff, 1.0 / 255.0));
-    }
+bool Ls3RenderObject::wirdGezeichnet(size_t i) const {
+  const auto& material = m_datei->materialien[i];
 
-#ifndef NDEBUG
-    std::cerr << "Drawing " << mesh_subset->children_Face.size() << " triangles" << std::endl;
-#endif
-    TRY(glDrawElements(GL_TRIANGLES, mesh_subset->children_Face.size() * 3, GL_UNSIGNED_SHORT, 0));
+  if (material.typLs3 == 16) { // Dummy
+    return false;
+  }
+  if (material.typLs3 == 17 && !m_lichter_schaltung.spitzenlichtVorne) {
+    return false;
+  }
+  if (material.typLs3 == 18 && !m_lichter_schaltung.schlusslichtVorne) {
+    return false;
+  }
+  if (material.typLs3 == 19 && !m_lichter_schaltung.spitzenlichtHinten) {
+    return false;
   }
+  if (material.typLs3 == 20 && !m_lichter_schaltung.schlusslichtHinten) {
+    return false;
+  }
+
+  auto texVoreinstellung = material.texVoreinstellung;
 
+  if (texVoreinstellung == 9 || texVoreinstellung == 10 || texVoreinstellung == 11) {
+    // Nachtfenster, Nebelwand
+    return false;
+  }
   return true;
 }
 
-glm::mat4 Ls3RenderObject::getTransform(size_t subset_index) const {
-  std::optional<AniPunkt> subset_animation;
-
-  for (const auto& a : m_ls3_datei.children_MeshAnimation) {
-    std::optional<float> t;
-    if (a->AniIndex >= 0 && static_cast<decltype(subset_index)>(a->AniIndex) == subset_index) {
-      for (const auto& def : m_ls3_datei.children_Animation) {
-        if (std::find_if(
-            std::begin(def->children_AniNrs),
-            std::end(def->children_AniNrs),
-            [&a](const auto& aniNrs) {
-              return aniNrs->AniNr == a->AniNr;
-            }) != std::end(def->children_AniNrs)) {
-          auto it = m_ani_positionen.find(def->AniID);
-          if (it != std::end(m_ani_positionen)) {
-            t = it->second;
-          }
-          subset_animation = interpoliere(a->children_AniPunkt, t.value_or(0.0f));
-          break;
-        }
-      }
-      if (subset_animation) {
-        break;
-      }
-    }
-  }
+void Ls3RenderObject::updateSubsetTransforms() {
+  const auto n_subsets = m_datei->materialien.size();
+  m_subset_transforms.assign(n_subsets, glm::mat4 { 1 });
+  m_subset_normals.assign(n_subsets, glm::mat4 { 1 });
 
-  glm::mat4 transform { 1 };
+  for (size_t i = 0; i < n_subsets; i++) {
+    const auto subset_animation = Ls3Datei::animation(m_datei->subset_animationen[i], m_spur_positionen);
+    if (!subset_animation) {
+      continue;
+    }
 
-  if (subset_animation) {
-    transform = glm::toMat4(glm::quat { subset_animation->q.w, subset_animation->q.x, subset_animation->q.y, subset_animation->q.z });
+    glm::mat4 transform = glm::toMat4(glm::quat { subset_animation->q.w, subset_animation->q.x, subset_animation->q.y, subset_animation->q.z });
     transform = glm::translate(glm::mat4 { 1 }, glm::vec3(subset_animation->p.x, subset_animation->p.y, subset_animation->p.z)) * transform;
+    m_subset_transforms[i] = transform;
+    m_subset_normals[i] = glm::transpose(glm::inverse(transform));
   }
-
-  return m_transform * transform;
 }
 
 }
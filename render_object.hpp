@@ -1,5 +1,10 @@
 #pragma once
 
+#include "./draw_list.hpp"
+#include "./mesh_buffer.hpp"
+#include "./software_renderer.hpp"
+#include "./texture_manager.hpp"
+
 #include <glm/glm.hpp>
 
 #define GLEW_STATIC
@@ -7,36 +12,73 @@
 #include <GLFW/glfw3.h>
 
 #include <cstddef>
+#include <memory>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-struct Landschaft;
-
 namespace ls3render {
 
+struct Ls3Datei;
 struct ShaderParameters;
 
+// Bildausschnitt, gegen den die Subsets vor dem Zeichnen geprueft werden.
+struct SichtVolumen {
+  // Von Welt- in Clip-Koordinaten des ganzen Bildes (Parallelprojektion, also affin)
+  glm::mat4 viewProj { 1 };
+  float bildBreite { 0 };
+  float bildHoehe { 0 };
+  // Subsets, deren projizierte Bounding Box in beiden Richtungen kleiner ist (in Pixeln), werden nicht gezeichnet.
+  // 0: nur Subsets ausserhalb des Bildes verwerfen
+  float mindestPixel { 0 };
+
+  bool operator==(const SichtVolumen& other) const {
+    return viewProj == other.viewProj && bildBreite == other.bildBreite && bildHoehe == other.bildHoehe
+      && mindestPixel == other.mindestPixel;
+  }
+  bool operator!=(const SichtVolumen& other) const { return !(*this == other); }
+};
+
 class RenderObject {
   public:
     virtual ~RenderObject() {}
-    virtual bool init() = 0;
+    // pixelProMeter: Ausgabeaufloesung, bestimmt die feinste hochgeladene Mip-Stufe der Texturen.
+    // vereinfachungPixel: zulaessige Abweichung der Geometrie im Bild, 0: Originalgeometrie (siehe VereinfachungsCache).
+    virtual bool init(TextureManager& textureManager, MeshBuffer& meshBuffer, float pixelProMeter, float vereinfachungPixel) = 0;
     virtual bool cleanup() = 0;
+    virtual bool isInitialized() const = 0;
+    // Laedt seit init() hinzugekommene Instanzen in den Grafikspeicher.
+    virtual bool updateInstances() = 0;
+    // Erweitert die Bounding Box um die seit dem letzten Aufruf hinzugekommenen Instanzen.
     virtual void updateBoundingBox(std::pair<glm::vec3, glm::vec3>* boundingBox) = 0;
-    virtual int getSubsetZOffsetSumme() = 0;
-    virtual bool render(const ShaderParameters& shaderParameters) const = 0;
+    // Bounding Box aller bisherigen Instanzen (leer, d.h. first > second, wenn es keine Geometrie gibt).
+    virtual std::pair<glm::vec3, glm::vec3> getBoundingBox() const = 0;
+    virtual int getSubsetZOffsetSumme() const = 0;
+    // Bestimmt die in sicht sichtbaren Subsets des (initialisierten) Objekts; nur diese haengt appendDrawRecords an.
+    // Gibt die Anzahl der verworfenen Subsets zurueck.
+    virtual size_t cull(const SichtVolumen& sicht) = 0;
+    // Haengt die Draw-Aufrufe des (initialisierten) Objekts in Zeichenreihenfolge an.
+    virtual void appendDrawRecords(std::vector<DrawRecord>* records) const = 0;
+    // Haengt fuer den Software-Renderer die in sicht sichtbaren Subsets aller Instanzen in Zeichenreihenfolge an,
+    // mit denselben Zustaenden wie appendDrawRecords. Braucht kein init(), Parameter wie dort.
+    // Gibt wie cull() die Anzahl der verworfenen Subsets zurueck.
+    virtual size_t appendSoftwareDraws(const SichtVolumen& sicht, float pixelProMeter, float vereinfachungPixel, std::vector<SoftwareDraw>* draws) const = 0;
 };
 
 class GLRenderObject : public RenderObject {
   public:
     GLRenderObject();
     bool cleanup() override;
+    bool isInitialized() const override;
     ~GLRenderObject() override;
 
   protected:
-    GLuint m_vao;
-    std::vector<GLuint> m_vbos;
-    std::vector<GLuint> m_ebos;
-    std::vector<std::vector<GLuint>> m_texs;
+    // Lage der Subsets im gemeinsamen MeshBuffer der Szene
+    std::vector<DrawRange> m_ranges;
+    std::vector<std::vector<TextureHandle>> m_texs;
+    // Pro Instanz Modell- und Normalenmatrix, ueber einen Buffer-Texture an den Vertex-Shader uebergeben
+    GLuint m_instance_buffer;
+    GLuint m_instance_texture;
     bool m_initialized;
 
 };
@@ -46,24 +88,73 @@ struct LichterSchaltung {
   bool spitzenlichtHinten { false };
   bool schlusslichtVorne { false };
   bool schlusslichtHinten { false };
+
+  bool operator==(const LichterSchaltung& other) const {
+    return spitzenlichtVorne == other.spitzenlichtVorne && spitzenlichtHinten == other.spitzenlichtHinten
+      && schlusslichtVorne == other.schlusslichtVorne && schlusslichtHinten == other.schlusslichtHinten;
+  }
 };
 
+// Eine LS3-Datei, die an einer oder mehreren Stellen der Szene mit demselben Animations-
+// und Lichtzustand vorkommt. Alle Instanzen werden mit einem instanzierten Draw-Call pro Subset gezeichnet.
 class Ls3RenderObject : public GLRenderObject {
   public:
-    Ls3RenderObject(const Landschaft& ls3_datei, const std::unordered_map<int, float>& ani_positionen, const LichterSchaltung& lichterSchaltung);
-    bool init() override;
-    void setTransform(glm::mat4 transform);
+    Ls3RenderObject(std::shared_ptr<const Ls3Datei> ls3_datei, const std::unordered_map<int, float>& ani_positionen, const LichterSchaltung& lichterSchaltung);
+    bool init(TextureManager& textureManager, MeshBuffer& meshBuffer, float pixelProMeter, float vereinfachungPixel) override;
+    bool updateInstances() override;
+    void addInstance(const glm::mat4& transform);
+    // Ob eine weitere Instanz mit diesem Zustand zu diesem Objekt hinzugefuegt werden kann.
+    bool canInstance(const Ls3Datei& ls3_datei, const std::vector<float>& spur_positionen, const LichterSchaltung& lichterSchaltung) const;
+    // Bounding Box einer Instanz mit dieser Transformation.
+    std::pair<glm::vec3, glm::vec3> instanceBoundingBox(const glm::mat4& transform) const;
     void updateBoundingBox(std::pair<glm::vec3, glm::vec3>* boundingBox) override;
-    int getSubsetZOffsetSumme() override;
-    bool render(const ShaderParameters& shaderParameters) const override;
+    // Ob es Instanzen gibt, die updateBoundingBox() noch nicht beruecksichtigt hat.
+    bool hasNewInstances() const { return m_instances_in_bounding_box < m_instances.size(); }
+    std::pair<glm::vec3, glm::vec3> getBoundingBox() const override;
+    int getSubsetZOffsetSumme() const override;
+    size_t cull(const SichtVolumen& sicht) override;
+    void appendDrawRecords(std::vector<DrawRecord>* records) const override;
+    size_t appendSoftwareDraws(const SichtVolumen& sicht, float pixelProMeter, float vereinfachungPixel, std::vector<SoftwareDraw>* draws) const override;
 
   private:
-    const Landschaft& m_ls3_datei;
-    glm::mat4 m_transform { 1 };
-    const std::unordered_map<int, float> m_ani_positionen;
+    // Aufeinanderfolgende Subsets mit identischem Zustand, die mit einem Multi-Draw-Aufruf gezeichnet werden.
+    struct DrawBatch {
+      size_t subset;  // erstes Subset, bestimmt den Zustand
+      GLsizei count() const { return static_cast<GLsizei>(counts.size()); }
+      std::vector<size_t> subsets;
+      std::vector<GLsizei> counts;
+      std::vector<const void*> indexOffsets;
+      std::vector<GLint> baseVertices;
+    };
+
+    const std::shared_ptr<const Ls3Datei> m_datei;
+    std::vector<DrawBatch> m_batches;
+    // m_batches ohne die beim letzten cull() verworfenen Subsets
+    std::vector<DrawBatch> m_sichtbare_batches;
+    std::vector<glm::mat4> m_instances;
+    size_t m_uploaded_instances { 0 };
+    size_t m_instances_in_bounding_box { 0 };
+    // Bounding Box aller Instanzen, wird in addInstance() erweitert
+    std::pair<glm::vec3, glm::vec3> m_bounding_box;
+    // Animationsposition je Spur der Datei (siehe Ls3Datei::ani_ids)
+    std::vector<float> m_spur_positionen;
     const LichterSchaltung m_lichter_schaltung;
+    const int m_z_offset_summe;
+
+    // Transformation des Subsets relativ zur Instanz (Subset-Animation) und zugehoerige Normalenmatrix.
+    // Werden bei Aenderung der Animationspositionen neu berechnet.
+    std::vector<glm::mat4> m_subset_transforms;
+    std::vector<glm::mat4> m_subset_normals;
 
-    glm::mat4 getTransform(size_t subset_index) const;
+    void updateSubsetTransforms();
+    // Pixel pro Einheit der Datei bei der groessten Skalierung aller Instanzen
+    float pixelProEinheit(float pixelProMeter) const;
+    // Ob das Subset in mindestens einer Instanz in sicht sichtbar ist.
+    bool istSichtbar(const SichtVolumen& sicht, size_t i) const;
+    // Ob das Subset bei diesem Lichtzustand gezeichnet wird (Subset-Typ, TexVoreinstellung).
+    bool wirdGezeichnet(size_t i) const;
+    // Ob zwei Subsets mit denselben Uniforms, Texturen und Render-States gezeichnet werden.
+    bool hasSameState(size_t lhs, size_t rhs) const;
 };
 
 }
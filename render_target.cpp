@@ -0,0 +1,118 @@
+#include "./render_target.hpp"
+
+#include "./macros.hpp"
+
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+namespace ls3render {
+
+RenderTarget::RenderTarget(int width, int height, int samples) : m_width(width), m_height(height), m_samples(samples) {}
+
+RenderTarget::~RenderTarget() {
+  glDeleteFramebuffers(1, &m_framebuffer);
+  glDeleteRenderbuffers(1, &m_color_renderbuffer);
+  glDeleteRenderbuffers(1, &m_depth_renderbuffer);
+  glDeleteFramebuffers(1, &m_framebuffer_multisample);
+  glDeleteRenderbuffers(1, &m_color_renderbuffer_multisample);
+  glDeleteRenderbuffers(1, &m_depth_renderbuffer_multisample);
+}
+
+bool RenderTarget::init() {
+  // Create and bind framebuffer & renderbuffer
+  TRY(glGenFramebuffers(1, &m_framebuffer));
+  TRY(glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer));
+
+  TRY(glGenRenderbuffers(1, &m_color_renderbuffer));
+  TRY(glBindRenderbuffer(GL_RENDERBUFFER, m_color_renderbuffer));
+
+  TRY(glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, m_width, m_height));
+  TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));  // don't know why that is necessary
+
+  TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_renderbuffer));
+
+  if (m_samples == 0) {
+    // Ohne Multisampling wird direkt in diesen Framebuffer gezeichnet.
+    TRY(glGenRenderbuffers(1, &m_depth_renderbuffer));
+    TRY(glBindRenderbuffer(GL_RENDERBUFFER, m_depth_renderbuffer));
+
+    TRY(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, m_width, m_height));
+    TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+
+    TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_renderbuffer));
+  }
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "Non-multisampling framebuffer is not complete" << std::endl;
+    return false;
+  }
+
+  if (m_samples == 0) {
+    return true;
+  }
+
+  // Create and bind multisampling framebuffer & renderbuffers
+  TRY(glGenFramebuffers(1, &m_framebuffer_multisample));
+  TRY(glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer_multisample));
+
+  TRY(glGenRenderbuffers(1, &m_color_renderbuffer_multisample));
+  TRY(glBindRenderbuffer(GL_RENDERBUFFER, m_color_renderbuffer_multisample));
+
+  TRY(glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_RGBA, m_width, m_height));
+  TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));  // don't know why that is necessary
+
+  TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_renderbuffer_multisample));
+
+  TRY(glGenRenderbuffers(1, &m_depth_renderbuffer_multisample));
+  TRY(glBindRenderbuffer(GL_RENDERBUFFER, m_depth_renderbuffer_multisample));
+
+  TRY(glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_DEPTH_COMPONENT, m_width, m_height));
+  TRY(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+
+  TRY(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_renderbuffer_multisample));
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "Multisampling framebuffer is not complete" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool RenderTarget::resolve() const {
+  if (m_samples == 0) {
+    return true;
+  }
+
+  TRY(glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer_multisample));
+  TRY(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer));
+  TRY(glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_LINEAR));
+  return true;
+}
+
+RenderTarget* RenderTargetPool::get(int width, int height, int samples) {
+  for (auto it = std::begin(m_targets); it != std::end(m_targets); ++it) {
+    if ((*it)->matches(width, height, samples)) {
+      m_targets.splice(std::begin(m_targets), m_targets, it);
+      return m_targets.front().get();
+    }
+  }
+
+  auto target = std::make_unique<RenderTarget>(width, height, samples);
+  if (!target->init()) {
+    return nullptr;
+  }
+
+  m_targets.push_front(std::move(target));
+  while (m_targets.size() > m_maxTargets) {
+    m_targets.pop_back();
+  }
+  return m_targets.front().get();
+}
+
+void RenderTargetPool::clear() {
+  m_targets.clear();
+}
+
+}
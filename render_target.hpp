@@ -0,0 +1,66 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <list>
+#include <memory>
+
+namespace ls3render {
+
+// Framebuffer mit Farb- und Tiefenpuffer einer bestimmten Groesse.
+// Bei Multisampling wird in einen zusaetzlichen Multisampling-Framebuffer gezeichnet,
+// der vor dem Auslesen in den normalen Framebuffer aufgeloest wird.
+class RenderTarget {
+ public:
+  RenderTarget(int width, int height, int samples);
+  ~RenderTarget();
+  RenderTarget(const RenderTarget&) = delete;
+  RenderTarget& operator=(const RenderTarget&) = delete;
+
+  bool init();
+
+  // Framebuffer, in den gezeichnet wird.
+  GLuint drawFramebuffer() const { return m_samples > 0 ? m_framebuffer_multisample : m_framebuffer; }
+  // Framebuffer, aus dem nach resolve() gelesen wird.
+  GLuint readFramebuffer() const { return m_framebuffer; }
+
+  // Loest das Multisampling-Ergebnis in den normalen Framebuffer auf. Ohne Multisampling nichts zu tun.
+  bool resolve() const;
+
+  bool matches(int width, int height, int samples) const {
+    return m_width == width && m_height == height && m_samples == samples;
+  }
+
+ private:
+  int m_width;
+  int m_height;
+  int m_samples;
+
+  GLuint m_framebuffer { 0 };
+  GLuint m_color_renderbuffer { 0 };
+  GLuint m_depth_renderbuffer { 0 };  // nur ohne Multisampling
+
+  GLuint m_framebuffer_multisample { 0 };
+  GLuint m_color_renderbuffer_multisample { 0 };
+  GLuint m_depth_renderbuffer_multisample { 0 };
+};
+
+// Haelt die zuletzt verwendeten Render-Targets vor, damit aufeinanderfolgende Render-Vorgaenge
+// mit gleicher Bildgroesse keine Frame- und Renderbuffer neu anlegen muessen.
+class RenderTargetPool {
+ public:
+  explicit RenderTargetPool(size_t maxTargets = 2) : m_maxTargets(maxTargets) {}
+
+  // Liefert ein Render-Target der angegebenen Groesse. nullptr bei Fehlschlag.
+  RenderTarget* get(int width, int height, int samples);
+
+  void clear();
+
+ private:
+  size_t m_maxTargets;
+  std::list<std::unique_ptr<RenderTarget>> m_targets;  // zuletzt verwendetes vorne
+};
+
+}
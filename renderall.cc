@@ -1,73 +1,269 @@
 #include "ls3render.h"
+#include "./image_writer.hpp"
 
 #include <algorithm>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
-int main(int argc, char** argv) {
-  ls3render_Init();
-  ls3render_SetMultisampling(4);
-#if 0
-  ls3render_SetPixelProMeter(20);
-#else
-  ls3render_SetPixelProMeter(40);
-  ls3render_SetAxonometrieParameter(3.141592/4.0f, 0.5f);
-#endif
+// Aufruf:
+//   renderall [Optionen] datei.ls3 [datei.ls3 ...]
+//     Rendert jede Datei als einzelnes Fahrzeug nach <datei mit _ statt />.tga
+//   renderall [Optionen] -j auftraege.txt
+//     Rendert alle Zuege aus der Auftragsdatei in einem Durchlauf.
+//
+// Optionen:
+//   -p  Einzeldateien als PNG statt TGA ausgeben (nur mit zlib)
+//   -u  TGA unkomprimiert statt lauflaengenkodiert schreiben
+//
+// Das Ausgabeformat ergibt sich aus der Dateiendung (.png, sonst TGA). Die Bilder werden in Hintergrund-Threads
+// ohne Kopie direkt aus dem Auslesepuffer kodiert, waehrend schon die naechsten Zuege gezeichnet werden.
+//
+// Auftragsdatei: Felder durch Tabulatoren getrennt, Leerzeilen und Zeilen mit # werden ignoriert.
+// Jeder Zug beginnt mit einer zug-Zeile, darauf folgen seine Fahrzeuge, auf jedes Fahrzeug seine Beladungen.
+//   zug       Ausgabedatei [PixelProMeter [Multisampling [Winkel [Skalierung]]]]
+//   fahrzeug  Datei OffsetX Fahrzeuglaenge Gedreht [StromabnehmerHoehe SA1 SA2 SA3 SA4 [SpitzeV SpitzeH SchlussV SchlussH]]
+//   beladung  Datei OffsetX OffsetY OffsetZ PhiX PhiY PhiZ
 
-  std::vector<uint8_t> buf;
-  for (int i = 1; i < argc; i++) {
-    std::string dateiname(argv[i]);
-    std::cerr << "Rendering " << i << "/" << (argc-1) << ": " << dateiname << std::endl;
-    ls3render_AddFahrzeug(dateiname.c_str(), 0, 0, false,
-        // Stromabnehmer
-        0, false, false, false, false,
-        // Lichter
-        false, false, false, false
-    );
-
-    int bufsize = ls3render_GetAusgabepufferGroesse();
-
-    if (bufsize == 0) {
-      std::cerr << "Nothing to render for " << dateiname << "!\n";
+namespace {
+
+constexpr int kPixelProMeter = 40;
+constexpr int kMultisampling = 4;
+constexpr float kAxonometrieWinkel = 3.141592/4.0f;
+constexpr float kAxonometrieSkalierung = 0.5f;
+// Hoechstens so viele Bytes an Bildern warten auf das Kodieren oder werden gerade kodiert
+constexpr size_t kAusgabeBytes = size_t(1) << 30;
+
+struct Fahrzeug {
+  std::string dateiname;
+  ls3render_Fahrzeug daten {};
+  std::vector<std::string> beladungDateinamen;
+  std::vector<ls3render_Beladung> beladungen;
+};
+
+struct Zug {
+  std::string ausgabe;
+  ls3render_Zug daten {};
+  std::vector<Fahrzeug> fahrzeuge;
+  std::vector<ls3render_Fahrzeug> fahrzeugDaten;
+};
+
+Zug neuerZug(const std::string& ausgabe) {
+  Zug result;
+  result.ausgabe = ausgabe;
+  result.daten.PixelProMeter = kPixelProMeter;
+  result.daten.Multisampling = kMultisampling;
+  result.daten.AxonometrieWinkel = kAxonometrieWinkel;
+  result.daten.AxonometrieSkalierung = kAxonometrieSkalierung;
+  return result;
+}
+
+std::vector<std::string> teile(const std::string& zeile) {
+  std::vector<std::string> result;
+  std::istringstream stream(zeile);
+  std::string feld;
+  while (std::getline(stream, feld, '\t')) {
+    result.push_back(feld);
+  }
+  return result;
+}
+
+float feldFloat(const std::vector<std::string>& felder, size_t i, float standard) {
+  return i < felder.size() ? std::strtof(felder[i].c_str(), nullptr) : standard;
+}
+
+int feldInt(const std::vector<std::string>& felder, size_t i, int standard) {
+  return i < felder.size() ? std::atoi(felder[i].c_str()) : standard;
+}
+
+bool leseAuftragsdatei(const char* pfad, std::vector<Zug>* zuege) {
+  std::ifstream datei(pfad);
+  if (!datei) {
+    std::cerr << "Error opening " << pfad << "\n";
+    return false;
+  }
+
+  std::string zeile;
+  for (size_t nr = 1; std::getline(datei, zeile); nr++) {
+    if (!zeile.empty() && zeile.back() == '\r') {
+      zeile.pop_back();
+    }
+    if (zeile.empty() || zeile[0] == '#') {
       continue;
     }
-    buf.resize(bufsize);
+    const auto felder = teile(zeile);
 
-    if (ls3render_Render(buf.data()) == 0) {
-      std::cerr << "Failed to render " << dateiname << "!\n";
-      continue;
+    if (felder[0] == "zug" && felder.size() >= 2) {
+      zuege->push_back(neuerZug(felder[1]));
+      auto& zug = zuege->back().daten;
+      zug.PixelProMeter = feldInt(felder, 2, zug.PixelProMeter);
+      zug.Multisampling = feldInt(felder, 3, zug.Multisampling);
+      zug.AxonometrieWinkel = feldFloat(felder, 4, zug.AxonometrieWinkel);
+      zug.AxonometrieSkalierung = feldFloat(felder, 5, zug.AxonometrieSkalierung);
+    } else if (felder[0] == "fahrzeug" && felder.size() >= 5 && !zuege->empty()) {
+      Fahrzeug fahrzeug;
+      fahrzeug.dateiname = felder[1];
+      auto& fz = fahrzeug.daten;
+      fz.OffsetX = feldFloat(felder, 2, 0);
+      fz.Fahrzeuglaenge = feldFloat(felder, 3, 0);
+      fz.Gedreht = feldInt(felder, 4, 0);
+      fz.StromabnehmerHoehe = feldFloat(felder, 5, 0);
+      fz.Stromabnehmer1Oben = feldInt(felder, 6, 0);
+      fz.Stromabnehmer2Oben = feldInt(felder, 7, 0);
+      fz.Stromabnehmer3Oben = feldInt(felder, 8, 0);
+      fz.Stromabnehmer4Oben = feldInt(felder, 9, 0);
+      fz.SpitzenlichtVorneAn = feldInt(felder, 10, 0);
+      fz.SpitzenlichtHintenAn = feldInt(felder, 11, 0);
+      fz.SchlusslichtVorneAn = feldInt(felder, 12, 0);
+      fz.SchlusslichtHintenAn = feldInt(felder, 13, 0);
+      zuege->back().fahrzeuge.push_back(std::move(fahrzeug));
+    } else if (felder[0] == "beladung" && felder.size() >= 8 && !zuege->empty() && !zuege->back().fahrzeuge.empty()) {
+      auto& fahrzeug = zuege->back().fahrzeuge.back();
+      fahrzeug.beladungDateinamen.push_back(felder[1]);
+      fahrzeug.beladungen.push_back(ls3render_Beladung {
+        nullptr,
+        feldFloat(felder, 2, 0), feldFloat(felder, 3, 0), feldFloat(felder, 4, 0),
+        feldFloat(felder, 5, 0), feldFloat(felder, 6, 0), feldFloat(felder, 7, 0),
+      });
+    } else {
+      std::cerr << pfad << ":" << nr << ": invalid line\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Setzt die Zeiger in den C-Strukturen, nachdem alle Vektoren ihre endgueltige Groesse haben.
+void verknuepfe(std::vector<Zug>* zuege, std::vector<ls3render_Zug>* result) {
+  for (auto& zug : *zuege) {
+    zug.fahrzeugDaten.clear();
+    for (auto& fahrzeug : zug.fahrzeuge) {
+      for (size_t i = 0; i < fahrzeug.beladungen.size(); i++) {
+        fahrzeug.beladungen[i].Dateiname = fahrzeug.beladungDateinamen[i].c_str();
+      }
+      fahrzeug.daten.Dateiname = fahrzeug.dateiname.c_str();
+      fahrzeug.daten.Beladungen = fahrzeug.beladungen.data();
+      fahrzeug.daten.AnzahlBeladungen = static_cast<int>(fahrzeug.beladungen.size());
+      zug.fahrzeugDaten.push_back(fahrzeug.daten);
+    }
+    zug.daten.Fahrzeuge = zug.fahrzeugDaten.data();
+    zug.daten.AnzahlFahrzeuge = static_cast<int>(zug.fahrzeugDaten.size());
+    result->push_back(zug.daten);
+  }
+}
+
+struct Ausgabe {
+  const std::vector<Zug>* zuege;
+  bool rle { true };
+  ls3render::BildAusgabe* hintergrund { nullptr };
+  // Meldungen kommen aus dem Render-Thread und aus den Schreib-Threads
+  std::mutex meldungen;
+};
+
+void meldeGeschrieben(Ausgabe* ausgabe, const std::string& pfad, bool ok) {
+  if (ok) {
+    std::lock_guard<std::mutex> lock(ausgabe->meldungen);
+    std::cout << "Wrote " << pfad << "\n";
+  }
+}
+
+void schreibeBild(void* benutzerdaten, int index, int erfolg, const void* bild, int breite, int hoehe, int verworfeneSubsets) {
+  auto& ausgabe = *static_cast<Ausgabe*>(benutzerdaten);
+  const std::string& pfad = (*ausgabe.zuege)[index].ausgabe;
+  {
+    std::lock_guard<std::mutex> lock(ausgabe.meldungen);
+    std::cerr << "Rendered " << (index + 1) << "/" << ausgabe.zuege->size() << ": " << pfad;
+    if (verworfeneSubsets > 0) {
+      std::cerr << " (" << verworfeneSubsets << " subsets culled)";
     }
+    std::cerr << std::endl;
 
-    short TGAhead[] = {
-      0,  // image id length 0, color map type 0
-      2,  // data type code 2 [uncompressed RGB], color map origin 0 (first half)
-      0,  // color map origin 0 (second half), color map length 0 (first half)
-      0,  // color map length 0 (second half), color map depth 0
-      0,  // x origin
-      0,  // y origin
-      static_cast<short>(ls3render_GetBildbreite()),  // width
-      static_cast<short>(ls3render_GetBildhoehe()), // height
-      32  // bits per pixel 32, image descriptor 0
-    };
+    if (!erfolg) {
+      std::cerr << "Failed to render " << pfad << "!\n";
+      return;
+    }
+  }
 
+  const auto format = ls3render::formatAusDateiname(pfad, ausgabe.rle);
+  const int kennung = ls3render_BehalteBild();
+  if (kennung >= 0) {
+    ausgabe.hintergrund->schreibe(pfad, format, bild, breite, hoehe, [&ausgabe, &pfad, kennung](bool ok) {
+      meldeGeschrieben(&ausgabe, pfad, ok);
+      ls3render_GibBildFrei(kennung);
+    });
+  } else {
+    // Das Bild ist nur waehrend des Callbacks gueltig
+    const auto* daten = static_cast<const unsigned char*>(bild);
+    ausgabe.hintergrund->schreibe(pfad, format,
+        std::vector<unsigned char>(daten, daten + static_cast<size_t>(breite) * hoehe * 4), breite, hoehe,
+        [&ausgabe, &pfad](bool ok) { meldeGeschrieben(&ausgabe, pfad, ok); });
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<Zug> zuege;
+  bool png = false;
+  bool rle = true;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    if (std::strcmp(argv[i], "-p") == 0) {
+      png = true;
+    } else if (std::strcmp(argv[i], "-u") == 0) {
+      rle = false;
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      if (!leseAuftragsdatei(argv[++i], &zuege)) {
+        return 1;
+      }
+    } else {
+      std::cerr << "Unknown option " << argv[i] << "\n";
+      return 1;
+    }
+  }
+  for (; i < argc; i++) {
+    std::string dateiname(argv[i]);
 #ifdef _WIN32
     std::replace(std::begin(dateiname), std::end(dateiname), '\\', '_');
     std::replace(std::begin(dateiname), std::end(dateiname), ':', '_');
 #else
     std::replace(std::begin(dateiname), std::end(dateiname), '/', '_');
 #endif
+    zuege.push_back(neuerZug(dateiname + (png ? ".png" : ".tga")));
+    Fahrzeug fahrzeug;
+    fahrzeug.dateiname = argv[i];
+    zuege.back().fahrzeuge.push_back(std::move(fahrzeug));
+  }
 
-    std::cout << "Writing to " << dateiname << ".tga\n";
-    FILE* out = fopen((dateiname + ".tga").c_str(),"wb");
-    fwrite(&TGAhead, sizeof(TGAhead), 1, out);
-    fwrite(&buf[0], bufsize, 1, out);
-    fclose(out);
+  std::vector<ls3render_Zug> zugDaten;
+  verknuepfe(&zuege, &zugDaten);
 
-    ls3render_Reset();
+  if (!ls3render_Init()) {
+    return 1;
   }
 
+  ls3render::BildAusgabe hintergrund(std::max(1u, std::thread::hardware_concurrency()), kAusgabeBytes);
+  Ausgabe ausgabe;
+  ausgabe.zuege = &zuege;
+  ausgabe.rle = rle;
+  ausgabe.hintergrund = &hintergrund;
+  const int erfolgreich = ls3render_RenderBatch(zugDaten.data(), static_cast<int>(zugDaten.size()), schreibeBild, &ausgabe);
+  const size_t fehler = hintergrund.warte();
   ls3render_Cleanup();
+
+  std::cerr << erfolgreich << "/" << zugDaten.size() << " rendered";
+  if (fehler > 0) {
+    std::cerr << ", " << fehler << " could not be written";
+  }
+  std::cerr << std::endl;
+  return erfolgreich == static_cast<int>(zugDaten.size()) && fehler == 0 ? 0 : 1;
 }
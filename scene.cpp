@@ -1,7 +1,10 @@
 #include "./scene.hpp"
 
+#include "./ls3_cache.hpp"
 #include "./render_object.hpp"
-#include "./utils.hpp"
+#include "./scene_cache.hpp"
+#include "./texture_manager.hpp"
+#include "./thread_pool.hpp"
 
 #include "zusi_parser/zusi_types.hpp"
 #include "zusi_parser/utils.hpp"
@@ -18,83 +21,181 @@
 #include <chrono>
 #include <cmath>
 #include <cstddef>
-#include <fstream>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace ls3render {
 
-bool Scene::LadeLandschaft(const zusixml::ZusiPfad& dateiname, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, const ls3render::LichterSchaltung& lichterSchaltung) {
-  const auto& dateinameOsPfad = dateiname.alsOsPfad();
-  std::unique_ptr<Zusi> zusi_datei = zusixml::tryParseFile(dateinameOsPfad);
-  if (!zusi_datei) {
-    std::cerr << "Error parsing " << dateinameOsPfad << "\n";
-    return false;
+namespace {
+
+bool ueberlappen(const std::pair<glm::vec3, glm::vec3>& a, const std::pair<glm::vec3, glm::vec3>& b) {
+  for (int achse = 0; achse < 3; achse++) {
+    if (a.first[achse] > b.second[achse] || b.first[achse] > a.second[achse]) {
+      return false;
+    }
   }
-  auto* ls3_datei = zusi_datei->Landschaft.get();
-  if (!ls3_datei) {
-    std::cerr << "Not an LS3 file: " << dateinameOsPfad << "\n";
-    return false;
+  return true;
+}
+
+// Liest den Verknuepfungsbaum einer Datei parallel in den Ls3Cache und die Texturen in den DdsCache.
+// Jede Datei wird nur einmal gelesen, egal wie oft sie verknuepft ist.
+class Vorlader {
+ public:
+  void lade(const zusixml::ZusiPfad& dateiname) {
+    if (!neu(dateiname.alsOsPfad())) {
+      return;
+    }
+    m_gruppe.starte([this, dateiname]() {
+      try {
+        ladeDatei(dateiname);
+      } catch (...) {
+        // Fehler meldet spaeter das Laden im Kontext-Thread
+      }
+    });
   }
 
-  if (!ls3_datei->lsb.Dateiname.empty()) {
-    std::string lsb_pfad = zusixml::ZusiPfad::vonZusiPfad(ls3_datei->lsb.Dateiname, dateiname).alsOsPfad();
+  void warte() { m_gruppe.warte(); }
 
-    std::ifstream lsb_stream;
-    lsb_stream.exceptions(std::ifstream::failbit | std::ifstream::eofbit | std::ifstream::badbit);
-    try {
-      lsb_stream.open(lsb_pfad, std::ios::in | std::ios::binary);
-    } catch (const std::ifstream::failure& e) {
-      std::cerr << lsb_pfad << ": open() failed: " << e.what();
-      return false;
+ private:
+  bool neu(const std::string& pfad) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_gesehen.insert(pfad).second;
+  }
+
+  void ladeDatei(const zusixml::ZusiPfad& dateiname) {
+    const std::shared_ptr<const Ls3Datei> datei = Ls3Cache::instance().lade(dateiname);
+    if (!datei) {
+      return;
     }
+    const auto& ls3_datei = datei->landschaft();
 
-    try {
-      for (const auto& mesh_subset : ls3_datei->children_SubSet) {
-        static_assert(sizeof(Vertex) == 40, "Wrong size of Vertex");
-        static_assert(offsetof(Vertex, p) == 0, "Wrong offset of Vertex::p");
-        static_assert(offsetof(Vertex, n) == 12, "Wrong offset of Vertex::n");
-        static_assert(offsetof(Vertex, U) == 24, "Wrong offset of Vertex::U");
-        static_assert(offsetof(Vertex, V) == 28, "Wrong offset of Vertex::V");
-        static_assert(offsetof(Vertex, U2) == 32, "Wrong offset of Vertex::U2");
-        static_assert(offsetof(Vertex, V2) == 36, "Wrong offset of Vertex::V2");
-        mesh_subset->children_Vertex.resize(mesh_subset->MeshV);
-        lsb_stream.read(reinterpret_cast<char*>(mesh_subset->children_Vertex.data()), mesh_subset->children_Vertex.size() * sizeof(Vertex));
-
-        static_assert(sizeof(Face) == 6, "Wrong size of Face");
-        assert(mesh_subset->MeshI % 3 == 0);
-        mesh_subset->children_Face.resize(mesh_subset->MeshI / 3);
-        lsb_stream.read(reinterpret_cast<char*>(mesh_subset->children_Face.data()), mesh_subset->children_Face.size() * sizeof(Face));
+    // Dieselben Bedingungen wie in Scene::LoeseAuf
+    for (const auto& verkn : ls3_datei.children_Verknuepfte) {
+      if (verkn->SichtbarAb > 1 || verkn->Datei.Dateiname.empty()) {
+        continue;
       }
-    } catch (const std::ifstream::failure& e) {
-      std::cerr << lsb_pfad << ": read() failed: " << e.what();
-      return false;
+      lade(zusixml::ZusiPfad::vonZusiPfad(verkn->Datei.Dateiname, dateiname));
     }
 
-    lsb_stream.exceptions(std::ios_base::iostate());
-    lsb_stream.peek();
-    assert(lsb_stream.eof());
+    for (const auto& subset : ls3_datei.children_SubSet) {
+      for (const auto& textur : subset->children_Textur) {
+        const std::string& pfad = textur->Datei.Dateiname;
+        if (pfad.empty() || !neu(pfad)) {
+          continue;
+        }
+        m_gruppe.starte([pfad]() {
+          DdsCache::instance().lade(pfad);
+        });
+      }
+    }
   }
 
-  for (auto& mesh_subset : ls3_datei->children_SubSet) {
-    for (auto& textur : mesh_subset->children_Textur) {
-      if (!textur->Datei.Dateiname.empty()) {
-        textur->Datei.Dateiname = zusixml::ZusiPfad::vonZusiPfad(textur->Datei.Dateiname, dateiname).alsOsPfad();
+  AufgabenGruppe m_gruppe;
+  std::mutex m_mutex;
+  std::unordered_set<std::string> m_gesehen;
+};
+
+}  // namespace
+
+bool Scene::LadeLandschaft(const zusixml::ZusiPfad& dateiname, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, const ls3render::LichterSchaltung& lichterSchaltung) {
+  const SzenenCache* szenen_cache = SzenenCache::instance();
+  AufgeloesteLandschaft landschaft;
+  if (szenen_cache && szenen_cache->lade(dateiname.alsOsPfad(), ani_positionen, &landschaft)) {
+    // Geometrie liegt im gemappten Cache, nur noch die Texturen parallel lesen
+    AufgabenGruppe gruppe;
+    std::unordered_set<std::string> gesehen;
+    for (const auto& platzierung : landschaft.platzierungen) {
+      for (const auto& material : platzierung.datei->materialien) {
+        for (const auto& textur : material.texturen) {
+          if (!textur.empty() && gesehen.insert(textur).second) {
+            gruppe.starte([textur]() {
+              DdsCache::instance().lade(textur);
+            });
+          }
+        }
       }
     }
+    gruppe.warte();
+  } else {
+    {
+      Vorlader vorlader;
+      vorlader.lade(dateiname);
+      vorlader.warte();
+    }
+    // Alle Dateien liegen jetzt im Cache; die Reihenfolge der Render-Objekte ergibt sich wie bisher aus der Rekursion.
+    if (!LoeseAuf(dateiname, glm::mat4 { 1 }, ani_positionen, &landschaft)) {
+      return false;
+    }
+    if (szenen_cache) {
+      szenen_cache->speichere(dateiname.alsOsPfad(), ani_positionen, landschaft);
+    }
   }
 
-  m_Ls3Dateien.push_back(std::move(zusi_datei));  // keep for later
+  for (const auto& platzierung : landschaft.platzierungen) {
+    FuegeHinzu(platzierung.datei, transform * platzierung.transform, ani_positionen, lichterSchaltung);
+  }
+  return true;
+}
 
-  auto render_object = std::make_unique<Ls3RenderObject>(*ls3_datei, ani_positionen, lichterSchaltung);
-  render_object->setTransform(transform);
-  m_RenderObjects.push_back(std::move(render_object));
+void Scene::FuegeHinzu(const std::shared_ptr<const Ls3Datei>& datei, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, const ls3render::LichterSchaltung& lichterSchaltung) {
+  const std::vector<float> spur_positionen = datei->spurPositionen(ani_positionen);
+
+  // Weitere Vorkommen derselben Datei mit gleichem Animations- und Lichtzustand werden
+  // als zusaetzliche Instanz eines frueheren Vorkommens gezeichnet (an dessen Position in der Zeichenreihenfolge).
+  // Das nur, wenn sich dadurch die Reihenfolge sich ueberlagernder Flaechen nicht aendert (Alpha-Blending, aber auch
+  // koplanare Flaechen unter GL_LESS): Die neue Instanz darf weder die bisherigen Instanzen noch die seitdem
+  // hinzugekommenen Objekte mit derselben Z-Offset-Summe ueberlappen, die als eigenes Objekt vor ihr gezeichnet wuerden.
+  auto& kandidaten = m_RenderObjectsByFile[datei.get()];
+  const auto it = std::find_if(std::begin(kandidaten), std::end(kandidaten), [&](const auto* ro) {
+    if (!ro->canInstance(*datei, spur_positionen, lichterSchaltung)) {
+      return false;
+    }
+    const auto box = ro->instanceBoundingBox(transform);
+    if (ueberlappen(box, ro->getBoundingBox())) {
+      return false;
+    }
+    // m_RenderObjects steht seit dem letzten Sortieren in Zeichenreihenfolge, neue Objekte folgen am Ende
+    for (auto dazwischen = m_RenderObjects.rbegin(); dazwischen->get() != ro; ++dazwischen) {
+      if ((*dazwischen)->getSubsetZOffsetSumme() == ro->getSubsetZOffsetSumme() && ueberlappen(box, (*dazwischen)->getBoundingBox())) {
+        return false;
+      }
+    }
+    return true;
+  });
+  Ls3RenderObject* ziel;
+  if (it != std::end(kandidaten)) {
+    ziel = *it;
+  } else {
+    m_Ls3Dateien.push_back(datei);  // keep for later
+
+    auto render_object = std::make_unique<Ls3RenderObject>(datei, ani_positionen, lichterSchaltung);
+    ziel = render_object.get();
+    kandidaten.push_back(ziel);
+    m_RenderObjects.push_back(std::move(render_object));
+  }
+  if (!ziel->hasNewInstances()) {
+    m_NeueInstanzen.push_back(ziel);
+  }
+  ziel->addInstance(transform);
+  m_Dirty = true;
+}
+
+bool Scene::LoeseAuf(const zusixml::ZusiPfad& dateiname, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, AufgeloesteLandschaft* result) {
+  std::shared_ptr<const Ls3Datei> datei = Ls3Cache::instance().lade(dateiname);
+  if (!datei) {
+    return false;
+  }
+  const auto* ls3_datei = &datei->landschaft();
+  const std::vector<float> spur_positionen = datei->spurPositionen(ani_positionen);
+  result->platzierungen.push_back(Platzierung { datei, transform });
 
   for (size_t counter = 0, len = ls3_datei->children_Verknuepfte.size(); counter < len; counter++) {
     // Zusi zeichnet verknuepfte Dateien mit dem gleichen Abstand zur Kamera
@@ -113,32 +214,7 @@ bool Scene::LadeLandschaft(const zusixml::ZusiPfad& dateiname, const glm::mat4&
     if (verkn->Datei.Dateiname.empty()) {
       continue;
     }
-    std::optional<AniPunkt> verkn_animation;
-
-    for (const auto& v : ls3_datei->children_VerknAnimation) {
-      std::optional<float> t;
-      if (v->AniIndex >= 0 && static_cast<decltype(i)>(v->AniIndex) == i) {
-        for (const auto& def : ls3_datei->children_Animation) {
-          if (std::find_if(
-              std::begin(def->children_AniNrs),
-              std::end(def->children_AniNrs),
-              [&v](const auto& aniNrs) {
-                return aniNrs->AniNr == v->AniNr;
-              }) != std::end(def->children_AniNrs)) {
-            auto it = ani_positionen.find(def->AniID);
-            if (it != std::end(ani_positionen)) {
-              t = it->second;
-            } else {
-            }
-            verkn_animation = interpoliere(v->children_AniPunkt, t.value_or(0.0f));
-            break;
-          }
-        }
-        if (verkn_animation) {
-          break;
-        }
-      }
-    }
+    const std::optional<AniPunkt> verkn_animation = Ls3Datei::animation(datei->verkn_animationen[i], spur_positionen);
 
     glm::mat4 rot_verkn = glm::eulerAngleZYX(verkn->phi.z, verkn->phi.y, verkn->phi.x);
     glm::mat4 transform_verkn = rot_verkn;
@@ -158,47 +234,129 @@ bool Scene::LadeLandschaft(const zusixml::ZusiPfad& dateiname, const glm::mat4&
       transform_verkn = translate_verkn_animation * transform_verkn;
     }
 
-    this->LadeLandschaft(verkn_dateiname, transform * transform_verkn, ani_positionen, lichterSchaltung);
+    if (!this->LoeseAuf(verkn_dateiname, transform * transform_verkn, ani_positionen, result)) {
+      result->vollstaendig = false;
+    }
   }
 
   return true;
 }
 
 void Scene::UpdateBoundingBox(std::pair<glm::vec3, glm::vec3>* bbox) {
-  // Update bounding box
-  for (const auto& ro : m_RenderObjects) {
+  // Nur die Objekte, die seit dem letzten Aufruf Instanzen bekommen haben
+  for (auto* ro : m_NeueInstanzen) {
     ro->updateBoundingBox(bbox);
   }
+  m_NeueInstanzen.clear();
 }
 
-bool Scene::LoadIntoGraphicsCardMemory() {
+bool Scene::LoadIntoGraphicsCardMemory(TextureManager& textureManager, const ShaderParameters& shaderParameters, float pixelProMeter, float vereinfachungPixel, const SichtVolumen& sicht) {
+  if (pixelProMeter > m_TexturPixelProMeter || vereinfachungPixel != m_VereinfachungPixel) {
+    // Originalgeometrie bleibt im MeshBuffer, nur Texturen, Instanzdaten und ggf. vereinfachte Geometrie werden neu geladen
+    for (const auto& ro : m_RenderObjects) {
+      if (ro->isInitialized()) {
+        ro->cleanup();
+        m_Dirty = true;
+      }
+    }
+    m_TexturPixelProMeter = std::max(m_TexturPixelProMeter, pixelProMeter);
+    m_VereinfachungPixel = vereinfachungPixel;
+  }
+
+  if (!m_Dirty && m_Sicht == sicht) {
+    return true;
+  }
+
+  if (!m_MeshBuffer) {
+    m_MeshBuffer = std::make_unique<MeshBuffer>();
+    if (!m_MeshBuffer->init(shaderParameters)) {
+      std::cerr << "Error initializing mesh buffer\n";
+      m_MeshBuffer.reset();
+      return false;
+    }
+  }
+
+  SortiereNachZOffset();
+
+  for (const auto& ro : m_RenderObjects) {
+    if (ro->isInitialized()) {
+      if (!ro->updateInstances()) {
+        std::cerr << "Error updating render object instances\n";
+        return false;
+      }
+      continue;
+    }
+    if (!ro->init(textureManager, *m_MeshBuffer, m_TexturPixelProMeter, m_VereinfachungPixel)) {
+      std::cerr << "Error initializing render object\n";
+      ro->cleanup();
+      return false;
+    }
+  }
+
+  if (!m_MeshBuffer->upload()) {
+    std::cerr << "Error uploading mesh data\n";
+    return false;
+  }
+
+  if (!m_DrawList) {
+    m_DrawList = std::make_unique<DrawList>();
+  }
+  m_DrawList->clear();
+  m_VerworfeneSubsets = 0;
+  for (const auto& ro : m_RenderObjects) {
+    m_VerworfeneSubsets += ro->cull(sicht);
+    m_DrawList->add(*ro);
+  }
+  m_DrawList->sort();
+  if (!m_DrawList->upload(shaderParameters)) {
+    std::cerr << "Error uploading draw data\n";
+    return false;
+  }
+
+  m_Sicht = sicht;
+  m_Dirty = false;
+  return true;
+}
+
+void Scene::SortiereNachZOffset() {
   // Sortiere nach -zOffsetSumme, damit negativer Z-Offset => spaeter zeichnen
+  // (Die Z-Offset-Summe wird beim Erzeugen der Objekte einmalig berechnet.)
   std::stable_sort(std::begin(m_RenderObjects), std::end(m_RenderObjects), [](const auto& lhs, const auto& rhs) {
     // lhs < rhs
     return -lhs->getSubsetZOffsetSumme() < -rhs->getSubsetZOffsetSumme();
   });
+}
+
+void Scene::SammleSoftwareDraws(float pixelProMeter, float vereinfachungPixel, const SichtVolumen& sicht, std::vector<SoftwareDraw>* draws) {
+  SortiereNachZOffset();
 
+  m_VerworfeneSubsets = 0;
   for (const auto& ro : m_RenderObjects) {
-    if (!ro->init()) {
-      std::cerr << "Error initializing render object\n";
-      return false;
-    }
+    m_VerworfeneSubsets += ro->appendSoftwareDraws(sicht, pixelProMeter, vereinfachungPixel, draws);
   }
-  return true;
 }
 
 void Scene::Render(const ShaderParameters& shader_parameters) const {
-  for (const auto& render_object : m_RenderObjects) {
-    render_object->render(shader_parameters);
+  if (!m_MeshBuffer || !m_DrawList) {
+    return;
   }
+  m_MeshBuffer->bind();
+  m_DrawList->render(shader_parameters);
 }
 
 void Scene::FreeGraphicsCardMemory() {
   for (const auto& ro : m_RenderObjects) {
-    ro->cleanup();
+    if (ro->isInitialized()) {
+      ro->cleanup();
+    }
   }
+  m_DrawList.reset();
+  m_MeshBuffer.reset();
+  m_Dirty = !m_RenderObjects.empty();
+  m_TexturPixelProMeter = 0;
+  m_Sicht.reset();
 }
 
-Scene::Scene() : m_Ls3Dateien(), m_RenderObjects() {}
+Scene::Scene() : m_Ls3Dateien(), m_RenderObjects(), m_MeshBuffer(), m_DrawList(), m_RenderObjectsByFile(), m_NeueInstanzen(), m_Dirty(false), m_TexturPixelProMeter(0), m_VereinfachungPixel(0), m_Sicht(), m_VerworfeneSubsets(0) {}
 
 }
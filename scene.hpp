@@ -1,5 +1,7 @@
 #pragma once
 
+#include "./draw_list.hpp"
+#include "./mesh_buffer.hpp"
 #include "./render_object.hpp"
 
 #include "zusi_parser/zusi_types.hpp"
@@ -7,6 +9,7 @@
 #include <glm/glm.hpp>
 
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -17,21 +20,65 @@ namespace zusixml {
 
 namespace ls3render {
 
+struct AufgeloesteLandschaft;
+struct Ls3Datei;
 struct ShaderParameters;
+class TextureManager;
 
 class Scene {
  public:
   Scene();
 
+  // Laedt die Datei samt aller verknuepften Dateien. Die Dateien und ihre Texturen werden vorab
+  // parallel gelesen, die Render-Objekte danach in Zusi-Zeichenreihenfolge erzeugt.
+  // Ist der Szenencache aktiv (siehe SzenenCache), wird der aufgeloeste Verknuepfungsbaum von dort gemappt.
   bool LadeLandschaft(const zusixml::ZusiPfad& dateiname, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, const LichterSchaltung& lichterSchaltung);
+  // Erweitert bbox um die seit dem letzten Aufruf hinzugekommenen Objekte und Instanzen.
   void UpdateBoundingBox(std::pair<glm::vec3, glm::vec3>* bbox);
-  bool LoadIntoGraphicsCardMemory();
+  // Laedt alle noch nicht geladenen Render-Objekte in den Grafikspeicher.
+  // Bereits geladene Objekte bleiben bis zu FreeGraphicsCardMemory() oder zur Zerstoerung der Szene dort.
+  // Texturen werden nur bis zur fuer pixelProMeter noetigen Mip-Stufe hochgeladen; bei hoeherer Aufloesung
+  // als beim letzten Aufruf werden die Objekte mit feineren Texturen neu initialisiert.
+  // Mit vereinfachungPixel > 0 wird die Geometrie so weit vereinfacht, dass sie im Bild um hoechstens so viele Pixel abweicht;
+  // bei geaenderter Einstellung werden die Objekte ebenfalls neu initialisiert.
+  // Es werden nur die in sicht sichtbaren Subsets gezeichnet; bei geaendertem Ausschnitt wird neu geprueft.
+  bool LoadIntoGraphicsCardMemory(TextureManager& textureManager, const ShaderParameters& shaderParameters, float pixelProMeter, float vereinfachungPixel, const SichtVolumen& sicht);
   void Render(const ShaderParameters& shader_parameters) const;
+  // Sammelt die in sicht sichtbaren Subsets fuer den Software-Renderer, in derselben Reihenfolge und mit
+  // denselben Zustaenden wie LoadIntoGraphicsCardMemory(), aber ohne etwas in den Grafikspeicher zu laden.
+  void SammleSoftwareDraws(float pixelProMeter, float vereinfachungPixel, const SichtVolumen& sicht, std::vector<SoftwareDraw>* draws);
   void FreeGraphicsCardMemory();
+  // Anzahl der beim letzten LoadIntoGraphicsCardMemory() verworfenen Subsets (pro Render-Objekt gezaehlt)
+  size_t VerworfeneSubsets() const { return m_VerworfeneSubsets; }
 
  private:
-  std::vector<std::unique_ptr<Zusi>> m_Ls3Dateien;
+  // Haengt die Datei und (rekursiv) alle verknuepften Dateien in Zusi-Zeichenreihenfolge an result an.
+  bool LoeseAuf(const zusixml::ZusiPfad& dateiname, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, AufgeloesteLandschaft* result);
+  // Erzeugt ein Render-Objekt fuer die Datei oder fuegt eine Instanz zu einem bestehenden hinzu,
+  // wenn sich dadurch das Bild nicht aendert.
+  void FuegeHinzu(const std::shared_ptr<const Ls3Datei>& datei, const glm::mat4& transform, const std::unordered_map<int, float>& ani_positionen, const LichterSchaltung& lichterSchaltung);
+  // Bringt die Render-Objekte in Zeichenreihenfolge.
+  void SortiereNachZOffset();
+
+  std::vector<std::shared_ptr<const Ls3Datei>> m_Ls3Dateien;
   std::vector<std::unique_ptr<RenderObject>> m_RenderObjects;
+  // Vertex- und Indexdaten aller Render-Objekte
+  std::unique_ptr<MeshBuffer> m_MeshBuffer;
+  // Aus den Render-Objekten kompilierte, sortierte Draw-Aufrufe
+  std::unique_ptr<DrawList> m_DrawList;
+  // Kandidaten fuer instanziertes Zeichnen wiederholt verwendeter Dateien
+  std::unordered_map<const Ls3Datei*, std::vector<Ls3RenderObject*>> m_RenderObjectsByFile;
+  // Render-Objekte mit Instanzen, die UpdateBoundingBox() noch nicht beruecksichtigt hat
+  std::vector<Ls3RenderObject*> m_NeueInstanzen;
+  // Es gibt Render-Objekte, die noch nicht im Grafikspeicher liegen oder noch nicht einsortiert sind.
+  bool m_Dirty;
+  // Aufloesung, fuer die die Texturen der initialisierten Render-Objekte geladen sind
+  float m_TexturPixelProMeter;
+  // Vereinfachung, mit der die initialisierten Render-Objekte geladen sind
+  float m_VereinfachungPixel;
+  // Ausschnitt, fuer den die Draw-Liste kompiliert ist
+  std::optional<SichtVolumen> m_Sicht;
+  size_t m_VerworfeneSubsets;
 };
 
 }
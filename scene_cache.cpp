@@ -0,0 +1,447 @@
+#include "./scene_cache.hpp"
+
+#include "./filesystem.hpp"
+#include "./ls3_cache.hpp"
+#include "./mapped_file.hpp"
+
+#include "zusi_parser/zusi_types.hpp"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+constexpr char MAGIC[4] = { 'L', 'S', '3', 'S' };
+// Bei jeder Aenderung des Formats oder der Bedeutung gespeicherter Werte erhoehen.
+constexpr uint32_t VERSION = 3;
+
+// FNV-1a, 64 Bit
+class Hash {
+ public:
+  void add(const void* daten, size_t groesse) {
+    const auto* bytes = static_cast<const unsigned char*>(daten);
+    for (size_t i = 0; i < groesse; i++) {
+      m_wert = (m_wert ^ bytes[i]) * 0x100000001b3ULL;
+    }
+  }
+
+  template <typename T>
+  void add(const T& wert) {
+    add(&wert, sizeof(T));
+  }
+
+  void add(const std::string& wert) {
+    add(static_cast<uint64_t>(wert.size()));
+    add(wert.data(), wert.size());
+  }
+
+  uint64_t wert() const { return m_wert; }
+
+ private:
+  uint64_t m_wert { 0xcbf29ce484222325ULL };
+};
+
+class Schreiber {
+ public:
+  template <typename T>
+  void schreibe(const T& wert) {
+    schreibe(&wert, sizeof(T));
+  }
+
+  void schreibe(const void* daten, size_t groesse) {
+    const auto* bytes = static_cast<const char*>(daten);
+    m_puffer.insert(std::end(m_puffer), bytes, bytes + groesse);
+  }
+
+  void schreibe(const std::string& wert) {
+    schreibe(static_cast<uint32_t>(wert.size()));
+    schreibe(wert.data(), wert.size());
+  }
+
+  // Geometrie wird auf 4 Byte ausgerichtet abgelegt
+  void richteAus() {
+    m_puffer.resize((m_puffer.size() + 3) & ~static_cast<size_t>(3), '\0');
+  }
+
+  const std::vector<char>& puffer() const { return m_puffer; }
+
+ private:
+  std::vector<char> m_puffer;
+};
+
+// Liest sequentiell aus der gemappten Datei. Nach dem ersten Lesefehler bleibt ok() false.
+class Leser {
+ public:
+  Leser(const unsigned char* daten, size_t groesse) : m_pos(daten), m_ende(daten + groesse) {}
+
+  template <typename T>
+  T lies() {
+    T result {};
+    if (const unsigned char* p = nimm(sizeof(T))) {
+      std::memcpy(&result, p, sizeof(T));
+    }
+    return result;
+  }
+
+  std::string liesString() {
+    const auto laenge = lies<uint32_t>();
+    const unsigned char* p = nimm(laenge);
+    return p ? std::string(reinterpret_cast<const char*>(p), laenge) : std::string();
+  }
+
+  // Gibt einen Zeiger auf die naechsten groesse Bytes zurueck und ueberspringt sie; nullptr, wenn die Datei zu kurz ist.
+  const unsigned char* nimm(size_t groesse) {
+    if (!m_ok || groesse > static_cast<size_t>(m_ende - m_pos)) {
+      m_ok = false;
+      return nullptr;
+    }
+    const unsigned char* result = m_pos;
+    m_pos += groesse;
+    return result;
+  }
+
+  void richteAus(const unsigned char* anfang) {
+    const size_t offset = m_pos - anfang;
+    nimm(((offset + 3) & ~static_cast<size_t>(3)) - offset);
+  }
+
+  bool ok() const { return m_ok; }
+  bool amEnde() const { return m_pos == m_ende; }
+
+ private:
+  const unsigned char* m_pos;
+  const unsigned char* m_ende;
+  bool m_ok { true };
+};
+
+void schreibeStempel(Schreiber* schreiber, const DateiStempel& stempel) {
+  schreiber->schreibe(stempel.pfad);
+  schreiber->schreibe(stempel.groesse);
+  schreiber->schreibe(stempel.aenderungszeit);
+}
+
+bool aktuell(const std::vector<DateiStempel>& abhaengigkeiten) {
+  return std::all_of(std::begin(abhaengigkeiten), std::end(abhaengigkeiten), [](const DateiStempel& gespeichert) {
+    DateiStempel aktuell;
+    return stempel(gespeichert.pfad, &aktuell) && aktuell == gespeichert;
+  });
+}
+
+}  // namespace
+
+SzenenCache* SzenenCache::instance() {
+  static std::unique_ptr<SzenenCache> instance = []() -> std::unique_ptr<SzenenCache> {
+    const char* verzeichnis = std::getenv("LS3RENDER_SZENENCACHE");
+    if (!verzeichnis || !*verzeichnis) {
+      return nullptr;
+    }
+    fs_error_code ec;
+    fs::create_directories(verzeichnis, ec);
+    if (ec) {
+      std::cerr << "Error creating scene cache directory " << verzeichnis << ": " << ec.message() << "\n";
+      return nullptr;
+    }
+    return std::unique_ptr<SzenenCache>(new SzenenCache(verzeichnis));
+  }();
+  return instance.get();
+}
+
+std::string SzenenCache::cachePfad(const std::string& os_pfad, const std::unordered_map<int, float>& ani_positionen) const {
+  DateiStempel wurzel;
+  if (!stempel(os_pfad, &wurzel)) {
+    return std::string();
+  }
+
+  std::vector<std::pair<int, float>> positionen(std::begin(ani_positionen), std::end(ani_positionen));
+  std::sort(std::begin(positionen), std::end(positionen));
+
+  Hash hash;
+  hash.add(VERSION);
+  hash.add(wurzel.pfad);
+  hash.add(static_cast<uint64_t>(positionen.size()));
+  for (const auto& [ani_id, position] : positionen) {
+    hash.add(ani_id);
+    hash.add(position);
+  }
+
+  std::ostringstream dateiname;
+  dateiname << std::hex;
+  dateiname.width(16);
+  dateiname.fill('0');
+  dateiname << hash.wert() << ".ls3s";
+  return (fs::path(m_verzeichnis) / dateiname.str()).string();
+}
+
+void SzenenCache::speichere(const std::string& os_pfad, const std::unordered_map<int, float>& ani_positionen, const AufgeloesteLandschaft& landschaft) const {
+  if (!landschaft.vollstaendig || landschaft.platzierungen.empty()) {
+    return;
+  }
+  const std::string pfad = cachePfad(os_pfad, ani_positionen);
+  if (pfad.empty()) {
+    return;
+  }
+
+  // Jede Datei nur einmal ablegen, Platzierungen verweisen ueber ihren Index darauf
+  std::vector<const Ls3Datei*> dateien;
+  std::unordered_map<const Ls3Datei*, uint32_t> indizes;
+  for (const auto& platzierung : landschaft.platzierungen) {
+    if (indizes.emplace(platzierung.datei.get(), static_cast<uint32_t>(dateien.size())).second) {
+      dateien.push_back(platzierung.datei.get());
+    }
+  }
+
+  // Die Stempel im Speicher stammen vom Laden. Hat sich eine Datei seitdem geaendert, passt der Inhalt
+  // nicht mehr zum aktuellen Stempel, dann nicht speichern (das naechste Laden liest die Datei neu).
+  std::vector<DateiStempel> abhaengigkeiten;
+  for (const auto* datei : dateien) {
+    abhaengigkeiten.push_back(datei->stempel);
+    if (!datei->lsb_stempel.pfad.empty()) {
+      abhaengigkeiten.push_back(datei->lsb_stempel);
+    }
+  }
+  if (!aktuell(abhaengigkeiten)) {
+    return;
+  }
+
+  // Die Animationspositionen sind Teil des Schluessels, daher koennen Subset-Animationen ausgewertet gespeichert werden.
+  Schreiber schreiber;
+  schreiber.schreibe(MAGIC, sizeof(MAGIC));
+  schreiber.schreibe(VERSION);
+  schreiber.schreibe(static_cast<uint32_t>(sizeof(Vertex)));
+  schreiber.schreibe(static_cast<uint32_t>(sizeof(Face)));
+
+  schreiber.schreibe(static_cast<uint32_t>(abhaengigkeiten.size()));
+  for (const auto& abhaengigkeit : abhaengigkeiten) {
+    schreibeStempel(&schreiber, abhaengigkeit);
+  }
+
+  schreiber.schreibe(static_cast<uint32_t>(dateien.size()));
+  for (const auto* datei : dateien) {
+    const std::vector<float> spur_positionen = datei->spurPositionen(ani_positionen);
+    schreiber.schreibe(static_cast<uint32_t>(datei->geometrie.size()));
+    for (size_t i = 0; i < datei->geometrie.size(); i++) {
+      const auto& material = datei->materialien[i];
+      const auto& geometrie = datei->geometrie[i];
+      schreiber.schreibe(static_cast<int32_t>(material.typLs3));
+      schreiber.schreibe(static_cast<int32_t>(material.texVoreinstellung));
+      schreiber.schreibe(static_cast<int32_t>(material.zBias));
+      schreiber.schreibe(material.diffuseColor);
+      schreiber.schreibe(material.emissiveColor);
+      schreiber.schreibe(static_cast<uint32_t>(material.texturen.size()));
+      for (const auto& textur : material.texturen) {
+        schreiber.schreibe(textur);
+      }
+
+      const std::optional<AniPunkt> animation = Ls3Datei::animation(datei->subset_animationen[i], spur_positionen);
+      schreiber.schreibe(static_cast<uint8_t>(animation.has_value()));
+      if (animation) {
+        schreiber.schreibe(glm::vec3(animation->p.x, animation->p.y, animation->p.z));
+        schreiber.schreibe(glm::vec4(animation->q.w, animation->q.x, animation->q.y, animation->q.z));
+      }
+
+      schreiber.schreibe(geometrie.aabbMin);
+      schreiber.schreibe(geometrie.aabbMax);
+      schreiber.schreibe(geometrie.uvDichte);
+      schreiber.schreibe(static_cast<uint64_t>(geometrie.anzahlVertices));
+      schreiber.schreibe(static_cast<uint64_t>(geometrie.anzahlFaces));
+      schreiber.richteAus();
+      schreiber.schreibe(geometrie.vertices, geometrie.vertexBytes());
+      schreiber.richteAus();
+      schreiber.schreibe(geometrie.faces, geometrie.faceBytes());
+      schreiber.richteAus();
+    }
+  }
+
+  schreiber.schreibe(static_cast<uint32_t>(landschaft.platzierungen.size()));
+  for (const auto& platzierung : landschaft.platzierungen) {
+    schreiber.schreibe(indizes[platzierung.datei.get()]);
+    schreiber.schreibe(platzierung.transform);
+  }
+
+  // Erst vollstaendig in eine temporaere Datei schreiben, damit parallel laufende Prozesse nie eine halbe Datei mappen.
+  // Thread-IDs sind nur innerhalb eines Prozesses eindeutig, deshalb gehoert auch die Prozess-ID in den Namen.
+  std::ostringstream temp_pfad;
+#ifdef _WIN32
+  temp_pfad << pfad << "." << _getpid() << "." << std::this_thread::get_id() << ".tmp";
+#else
+  temp_pfad << pfad << "." << getpid() << "." << std::this_thread::get_id() << ".tmp";
+#endif
+  {
+    std::ofstream out(temp_pfad.str(), std::ios::binary | std::ios::trunc);
+    out.write(schreiber.puffer().data(), schreiber.puffer().size());
+    if (!out) {
+      std::cerr << "Error writing scene cache file " << temp_pfad.str() << "\n";
+      return;
+    }
+  }
+  fs_error_code ec;
+  fs::rename(temp_pfad.str(), pfad, ec);
+  if (ec) {
+    std::cerr << "Error renaming scene cache file to " << pfad << ": " << ec.message() << "\n";
+    fs::remove(temp_pfad.str(), ec);
+    return;
+  }
+
+  // Weitere Ladevorgaenge in diesem Prozess verwenden die bereits geladenen Dateien statt der gerade geschriebenen
+  Eintrag eintrag;
+  if (!stempel(pfad, &eintrag.cache_datei)) {
+    return;
+  }
+  eintrag.abhaengigkeiten = std::move(abhaengigkeiten);
+  eintrag.landschaft = landschaft;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_geladen[pfad] = std::move(eintrag);
+}
+
+bool SzenenCache::lade(const std::string& os_pfad, const std::unordered_map<int, float>& ani_positionen, AufgeloesteLandschaft* result) const {
+  const std::string pfad = cachePfad(os_pfad, ani_positionen);
+  fs_error_code ec;
+  if (pfad.empty() || !fs::exists(pfad, ec)) {
+    return false;
+  }
+  Eintrag eintrag;
+  if (!stempel(pfad, &eintrag.cache_datei)) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_geladen.find(pfad);
+    if (it != std::end(m_geladen) && it->second.cache_datei == eintrag.cache_datei) {
+      if (!aktuell(it->second.abhaengigkeiten)) {
+        m_geladen.erase(it);
+        return false;
+      }
+      *result = it->second.landschaft;
+      return true;
+    }
+  }
+
+  std::shared_ptr<const GemappteDatei> datei = GemappteDatei::oeffne(pfad);
+  if (!datei) {
+    return false;
+  }
+  const unsigned char* anfang = datei->daten();
+  Leser leser(anfang, datei->groesse());
+
+  const unsigned char* magic = leser.nimm(sizeof(MAGIC));
+  if (!magic || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || leser.lies<uint32_t>() != VERSION
+      || leser.lies<uint32_t>() != sizeof(Vertex) || leser.lies<uint32_t>() != sizeof(Face)) {
+    return false;
+  }
+
+  // Veraltet, sobald sich eine der beteiligten Dateien geaendert hat
+  const auto n_abhaengigkeiten = leser.lies<uint32_t>();
+  for (uint32_t i = 0; i < n_abhaengigkeiten && leser.ok(); i++) {
+    DateiStempel gespeichert;
+    gespeichert.pfad = leser.liesString();
+    gespeichert.groesse = leser.lies<uint64_t>();
+    gespeichert.aenderungszeit = leser.lies<int64_t>();
+    eintrag.abhaengigkeiten.push_back(std::move(gespeichert));
+  }
+  if (!leser.ok() || !aktuell(eintrag.abhaengigkeiten)) {
+    return false;
+  }
+
+  const auto n_dateien = leser.lies<uint32_t>();
+  std::vector<std::shared_ptr<const Ls3Datei>> dateien;
+  for (uint32_t d = 0; d < n_dateien && leser.ok(); d++) {
+    auto ls3_datei = std::make_shared<Ls3Datei>();
+    ls3_datei->lsb = datei;
+    const auto n_subsets = leser.lies<uint32_t>();
+    for (uint32_t i = 0; i < n_subsets && leser.ok(); i++) {
+      SubsetMaterial material;
+      material.typLs3 = leser.lies<int32_t>();
+      material.texVoreinstellung = leser.lies<int32_t>();
+      material.zBias = leser.lies<int32_t>();
+      material.diffuseColor = leser.lies<glm::vec4>();
+      material.emissiveColor = leser.lies<glm::vec4>();
+      const auto n_texturen = leser.lies<uint32_t>();
+      for (uint32_t t = 0; t < n_texturen && leser.ok(); t++) {
+        material.texturen.push_back(leser.liesString());
+      }
+
+      AnimationsBindung animation;
+      if (leser.lies<uint8_t>()) {
+        const auto p = leser.lies<glm::vec3>();
+        const auto wxyz = leser.lies<glm::vec4>();
+        AniPunkt ani_punkt {};
+        ani_punkt.p = Vec3 { p.x, p.y, p.z };
+        ani_punkt.q = Quaternion { wxyz[0], wxyz[1], wxyz[2], wxyz[3] };
+        animation.fest = ani_punkt;
+      }
+
+      SubsetGeometrie geometrie;
+      geometrie.aabbMin = leser.lies<glm::vec3>();
+      geometrie.aabbMax = leser.lies<glm::vec3>();
+      geometrie.uvDichte[0] = leser.lies<float>();
+      geometrie.uvDichte[1] = leser.lies<float>();
+      const auto n_vertices = leser.lies<uint64_t>();
+      const auto n_faces = leser.lies<uint64_t>();
+      if (n_vertices > datei->groesse() / sizeof(Vertex) || n_faces > datei->groesse() / sizeof(Face)) {
+        return false;
+      }
+      geometrie.anzahlVertices = n_vertices;
+      geometrie.anzahlFaces = n_faces;
+      leser.richteAus(anfang);
+      geometrie.vertices = leser.nimm(geometrie.vertexBytes());
+      leser.richteAus(anfang);
+      geometrie.faces = leser.nimm(geometrie.faceBytes());
+      leser.richteAus(anfang);
+
+      ls3_datei->materialien.push_back(std::move(material));
+      ls3_datei->subset_animationen.push_back(std::move(animation));
+      ls3_datei->geometrie.push_back(geometrie);
+    }
+    dateien.push_back(std::move(ls3_datei));
+  }
+
+  const auto n_platzierungen = leser.lies<uint32_t>();
+  AufgeloesteLandschaft& landschaft = eintrag.landschaft;
+  for (uint32_t i = 0; i < n_platzierungen && leser.ok(); i++) {
+    const auto index = leser.lies<uint32_t>();
+    const auto transform = leser.lies<glm::mat4>();
+    if (index >= dateien.size()) {
+      return false;
+    }
+    landschaft.platzierungen.push_back(Platzierung { dateien[index], transform });
+  }
+
+  if (!leser.ok() || !leser.amEnde()) {
+    std::cerr << "Corrupt scene cache file " << pfad << "\n";
+    return false;
+  }
+  *result = landschaft;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_geladen[pfad] = std::move(eintrag);
+  return true;
+}
+
+void SzenenCache::leere() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_geladen.clear();
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "./filesystem.hpp"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ls3render {
+
+struct Ls3Datei;
+
+// Eine Datei an ihrer Stelle im Verknuepfungsbaum, Transformation relativ zur Wurzeldatei.
+struct Platzierung {
+  std::shared_ptr<const Ls3Datei> datei;
+  glm::mat4 transform;
+};
+
+// Vollstaendig aufgeloester Verknuepfungsbaum einer Datei fuer bestimmte Animationspositionen,
+// in Zeichenreihenfolge.
+struct AufgeloesteLandschaft {
+  std::vector<Platzierung> platzierungen;
+  // false, wenn eine verknuepfte Datei nicht geladen werden konnte. Solche Ergebnisse werden nicht gespeichert,
+  // damit der Fehler beim naechsten Laden wieder gemeldet wird.
+  bool vollstaendig { true };
+};
+
+// Optionaler Cache aufgeloester Verknuepfungsbaeume auf der Festplatte, eine Datei pro Wurzeldatei
+// und Satz Animationspositionen. Aktiv, wenn die Umgebungsvariable LS3RENDER_SZENENCACHE auf ein Verzeichnis zeigt.
+//
+// Eine Cache-Datei enthaelt alle Abhaengigkeiten (LS3- und LSB-Dateien mit Groesse und Aenderungszeit),
+// pro Datei Materialien, Bounding Boxes, ausgewertete Subset-Animationen und die Geometrie sowie
+// die Platzierungen. Sie wird beim Laden nur gemappt; die Geometrie wird direkt aus dem Mapping hochgeladen.
+class SzenenCache {
+ public:
+  // nullptr, wenn der Cache nicht aktiviert ist.
+  static SzenenCache* instance();
+
+  // Liest den Baum der Datei aus dem Cache. false, wenn kein aktueller Eintrag existiert.
+  // Die Abhaengigkeiten werden bei jedem Aufruf geprueft.
+  bool lade(const std::string& os_pfad, const std::unordered_map<int, float>& ani_positionen, AufgeloesteLandschaft* result) const;
+
+  // Schreibt den Baum der Datei in den Cache. Fehler werden nur gemeldet, der Cache ist optional.
+  void speichere(const std::string& os_pfad, const std::unordered_map<int, float>& ani_positionen, const AufgeloesteLandschaft& landschaft) const;
+
+  // Vergisst bereits gemappte Cache-Dateien. Noch verwendete Dateien bleiben bis dahin gueltig.
+  void leere();
+
+ private:
+  // Eine bereits gemappte Cache-Datei. Wiederholtes Laden liefert dieselben Ls3Datei-Objekte,
+  // so dass mehrfach vorkommende Fahrzeuge weiterhin instanziert gezeichnet werden.
+  struct Eintrag {
+    DateiStempel cache_datei;
+    std::vector<DateiStempel> abhaengigkeiten;
+    AufgeloesteLandschaft landschaft;
+  };
+
+  explicit SzenenCache(std::string verzeichnis) : m_verzeichnis(std::move(verzeichnis)) {}
+
+  // Pfad der Cache-Datei; leer, wenn die Wurzeldatei nicht existiert.
+  std::string cachePfad(const std::string& os_pfad, const std::unordered_map<int, float>& ani_positionen) const;
+
+  std::string m_verzeichnis;
+  mutable std::mutex m_mutex;
+  mutable std::unordered_map<std::string, Eintrag> m_geladen;
+};
+
+}
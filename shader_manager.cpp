@@ -3,6 +3,10 @@
 #include "macros.hpp"
 #include "shader_parameters.hpp"
 
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
 namespace {
 static const std::string vs_source =
 #include "./assets/vertex_shader.glsl"
@@ -88,27 +92,28 @@ struct ShaderManager::impl {
     m_ShaderParameters.attrib_uv2 = glGetAttribLocation(shader_program, "uv2");
 
     // Bind uniform variables
-    m_ShaderParameters.uni_nor = glGetUniformLocation(shader_program, "nor");
-    m_ShaderParameters.uni_model =
-        glGetUniformLocation(shader_program, "model");
-    m_ShaderParameters.uni_view = glGetUniformLocation(shader_program, "view");
-    m_ShaderParameters.uni_proj = glGetUniformLocation(shader_program, "proj");
+    m_ShaderParameters.uni_viewProj =
+        glGetUniformLocation(shader_program, "viewProj");
+    m_ShaderParameters.uni_instances =
+        glGetUniformLocation(shader_program, "instances");
     m_ShaderParameters.uni_tex.push_back(
         glGetUniformLocation(shader_program, "tex1"));
     m_ShaderParameters.uni_tex.push_back(
         glGetUniformLocation(shader_program, "tex2"));
-    m_ShaderParameters.uni_numTextures =
-        glGetUniformLocation(shader_program, "numTextures");
-    m_ShaderParameters.uni_diffuse_color =
-        glGetUniformLocation(shader_program, "diffuseColor");
-    m_ShaderParameters.uni_emissive_color =
-        glGetUniformLocation(shader_program, "emissiveColor");
-    m_ShaderParameters.uni_alphaCutoff =
-        glGetUniformLocation(shader_program, "alphaCutoff");
-    m_ShaderParameters.uni_texVoreinstellung =
-        glGetUniformLocation(shader_program, "texVoreinstellung");
+    m_ShaderParameters.block_drawDaten =
+        glGetUniformBlockIndex(shader_program, "DrawDaten");
 
     m_ShaderParameters.validate();
+
+    TRY(glUniform1i(m_ShaderParameters.uni_instances, kInstanceTextureUnit));
+    for (size_t i = 0; i < m_ShaderParameters.uni_tex.size(); i++) {
+      TRY(glUniform1i(m_ShaderParameters.uni_tex[i], i));
+    }
+    if (m_ShaderParameters.block_drawDaten != GL_INVALID_INDEX) {
+      TRY(glUniformBlockBinding(shader_program, m_ShaderParameters.block_drawDaten, kDrawDatenBinding));
+    }
+
+    TRY_CHECKPOINT("ShaderManager::init");
     return true;
   }
 
@@ -9,22 +9,20 @@
 
 namespace ls3render {
 
+// Textureinheit, an die der Buffer-Texture mit den Instanzdaten gebunden wird (tex1 und tex2 belegen 0 und 1).
+constexpr GLint kInstanceTextureUnit = 2;
+// Bindungspunkt des Uniform-Blocks DrawDaten.
+constexpr GLuint kDrawDatenBinding = 0;
+
 struct ShaderParameters {
   GLint attrib_pos;
   GLint attrib_nor;
   GLint attrib_uv1;
   GLint attrib_uv2;
-  GLint uni_nor;
-  GLint uni_model;
-  GLint uni_view;
-  GLint uni_proj;
-  GLint uni_shear;
+  GLint uni_viewProj;
+  GLint uni_instances;
   std::vector<GLint> uni_tex;
-  GLint uni_numTextures;
-  GLint uni_diffuse_color;
-  GLint uni_emissive_color;
-  GLint uni_alphaCutoff;
-  GLint uni_texVoreinstellung;
+  GLuint block_drawDaten;
 
   ShaderParameters() : uni_tex() {}
 
@@ -37,19 +35,14 @@ struct ShaderParameters {
     CHECK_MINUS_ONE(attrib_nor);
     CHECK_MINUS_ONE(attrib_uv1);
     CHECK_MINUS_ONE(attrib_uv2);
-    CHECK_MINUS_ONE(uni_nor);
-    CHECK_MINUS_ONE(uni_model);
-    CHECK_MINUS_ONE(uni_view);
-    CHECK_MINUS_ONE(uni_proj);
-    CHECK_MINUS_ONE(uni_shear);
+    CHECK_MINUS_ONE(uni_viewProj);
+    CHECK_MINUS_ONE(uni_instances);
     for (size_t i = 0; i < uni_tex.size(); i++) {
       CHECK_MINUS_ONE(uni_tex[i]);
     }
-    CHECK_MINUS_ONE(uni_numTextures);
-    CHECK_MINUS_ONE(uni_diffuse_color);
-    CHECK_MINUS_ONE(uni_emissive_color);
-    CHECK_MINUS_ONE(uni_alphaCutoff);
-    CHECK_MINUS_ONE(uni_texVoreinstellung);
+    if (block_drawDaten == GL_INVALID_INDEX) {
+      std::cerr << "Warning: Shader uniform block DrawDaten not found" << std::endl;
+    }
   }
 
 #undef CHECK_MINUS_ONE
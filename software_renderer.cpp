@@ -0,0 +1,762 @@
+#include "./software_renderer.hpp"
+
+#include "./ls3_cache.hpp"
+#include "./texture.hpp"
+#include "./texture_manager.hpp"
+#include "./thread_pool.hpp"
+
+#include "zusi_parser/zusi_types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ls3render {
+
+namespace {
+
+// Kantenlaenge der Kacheln in Pixeln
+constexpr int kKachel = 64;
+// Unterpixelgenauigkeit der Vertexpositionen (Bits), wie bei ueblichen GL-Implementierungen
+constexpr int kSubpixelBits = 8;
+constexpr int64_t kSubpixel = 1 << kSubpixelBits;
+// Vertices weiter ausserhalb werden auf diese Entfernung (Pixel) gezogen, damit die Kantenfunktionen nicht ueberlaufen
+constexpr float kMaxKoordinate = 1 << 20;
+constexpr uint32_t kMaxTiefe = (1u << 24) - 1;
+// GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT der verbreiteten Implementierungen
+constexpr float kMaxAnisotropie = 16;
+// Wie viele Texturen der Shader verwendet (tex1, tex2)
+constexpr size_t kMaxTexturen = 2;
+
+// Samplepositionen relativ zur Pixelmitte in 1/16 Pixel, wie die Standardmuster von Direct3D.
+// Wird eine andere Anzahl verlangt, wird wie bei GL die naechstgroessere verwendet (hoechstens 8).
+struct SampleMuster {
+  int anzahl;
+  int8_t x[8];
+  int8_t y[8];
+};
+constexpr SampleMuster kMuster[] = {
+  { 1, { 0 }, { 0 } },
+  { 2, { 4, -4 }, { 4, -4 } },
+  { 4, { -2, 6, -6, 2 }, { -6, -2, 2, 6 } },
+  { 8, { 1, -1, 5, -3, -5, -7, 3, 7 }, { -3, 3, 1, -5, 5, -1, 7, -7 } },
+};
+
+const SampleMuster& sampleMuster(int multisampling) {
+  for (const auto& muster : kMuster) {
+    if (muster.anzahl >= multisampling) {
+      return muster;
+    }
+  }
+  return kMuster[std::size(kMuster) - 1];
+}
+
+uint8_t alsUnorm8(float wert) {
+  return static_cast<uint8_t>(std::lround(std::clamp(wert, 0.0f, 1.0f) * 255.0f));
+}
+
+int64_t abrunden(int64_t wert, int64_t teiler) {
+  return wert >= 0 ? wert / teiler : -((-wert + teiler - 1) / teiler);
+}
+
+// S3TC-Dekodierung (DXT1/3/5) eines 4x4-Blocks nach rgba (16 Texel zeilenweise)
+uint16_t lese16(const unsigned char* daten) {
+  return static_cast<uint16_t>(daten[0] | (daten[1] << 8));
+}
+
+uint32_t lese32(const unsigned char* daten) {
+  return static_cast<uint32_t>(daten[0]) | (static_cast<uint32_t>(daten[1]) << 8)
+    | (static_cast<uint32_t>(daten[2]) << 16) | (static_cast<uint32_t>(daten[3]) << 24);
+}
+
+void dekodiereFarbe(const unsigned char* block, bool dxt1, uint8_t rgba[16][4]) {
+  const uint16_t c0 = lese16(block);
+  const uint16_t c1 = lese16(block + 2);
+  uint8_t palette[4][4];
+  const auto rgb565 = [](uint16_t c, uint8_t* ziel) {
+    const int r = (c >> 11) & 31;
+    const int g = (c >> 5) & 63;
+    const int b = c & 31;
+    ziel[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+    ziel[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+    ziel[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+    ziel[3] = 255;
+  };
+  rgb565(c0, palette[0]);
+  rgb565(c1, palette[1]);
+  // DXT3/5 verwenden immer vier Farben, DXT1 bei c0 <= c1 drei und transparentes Schwarz
+  if (!dxt1 || c0 > c1) {
+    for (int k = 0; k < 3; k++) {
+      palette[2][k] = static_cast<uint8_t>((2 * palette[0][k] + palette[1][k] + 1) / 3);
+      palette[3][k] = static_cast<uint8_t>((palette[0][k] + 2 * palette[1][k] + 1) / 3);
+    }
+    palette[2][3] = palette[3][3] = 255;
+  } else {
+    for (int k = 0; k < 3; k++) {
+      palette[2][k] = static_cast<uint8_t>((palette[0][k] + palette[1][k] + 1) / 2);
+      palette[3][k] = 0;
+    }
+    palette[2][3] = 255;
+    palette[3][3] = 0;
+  }
+  const uint32_t indizes = lese32(block + 4);
+  for (int i = 0; i < 16; i++) {
+    std::copy_n(palette[(indizes >> (2 * i)) & 3], 4, rgba[i]);
+  }
+}
+
+void dekodiereAlphaDxt3(const unsigned char* block, uint8_t rgba[16][4]) {
+  for (int i = 0; i < 16; i++) {
+    rgba[i][3] = static_cast<uint8_t>(((block[i / 2] >> (4 * (i % 2))) & 15) * 17);
+  }
+}
+
+void dekodiereAlphaDxt5(const unsigned char* block, uint8_t rgba[16][4]) {
+  const int a0 = block[0];
+  const int a1 = block[1];
+  int palette[8] = { a0, a1 };
+  if (a0 > a1) {
+    for (int k = 1; k < 7; k++) {
+      palette[k + 1] = ((7 - k) * a0 + k * a1 + 3) / 7;
+    }
+  } else {
+    for (int k = 1; k < 5; k++) {
+      palette[k + 1] = ((5 - k) * a0 + k * a1 + 2) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+  uint64_t indizes = 0;
+  for (int b = 0; b < 6; b++) {
+    indizes |= static_cast<uint64_t>(block[2 + b]) << (8 * b);
+  }
+  for (int i = 0; i < 16; i++) {
+    rgba[i][3] = static_cast<uint8_t>(palette[(indizes >> (3 * i)) & 7]);
+  }
+}
+
+}  // namespace
+
+struct SoftwareRenderer::Textur {
+  struct Stufe {
+    int breite;
+    int hoehe;
+    std::vector<uint8_t> rgba;  // Zeile 0 ist t = 0, wie beim Hochladen der DDS-Daten
+  };
+  // Ab der Basis-Stufe, wie im GL-Pfad hochgeladen
+  std::vector<Stufe> stufen;
+
+  // Nur bis zum Dekodieren gesetzt
+  std::shared_ptr<const DdsDaten> quelle;
+  size_t basis { 0 };
+
+  void dekodiere() {
+    const bool dxt1 = quelle->format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    const size_t block_groesse = dxt1 ? 8 : 16;
+    for (size_t s = basis; s < quelle->mipStufen.size(); s++) {
+      const auto& mip = quelle->mipStufen[s];
+      Stufe stufe { static_cast<int>(mip.width), static_cast<int>(mip.height), {} };
+      stufe.rgba.resize(static_cast<size_t>(stufe.breite) * stufe.hoehe * 4);
+      const int bloecke_x = (stufe.breite + 3) / 4;
+      const int bloecke_y = (stufe.hoehe + 3) / 4;
+      for (int by = 0; by < bloecke_y; by++) {
+        for (int bx = 0; bx < bloecke_x; bx++) {
+          const unsigned char* block = mip.daten + (static_cast<size_t>(by) * bloecke_x + bx) * block_groesse;
+          uint8_t texel[16][4];
+          if (dxt1) {
+            dekodiereFarbe(block, true, texel);
+          } else {
+            dekodiereFarbe(block + 8, false, texel);
+            if (quelle->format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT) {
+              dekodiereAlphaDxt3(block, texel);
+            } else {
+              dekodiereAlphaDxt5(block, texel);
+            }
+          }
+          for (int i = 0; i < 16; i++) {
+            const int x = bx * 4 + i % 4;
+            const int y = by * 4 + i / 4;
+            if (x < stufe.breite && y < stufe.hoehe) {
+              std::copy_n(texel[i], 4, &stufe.rgba[(static_cast<size_t>(y) * stufe.breite + x) * 4]);
+            }
+          }
+        }
+      }
+      stufen.push_back(std::move(stufe));
+    }
+    quelle.reset();
+  }
+
+  // GL_LINEAR mit GL_REPEAT
+  void bilinear(size_t s, float u, float v, float ergebnis[4]) const {
+    const Stufe& stufe = stufen[s];
+    if (!std::isfinite(u) || !std::isfinite(v)) {
+      u = v = 0;
+    }
+    const float fu = u * static_cast<float>(stufe.breite) - 0.5f;
+    const float fv = v * static_cast<float>(stufe.hoehe) - 0.5f;
+    const float iu = std::floor(fu);
+    const float iv = std::floor(fv);
+    const float a = fu - iu;
+    const float b = fv - iv;
+    const auto wickle = [](float i, int n) {
+      const int r = static_cast<int>(std::fmod(i, static_cast<float>(n)));
+      return r < 0 ? r + n : r;
+    };
+    const int x0 = wickle(iu, stufe.breite);
+    const int y0 = wickle(iv, stufe.hoehe);
+    const int x1 = x0 + 1 == stufe.breite ? 0 : x0 + 1;
+    const int y1 = y0 + 1 == stufe.hoehe ? 0 : y0 + 1;
+    const auto texel = [&stufe](int x, int y) { return &stufe.rgba[(static_cast<size_t>(y) * stufe.breite + x) * 4]; };
+    const uint8_t* t00 = texel(x0, y0);
+    const uint8_t* t10 = texel(x1, y0);
+    const uint8_t* t01 = texel(x0, y1);
+    const uint8_t* t11 = texel(x1, y1);
+    for (int k = 0; k < 4; k++) {
+      const float oben = t00[k] + (t10[k] - t00[k]) * a;
+      const float unten = t01[k] + (t11[k] - t01[k]) * a;
+      ergebnis[k] = (oben + (unten - oben) * b) * (1.0f / 255.0f);
+    }
+  }
+
+  // GL_LINEAR_MIPMAP_LINEAR (Vergroesserung GL_LINEAR) bei Detailstufe lambda
+  void trilinear(float u, float v, float lambda, float ergebnis[4]) const {
+    const size_t letzte = stufen.size() - 1;
+    if (!(lambda > 0.0f)) {
+      bilinear(0, u, v, ergebnis);
+      return;
+    }
+    if (lambda >= static_cast<float>(letzte)) {
+      bilinear(letzte, u, v, ergebnis);
+      return;
+    }
+    const size_t s = static_cast<size_t>(lambda);
+    const float f = lambda - static_cast<float>(s);
+    float feiner[4];
+    bilinear(s, u, v, feiner);
+    bilinear(s + 1, u, v, ergebnis);
+    for (int k = 0; k < 4; k++) {
+      ergebnis[k] = feiner[k] + (ergebnis[k] - feiner[k]) * f;
+    }
+  }
+};
+
+// Uniforms und Render-States eines Draws
+struct SoftwareRenderer::Zustand {
+  std::shared_ptr<const Textur> texturen[kMaxTexturen];
+  size_t anzahlTexturen;
+  float diffuse[4];
+  float emissive[3];
+  int texVoreinstellung;
+  float alphaCutoff;
+  int32_t polygonOffset;
+  bool blend;
+};
+
+// Ein sichtbares Dreieck in Fensterkoordinaten des ganzen Bildes (Ursprung unten links)
+struct SoftwareRenderer::Dreieck {
+  uint32_t zustand;
+  // Eckpunkte gegen den Uhrzeigersinn, in 1/kSubpixel Pixel
+  int32_t x[3];
+  int32_t y[3];
+  // Betroffene Pixel (inklusive, auf das Bild begrenzt)
+  int32_t minX, minY, maxX, maxY;
+  // Tiefe (0..1) an Pixelposition (x, y): z0 + zdx * x + zdy * y
+  double z0, zdx, zdy;
+  // Normale, UV1 und UV2 an (x, y): wert + dx * (x - bx) + dy * (y - by)
+  float bx, by;
+  float wert[7], dx[7], dy[7];
+  // Pro Textur die Detailstufe und fuer anisotrope Filterung die Anzahl und den Abstand (in UV)
+  // der Abtastungen entlang der laengeren Achse des Pixels in der Textur.
+  // Bei Parallelprojektion sind die Ableitungen der Texturkoordinaten im ganzen Dreieck gleich.
+  struct Filter {
+    float lambda;
+    int proben;
+    float du, dv;
+  } filter[kMaxTexturen];
+};
+
+namespace {
+
+// Anisotrope Filterung nach EXT_texture_filter_anisotropic: bis zu kMaxAnisotropie trilineare Abtastungen
+// entlang der laengeren Achse, Detailstufe nach der Ausdehnung quer dazu.
+template <typename Textur, typename Filter>
+void tasteAb(const Textur& textur, const Filter& filter, float u, float v, float ergebnis[4]) {
+  if (filter.proben <= 1) {
+    textur.trilinear(u, v, filter.lambda, ergebnis);
+    return;
+  }
+  float summe[4] = { 0, 0, 0, 0 };
+  for (int i = 0; i < filter.proben; i++) {
+    const float t = (static_cast<float>(i) + 0.5f) / static_cast<float>(filter.proben) - 0.5f;
+    float probe[4];
+    textur.trilinear(u + filter.du * t, v + filter.dv * t, filter.lambda, probe);
+    for (int k = 0; k < 4; k++) {
+      summe[k] += probe[k];
+    }
+  }
+  for (int k = 0; k < 4; k++) {
+    ergebnis[k] = summe[k] / static_cast<float>(filter.proben);
+  }
+}
+
+}  // namespace
+
+SoftwareRenderer::SoftwareRenderer() = default;
+SoftwareRenderer::~SoftwareRenderer() = default;
+
+std::shared_ptr<const SoftwareRenderer::Textur> SoftwareRenderer::textur(const std::string& pfad, float uvProPixel, std::vector<std::shared_ptr<Textur>>* neu) {
+  std::shared_ptr<const DdsDaten> dds = DdsCache::instance().lade(pfad);
+  if (!dds) {
+    return nullptr;
+  }
+  const size_t stufe = basisStufe(*dds, uvProPixel);
+
+  // Die groebste dekodierte Fassung, die noch fein genug ist (wie im TextureManager)
+  auto& fassungen = m_texturen[pfad];
+  auto it = fassungen.upper_bound(stufe);
+  if (it != std::begin(fassungen)) {
+    return std::prev(it)->second;
+  }
+
+  auto textur = std::make_shared<Textur>();
+  textur->quelle = std::move(dds);
+  textur->basis = stufe;
+  neu->push_back(textur);
+  fassungen.emplace(stufe, textur);
+  return textur;
+}
+
+bool SoftwareRenderer::bereiteVor(const std::vector<SoftwareDraw>& draws, const glm::mat4& viewProj, int breite, int hoehe, int multisampling) {
+  m_breite = breite;
+  m_hoehe = hoehe;
+  m_samples = sampleMuster(multisampling).anzahl;
+  m_kachelnX = (breite + kKachel - 1) / kKachel;
+  const int kacheln_y = (hoehe + kKachel - 1) / kKachel;
+  m_zustaende.clear();
+  m_dreiecke.clear();
+  m_kacheln.assign(static_cast<size_t>(m_kachelnX) * kacheln_y, {});
+
+  // Zustaende und Texturen; neue Texturen werden danach parallel dekodiert
+  std::vector<std::shared_ptr<Textur>> neu;
+  bool ok = true;
+  m_zustaende.reserve(draws.size());
+  for (const auto& draw : draws) {
+    Zustand zustand {};
+    zustand.anzahlTexturen = std::min(draw.texturen->size(), kMaxTexturen);
+    for (size_t t = 0; ok && t < zustand.anzahlTexturen; t++) {
+      zustand.texturen[t] = textur((*draw.texturen)[t], draw.uvProPixel[t], &neu);
+      if (!zustand.texturen[t]) {
+        std::cerr << "Loading image " << (*draw.texturen)[t] << " failed" << std::endl;
+        ok = false;
+      }
+    }
+    if (!ok) {
+      break;
+    }
+    for (int k = 0; k < 4; k++) {
+      zustand.diffuse[k] = draw.diffuseColor[k];
+    }
+    for (int k = 0; k < 3; k++) {
+      zustand.emissive[k] = draw.emissiveColor[k];
+    }
+    zustand.texVoreinstellung = draw.texVoreinstellung;
+    zustand.alphaCutoff = draw.alphaCutoff;
+    zustand.polygonOffset = static_cast<int32_t>(std::lround(draw.polygonOffset));
+    zustand.blend = draw.blend;
+    m_zustaende.push_back(std::move(zustand));
+  }
+  {
+    // Auch bei Fehlschlag, die neuen Texturen stehen bereits im Cache
+    AufgabenGruppe gruppe;
+    for (const auto& textur : neu) {
+      gruppe.starte([textur]() { textur->dekodiere(); });
+    }
+  }
+  if (!ok) {
+    m_zustaende.clear();
+    m_kacheln.clear();
+    return false;
+  }
+
+  // Vertex-Transformation und Dreiecks-Setup parallel pro Draw
+  std::vector<std::vector<Dreieck>> dreiecke(draws.size());
+  {
+    AufgabenGruppe gruppe;
+    for (size_t d = 0; d < draws.size(); d++) {
+      gruppe.starte([this, &draws, &viewProj, &dreiecke, d]() {
+        const SoftwareDraw& draw = draws[d];
+        const Zustand& zustand = m_zustaende[d];
+        const SubsetGeometrie& geometrie = *draw.geometrie;
+        const glm::mat4 transform = viewProj * draw.model;
+
+        struct Eckpunkt {
+          int32_t x, y;
+          double z;
+          float attribute[7];
+        };
+        std::vector<Eckpunkt> eckpunkte(geometrie.anzahlVertices);
+        for (size_t i = 0; i < geometrie.anzahlVertices; i++) {
+          const Vertex vertex = geometrie.vertex(i);
+          const glm::vec4 clip = transform * glm::vec4(vertex.p.x, vertex.p.y, vertex.p.z, 1.0f);
+          const glm::vec4 normale = draw.nor * glm::vec4(vertex.n.x, vertex.n.y, vertex.n.z, 0.0f);
+          const auto fenster = [](float ndc, int groesse) {
+            const float pixel = (ndc + 1.0f) * 0.5f * static_cast<float>(groesse);
+            return static_cast<int32_t>(std::lround(std::clamp(pixel, -kMaxKoordinate, kMaxKoordinate) * kSubpixel));
+          };
+          auto& eckpunkt = eckpunkte[i];
+          eckpunkt.x = fenster(clip.x / clip.w, m_breite);
+          eckpunkt.y = fenster(clip.y / clip.w, m_hoehe);
+          eckpunkt.z = (static_cast<double>(clip.z) / clip.w + 1.0) * 0.5;
+          const float attribute[7] = { normale.x, normale.y, normale.z, vertex.U, vertex.V, vertex.U2, vertex.V2 };
+          std::copy_n(attribute, 7, eckpunkt.attribute);
+        }
+
+        auto& ergebnis = dreiecke[d];
+        for (size_t f = 0; f < geometrie.anzahlFaces; f++) {
+          const Face face = geometrie.face(f);
+          if (face.i[0] >= eckpunkte.size() || face.i[1] >= eckpunkte.size() || face.i[2] >= eckpunkte.size()) {
+            continue;
+          }
+          // Vorderseiten sind im Uhrzeigersinn (glFrontFace(GL_CW)), fuer die Kantenfunktionen umdrehen
+          const Eckpunkt* e[3] = { &eckpunkte[face.i[0]], &eckpunkte[face.i[2]], &eckpunkte[face.i[1]] };
+          const int64_t flaeche = static_cast<int64_t>(e[1]->x - e[0]->x) * (e[2]->y - e[0]->y)
+            - static_cast<int64_t>(e[2]->x - e[0]->x) * (e[1]->y - e[0]->y);
+          if (flaeche <= 0) {
+            continue;
+          }
+          // Ganz vor der Near- oder hinter der Far-Plane
+          if ((e[0]->z < 0 && e[1]->z < 0 && e[2]->z < 0) || (e[0]->z > 1 && e[1]->z > 1 && e[2]->z > 1)) {
+            continue;
+          }
+
+          Dreieck dreieck {};
+          dreieck.zustand = static_cast<uint32_t>(d);
+          for (int k = 0; k < 3; k++) {
+            dreieck.x[k] = e[k]->x;
+            dreieck.y[k] = e[k]->y;
+          }
+          dreieck.minX = static_cast<int32_t>(std::max<int64_t>(0, abrunden(std::min({ e[0]->x, e[1]->x, e[2]->x }), kSubpixel)));
+          dreieck.minY = static_cast<int32_t>(std::max<int64_t>(0, abrunden(std::min({ e[0]->y, e[1]->y, e[2]->y }), kSubpixel)));
+          dreieck.maxX = static_cast<int32_t>(std::min<int64_t>(m_breite - 1, abrunden(std::max({ e[0]->x, e[1]->x, e[2]->x }), kSubpixel)));
+          dreieck.maxY = static_cast<int32_t>(std::min<int64_t>(m_hoehe - 1, abrunden(std::max({ e[0]->y, e[1]->y, e[2]->y }), kSubpixel)));
+          if (dreieck.minX > dreieck.maxX || dreieck.minY > dreieck.maxY) {
+            continue;
+          }
+
+          // Ebenengleichungen der Attribute ueber den eingerasterten Eckpunkten
+          const double x0 = static_cast<double>(e[0]->x) / kSubpixel;
+          const double y0 = static_cast<double>(e[0]->y) / kSubpixel;
+          const double x1 = static_cast<double>(e[1]->x) / kSubpixel - x0;
+          const double y1 = static_cast<double>(e[1]->y) / kSubpixel - y0;
+          const double x2 = static_cast<double>(e[2]->x) / kSubpixel - x0;
+          const double y2 = static_cast<double>(e[2]->y) / kSubpixel - y0;
+          const double det = x1 * y2 - x2 * y1;
+          const auto ebene = [&](double w0, double w1, double w2, double* ddx, double* ddy) {
+            *ddx = ((w1 - w0) * y2 - (w2 - w0) * y1) / det;
+            *ddy = ((w2 - w0) * x1 - (w1 - w0) * x2) / det;
+          };
+          ebene(e[0]->z, e[1]->z, e[2]->z, &dreieck.zdx, &dreieck.zdy);
+          dreieck.z0 = e[0]->z - dreieck.zdx * x0 - dreieck.zdy * y0;
+          dreieck.bx = static_cast<float>(x0);
+          dreieck.by = static_cast<float>(y0);
+          for (int a = 0; a < 7; a++) {
+            double ddx, ddy;
+            ebene(e[0]->attribute[a], e[1]->attribute[a], e[2]->attribute[a], &ddx, &ddy);
+            dreieck.wert[a] = e[0]->attribute[a];
+            dreieck.dx[a] = static_cast<float>(ddx);
+            dreieck.dy[a] = static_cast<float>(ddy);
+          }
+
+          for (size_t t = 0; t < zustand.anzahlTexturen; t++) {
+            // Textur 1 mit UV1 (Attribute 3, 4), Textur 2 mit UV2 (Attribute 5, 6)
+            const auto& basis = zustand.texturen[t]->stufen.front();
+            const int a = 3 + 2 * static_cast<int>(t);
+            const float ux = dreieck.dx[a] * static_cast<float>(basis.breite);
+            const float vx = dreieck.dx[a + 1] * static_cast<float>(basis.hoehe);
+            const float uy = dreieck.dy[a] * static_cast<float>(basis.breite);
+            const float vy = dreieck.dy[a + 1] * static_cast<float>(basis.hoehe);
+            const float px = std::sqrt(ux * ux + vx * vx);
+            const float py = std::sqrt(uy * uy + vy * vy);
+            const float p_max = std::max(px, py);
+            const float p_min = std::min(px, py);
+            auto& filter = dreieck.filter[t];
+            filter.proben = static_cast<int>(p_min > 0 ? std::min(std::ceil(p_max / p_min), kMaxAnisotropie) : (p_max > 0 ? kMaxAnisotropie : 1));
+            filter.lambda = p_max > 0 ? std::log2(p_max / static_cast<float>(filter.proben)) : -std::numeric_limits<float>::infinity();
+            filter.du = px >= py ? dreieck.dx[a] : dreieck.dy[a];
+            filter.dv = px >= py ? dreieck.dx[a + 1] : dreieck.dy[a + 1];
+          }
+          ergebnis.push_back(dreieck);
+        }
+      });
+    }
+  }
+
+  // Verteilen auf die Kacheln in Zeichenreihenfolge
+  size_t anzahl = 0;
+  for (const auto& liste : dreiecke) {
+    anzahl += liste.size();
+  }
+  if (anzahl > std::numeric_limits<uint32_t>::max()) {
+    std::cerr << "Too many triangles for software rendering\n";
+    m_kacheln.clear();
+    return false;
+  }
+  m_dreiecke.reserve(anzahl);
+  for (auto& liste : dreiecke) {
+    for (const auto& dreieck : liste) {
+      const auto index = static_cast<uint32_t>(m_dreiecke.size());
+      for (int ky = dreieck.minY / kKachel; ky <= dreieck.maxY / kKachel; ky++) {
+        for (int kx = dreieck.minX / kKachel; kx <= dreieck.maxX / kKachel; kx++) {
+          m_kacheln[static_cast<size_t>(ky) * m_kachelnX + kx].push_back(index);
+        }
+      }
+      m_dreiecke.push_back(dreieck);
+    }
+    liste = {};
+  }
+  return true;
+}
+
+void SoftwareRenderer::zeichne(int ersteZeile, int anzahlZeilen, unsigned char* ziel) const {
+  const int letzte_zeile = std::min(ersteZeile + anzahlZeilen, m_hoehe);
+  AufgabenGruppe gruppe;
+  for (int ky = ersteZeile / kKachel; ky * kKachel < letzte_zeile; ky++) {
+    for (int kx = 0; kx < m_kachelnX; kx++) {
+      const size_t kachel = static_cast<size_t>(ky) * m_kachelnX + kx;
+      gruppe.starte([this, kachel, ersteZeile, letzte_zeile, ziel]() {
+        zeichneKachel(kachel, ersteZeile, letzte_zeile, ziel);
+      });
+    }
+  }
+  gruppe.warte();
+}
+
+void SoftwareRenderer::zeichneKachel(size_t kachel, int ersteZeile, int letzteZeile, unsigned char* ziel) const {
+  const int kachel_x = static_cast<int>(kachel % m_kachelnX) * kKachel;
+  const int kachel_y = static_cast<int>(kachel / m_kachelnX) * kKachel;
+  const int von_x = kachel_x;
+  const int bis_x = std::min(kachel_x + kKachel, m_breite);
+  const int von_y = std::max(kachel_y, ersteZeile);
+  const int bis_y = std::min(kachel_y + kKachel, letzteZeile);
+  if (von_y >= bis_y) {
+    return;
+  }
+
+  const SampleMuster& muster = sampleMuster(m_samples);
+  const int samples = muster.anzahl;
+  // RGBA8 und 24-Bit-Tiefe pro Sample, geloescht auf (0, 0, 0, 0) und 1
+  std::vector<uint32_t> farbe(static_cast<size_t>(kKachel) * kKachel * samples, 0);
+  std::vector<uint32_t> tiefe(farbe.size(), kMaxTiefe);
+  const auto sample_index = [&](int x, int y) {
+    return (static_cast<size_t>(y - kachel_y) * kKachel + (x - kachel_x)) * samples;
+  };
+
+  // Samplepositionen in 1/kSubpixel bzw. in Pixeln relativ zur Pixelmitte
+  constexpr int64_t kMusterSchritt = kSubpixel / 16;
+  for (const uint32_t index : m_kacheln[kachel]) {
+    const Dreieck& dreieck = m_dreiecke[index];
+    const Zustand& zustand = m_zustaende[dreieck.zustand];
+    const int x0 = std::max<int>(dreieck.minX, von_x);
+    const int x1 = std::min<int>(dreieck.maxX, bis_x - 1);
+    const int y0 = std::max<int>(dreieck.minY, von_y);
+    const int y1 = std::min<int>(dreieck.maxY, bis_y - 1);
+    if (x0 > x1 || y0 > y1) {
+      continue;
+    }
+
+    // Kantenfunktionen a * x + b * y + c >= 0 im Inneren; Kanten, die nicht oben oder links liegen,
+    // gehoeren nicht zum Dreieck (Top-Left-Regel), damit benachbarte Dreiecke kein Sample doppelt treffen
+    int64_t a[3], b[3], c[3];
+    int64_t sample_delta[8][3];
+    for (int k = 0; k < 3; k++) {
+      const int n = (k + 1) % 3;
+      a[k] = static_cast<int64_t>(dreieck.y[k]) - dreieck.y[n];
+      b[k] = static_cast<int64_t>(dreieck.x[n]) - dreieck.x[k];
+      c[k] = -(a[k] * dreieck.x[k] + b[k] * dreieck.y[k]);
+      const bool oben_links = a[k] > 0 || (a[k] == 0 && b[k] < 0);
+      if (!oben_links) {
+        c[k] -= 1;
+      }
+      for (int s = 0; s < samples; s++) {
+        sample_delta[s][k] = a[k] * muster.x[s] * kMusterSchritt + b[k] * muster.y[s] * kMusterSchritt;
+      }
+    }
+    double z_delta[8];
+    for (int s = 0; s < samples; s++) {
+      z_delta[s] = dreieck.zdx * muster.x[s] / 16.0 + dreieck.zdy * muster.y[s] / 16.0;
+    }
+
+    for (int y = y0; y <= y1; y++) {
+      const int64_t mitte_y = static_cast<int64_t>(y) * kSubpixel + kSubpixel / 2;
+      int64_t kante[3];
+      for (int k = 0; k < 3; k++) {
+        kante[k] = a[k] * (static_cast<int64_t>(x0) * kSubpixel + kSubpixel / 2) + b[k] * mitte_y + c[k];
+      }
+      for (int x = x0; x <= x1; x++, kante[0] += a[0] * kSubpixel, kante[1] += a[1] * kSubpixel, kante[2] += a[2] * kSubpixel) {
+        unsigned int maske = 0;
+        for (int s = 0; s < samples; s++) {
+          const bool innen = kante[0] + sample_delta[s][0] >= 0 && kante[1] + sample_delta[s][1] >= 0 && kante[2] + sample_delta[s][2] >= 0;
+          maske |= static_cast<unsigned int>(innen) << s;
+        }
+        if (!maske) {
+          continue;
+        }
+
+        // Tiefentest pro Sample; Samples vor der Near- oder hinter der Far-Plane sind weggeclippt
+        const size_t basis = sample_index(x, y);
+        const double mitte_z = dreieck.z0 + dreieck.zdx * (x + 0.5) + dreieck.zdy * (y + 0.5);
+        uint32_t sample_tiefe[8];
+        for (int s = 0; s < samples; s++) {
+          if (!(maske & (1u << s))) {
+            continue;
+          }
+          const double z = mitte_z + z_delta[s];
+          if (!(z >= 0.0 && z <= 1.0)) {
+            maske &= ~(1u << s);
+            continue;
+          }
+          const int64_t d = std::llround(z * kMaxTiefe) + zustand.polygonOffset;
+          sample_tiefe[s] = static_cast<uint32_t>(std::clamp<int64_t>(d, 0, kMaxTiefe));
+          if (!(sample_tiefe[s] < tiefe[basis + s])) {
+            maske &= ~(1u << s);
+          }
+        }
+        if (!maske) {
+          continue;
+        }
+
+        // Fragment-Shader, einmal pro Pixel in der Pixelmitte
+        const float fx = static_cast<float>(x) + 0.5f - dreieck.bx;
+        const float fy = static_cast<float>(y) + 0.5f - dreieck.by;
+        float attribute[7];
+        for (int k = 0; k < 7; k++) {
+          attribute[k] = dreieck.wert[k] + dreieck.dx[k] * fx + dreieck.dy[k] * fy;
+        }
+
+        // Ohne Textur bindet auch der GL-Pfad eine weisse Textur
+        float tex[4] = { 1, 1, 1, 1 };
+        if (zustand.anzahlTexturen > 0) {
+          tasteAb(*zustand.texturen[0], dreieck.filter[0], attribute[3], attribute[4], tex);
+        }
+        if (tex[3] < zustand.alphaCutoff) {
+          continue;
+        }
+        if (zustand.texVoreinstellung == 3 && zustand.anzahlTexturen > 1) {
+          // Tex 1 Standard, Tex 2 transparent
+          float tex2[4];
+          tasteAb(*zustand.texturen[1], dreieck.filter[1], attribute[5], attribute[6], tex2);
+          const float alpha2 = tex2[3];
+          for (int k = 0; k < 4; k++) {
+            tex[k] += (tex2[k] - tex[k]) * alpha2;
+          }
+        }
+
+        constexpr float kAmbient = 0.4f;
+        constexpr float kLicht = 0.70710678f;  // normalize(vec3(0, 1, 1))
+        const float kd = std::max(0.0f, kAmbient + (1 - kAmbient) * (kLicht * attribute[1] + kLicht * attribute[2]));
+        float basis_farbe[4] = { kd * zustand.diffuse[0], kd * zustand.diffuse[1], kd * zustand.diffuse[2], zustand.diffuse[3] };
+        for (int k = 0; k < 3; k++) {
+          basis_farbe[k] += zustand.emissive[k];
+        }
+
+        float ausgabe[4];
+        const int tv = zustand.texVoreinstellung;
+        if (tv == 4 || (tv >= 6 && tv <= 9)) {
+          // Halbtransparenz
+          if (zustand.anzahlTexturen == 0) {
+            std::copy_n(basis_farbe, 4, ausgabe);
+          } else {
+            for (int k = 0; k < 3; k++) {
+              ausgabe[k] = tex[k] * basis_farbe[k];
+            }
+            ausgabe[3] = tex[3];
+          }
+        } else {
+          for (int k = 0; k < 3; k++) {
+            ausgabe[k] = tex[k] * basis_farbe[k];
+          }
+          ausgabe[3] = 1.0f;
+        }
+        for (float& wert : ausgabe) {
+          wert = std::clamp(wert, 0.0f, 1.0f);
+        }
+
+        const auto packe = [](const float rgba[4]) {
+          return static_cast<uint32_t>(alsUnorm8(rgba[0])) | (static_cast<uint32_t>(alsUnorm8(rgba[1])) << 8)
+            | (static_cast<uint32_t>(alsUnorm8(rgba[2])) << 16) | (static_cast<uint32_t>(alsUnorm8(rgba[3])) << 24);
+        };
+        const uint32_t gepackt = packe(ausgabe);
+        for (int s = 0; s < samples; s++) {
+          if (!(maske & (1u << s))) {
+            continue;
+          }
+          tiefe[basis + s] = sample_tiefe[s];
+          if (!zustand.blend) {
+            farbe[basis + s] = gepackt;
+            continue;
+          }
+          // glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA)
+          const uint32_t vorher = farbe[basis + s];
+          float gemischt[4];
+          for (int k = 0; k < 4; k++) {
+            const float dst = static_cast<float>((vorher >> (8 * k)) & 0xff) * (1.0f / 255.0f);
+            gemischt[k] = (k < 3 ? ausgabe[k] * ausgabe[3] : ausgabe[3]) + dst * (1.0f - ausgabe[3]);
+          }
+          farbe[basis + s] = packe(gemischt);
+        }
+      }
+    }
+  }
+
+  // Resolve (Mittelwert der Samples) und Ausgabe als BGRA
+  for (int y = von_y; y < bis_y; y++) {
+    unsigned char* zeile = ziel + (static_cast<size_t>(y - ersteZeile) * m_breite + von_x) * 4;
+    for (int x = von_x; x < bis_x; x++, zeile += 4) {
+      const size_t basis = sample_index(x, y);
+      uint32_t summe[4] = { 0, 0, 0, 0 };
+      for (int s = 0; s < samples; s++) {
+        for (int k = 0; k < 4; k++) {
+          summe[k] += (farbe[basis + s] >> (8 * k)) & 0xff;
+        }
+      }
+      const auto kanal = [&](int k) { return static_cast<unsigned char>((summe[k] + samples / 2) / samples); };
+      zeile[0] = kanal(2);
+      zeile[1] = kanal(1);
+      zeile[2] = kanal(0);
+      zeile[3] = kanal(3);
+    }
+  }
+}
+
+size_t SoftwareRenderer::evictUnused() {
+  size_t result = 0;
+  for (auto it = std::begin(m_texturen); it != std::end(m_texturen); ) {
+    auto& fassungen = it->second;
+    for (auto fassung = std::begin(fassungen); fassung != std::end(fassungen); ) {
+      if (fassung->second.use_count() == 1) {
+        fassung = fassungen.erase(fassung);
+        ++result;
+      } else {
+        ++fassung;
+      }
+    }
+    if (fassungen.empty()) {
+      it = m_texturen.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return result;
+}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ls3render {
+
+struct SubsetGeometrie;
+
+// Ein Subset einer Instanz mit denselben Uniforms und Render-States, die der GL-Pfad in DrawRecord setzt.
+struct SoftwareDraw {
+  const SubsetGeometrie* geometrie;
+  // Haelt vereinfachte Geometrie am Leben (sonst leer, die Datei gehoert der Szene)
+  std::shared_ptr<const void> halter;
+  glm::mat4 model;  // Instanz * Subset-Transformation
+  glm::mat4 nor;
+  const std::vector<std::string>* texturen;
+  // Groesste Aenderung von UV1 bzw. UV2 pro Ausgabepixel (0: unbekannt), bestimmt die feinste Mip-Stufe
+  float uvProPixel[2];
+  glm::vec4 diffuseColor;
+  glm::vec4 emissiveColor;
+  int texVoreinstellung;
+  float alphaCutoff;
+  float polygonOffset;  // Einheiten wie bei glPolygonOffset
+  bool blend;
+};
+
+// Zeichnet die Szene ohne OpenGL auf der CPU, wie die Shader in assets/ mit den Render-States aus
+// DrawList::render: Tiefentest GL_LESS auf einem 24-Bit-Tiefenpuffer, Backface-Culling (Vorderseite im
+// Uhrzeigersinn), Alpha-Test, Alpha-Blending und Multisampling, Texturen trilinear und anisotrop gefiltert.
+// Das Ergebnis stimmt bis auf Rundungsunterschiede mit dem GL-Pfad ueberein.
+// Die Dreiecke werden einmal auf Kacheln verteilt, die Kacheln dann parallel im ThreadPool gezeichnet.
+// Dekodierte Texturen bleiben wie beim TextureManager bis evictUnused() geladen.
+class SoftwareRenderer {
+ public:
+  SoftwareRenderer();
+  ~SoftwareRenderer();
+  SoftwareRenderer(const SoftwareRenderer&) = delete;
+  SoftwareRenderer& operator=(const SoftwareRenderer&) = delete;
+
+  // Bereitet ein Bild der Groesse breite x hoehe vor: dekodiert die Texturen, transformiert die Vertices
+  // mit viewProj (ganzes Bild) und verteilt die Dreiecke auf die Kacheln. draws muss nur waehrend des Aufrufs
+  // gueltig bleiben. false, wenn eine Textur nicht geladen werden kann.
+  bool bereiteVor(const std::vector<SoftwareDraw>& draws, const glm::mat4& viewProj, int breite, int hoehe, int multisampling);
+
+  // Zeichnet die Zeilen ab ersteZeile (von unten) des vorbereiteten Bildes im Format von ls3render_Render nach ziel.
+  void zeichne(int ersteZeile, int anzahlZeilen, unsigned char* ziel) const;
+
+  // Gibt alle dekodierten Texturen frei, die kein vorbereitetes Bild mehr verwendet.
+  // @return Die Anzahl der freigegebenen Texturen.
+  size_t evictUnused();
+
+ private:
+  struct Textur;
+  struct Zustand;
+  struct Dreieck;
+
+  // Die Textur ab der fuer uvProPixel noetigen Mip-Stufe, bei Bedarf zum Dekodieren in neu eingetragen.
+  std::shared_ptr<const Textur> textur(const std::string& pfad, float uvProPixel, std::vector<std::shared_ptr<Textur>>* neu);
+  void zeichneKachel(size_t kachel, int ersteZeile, int letzteZeile, unsigned char* ziel) const;
+
+  // Pro Pfad die dekodierten Fassungen nach Basis-Mip-Stufe
+  std::unordered_map<std::string, std::map<size_t, std::shared_ptr<const Textur>>> m_texturen;
+
+  // Das vorbereitete Bild
+  int m_breite { 0 };
+  int m_hoehe { 0 };
+  int m_samples { 1 };
+  int m_kachelnX { 0 };
+  std::vector<Zustand> m_zustaende;
+  std::vector<Dreieck> m_dreiecke;
+  // Pro Kachel die Indizes der Dreiecke in Zeichenreihenfolge
+  std::vector<std::vector<uint32_t>> m_kacheln;
+};
+
+}
@@ -1,16 +1,19 @@
 #pragma once
 
 #include "./macros.hpp"
+#include "./mapped_file.hpp"
 
 #define GLEW_STATIC
 #include <GL/glew.h>
 
-#include <cassert>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -42,139 +45,123 @@ struct DDS_HEADER {
   uint32_t           dwReserved2;
 };
 
+static_assert(sizeof(DDS_HEADER) == 124, "Wrong size of DDS_HEADER");
+
 }
 
+// Eine Mip-Stufe innerhalb der gemappten DDS-Datei.
+struct DdsMipStufe {
+  unsigned int width;
+  unsigned int height;
+  const unsigned char* daten;
+  unsigned int size;
+};
+
+// Inhalt einer DDS-Datei, unabhaengig von einem GL-Kontext. Kann von mehreren Kontexten hochgeladen werden.
+// Die Mip-Stufen zeigen direkt in die gemappte Datei und sind gegen deren Groesse geprueft.
+struct DdsDaten {
+  unsigned int format;
+  std::vector<DdsMipStufe> mipStufen;
+  std::unique_ptr<ls3render::GemappteDatei> datei;
+};
+
 class Texture {
 public:
-  bool readDDS(const std::string& filename){
-		  #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-		  #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-		  #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
-
-                  DDS_HEADER header { };
-
-		  FILE *fp;
-
-		  // Try to open file
-		  fp = fopen(filename.c_str(),"rb");
-		  if (fp == NULL){
-				  printf("ERROR::TEXTURE::FILE_NOT_FOUND::%s\n", filename.c_str());
-				  return false;
-		  }
-
-                  fseek(fp, 0, SEEK_END);
-                  unsigned int fileSize = ftell(fp);
-                  rewind(fp);
-
-		  // check magic
-		  char filecode[4];
-		  fread(&filecode,1,4,fp);
-		  if(strncmp(filecode,"DDS ",4) != 0){
-				  printf("ERROR::TEXTURE::NOT_VALID_DDS_FORMAT(\n");
-				  return false;
-		  }
-
-		  unsigned char* buffer;
-		  unsigned int bufSize;
-
-		  fread(&header,1,124,fp);
-		  // los file parametres
-		  assert(header.dwSize == 124);
-                  assert((header.ddspf.dwFlags & 0x4) == 0x4); // fourCC available
-
-#if 0
-                  // https://github.com/svn2github/fs2open/blob/c6d35120e8372c2c74270c85a9e7d88709086278/tags/fs2_open_3_6_7/fs2_open/code/ddsutils/ddsutils.cpp#L71
-                  // did I mention lately that I hate Microsoft?
-                  // this is here to fix the situation where Microsoft doesn't follow their own docs
-                  if (header.dwPitchOrLinearSize <= 0) {
-                    if (header.dwDepth == 0) {
-                      header.dwDepth = 1;
-                    }
-                    // calculate the block size, mult by 8 for DXT1, 16 for DXT3 & 5
-                    std::cerr << "calculating block size" << std::endl;
-                    bufSize = ((header.dwWidth + 3)/4) * ((header.dwHeight + 3)/4) * ((header.dwDepth + 3)/4) * ((header.ddspf.dwFourCC == FOURCC_DXT1) ? 8 : 16);
-                  } else {
-                    assert((header.dwFlags & 0x80000) == 0x80000);  // linearSize available
-                    std::cerr << "using block size" << std::endl;
-                    bufSize = header.dwMipMapCount > 1 ? header.dwPitchOrLinearSize * 2 : header.dwPitchOrLinearSize; // buffer size = linearsize ou le double si y'a des mipmap
-                  }
-#else
-                  bufSize = fileSize - 124 - 4;
-#endif
-                  assert(bufSize != 0);
-
-		  buffer = new unsigned char[bufSize * sizeof(unsigned char)]; // on allocate la ram
-		  fread(buffer,1,bufSize,fp); // On lis le tout
-
-		  fclose(fp);
-
-		  // NOW we check what format that is... And make it compatible to OpenGL
-		  unsigned int format;
-		  switch(header.ddspf.dwFourCC){
-				  case FOURCC_DXT1:
-						  format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-						  break;
-				  case FOURCC_DXT3:
-						  format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-						  break;
-				  case FOURCC_DXT5:
-						  format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-						  break;
-				  default:
-						  delete[] buffer;
-						  printf("ERROR::TEXTURE::NOT_A_VALID_DXT_COMPRESSED_FILE\n");
-						  return false;
-		  }
-
-		  this->buffer = buffer;
-		  this->bufSize = bufSize;
-		  this->format = format;
-		  this->height = header.dwHeight;
-		  this->width = header.dwWidth;
-		  this->mipMapCount = std::max(1u, header.dwMipMapCount);  // 0: non-mipmapped texture
-
-		  return true;
+  static bool readDDS(const std::string& filename, DdsDaten* result){
+    constexpr uint32_t FOURCC_DXT1 = 0x31545844; // Equivalent to "DXT1" in ASCII
+    constexpr uint32_t FOURCC_DXT3 = 0x33545844; // Equivalent to "DXT3" in ASCII
+    constexpr uint32_t FOURCC_DXT5 = 0x35545844; // Equivalent to "DXT5" in ASCII
+    constexpr uint32_t DDPF_FOURCC = 0x4;
+
+    // Nicht vorab einlesen: Je nach Ausgabeaufloesung werden die feinen Mip-Stufen nie hochgeladen
+    auto datei = ls3render::GemappteDatei::oeffne(filename, false);
+    if (!datei) {
+      printf("ERROR::TEXTURE::FILE_NOT_FOUND::%s\n", filename.c_str());
+      return false;
+    }
+
+    // check magic
+    if (datei->groesse() < 4 + sizeof(DDS_HEADER) || std::memcmp(datei->daten(), "DDS ", 4) != 0) {
+      printf("ERROR::TEXTURE::NOT_VALID_DDS_FORMAT::%s\n", filename.c_str());
+      return false;
+    }
+
+    DDS_HEADER header;
+    std::memcpy(&header, datei->daten() + 4, sizeof(DDS_HEADER));
+    if (header.dwSize != sizeof(DDS_HEADER) || (header.ddspf.dwFlags & DDPF_FOURCC) == 0
+        || header.dwWidth == 0 || header.dwHeight == 0) {
+      printf("ERROR::TEXTURE::NOT_VALID_DDS_FORMAT::%s\n", filename.c_str());
+      return false;
+    }
+
+    // NOW we check what format that is... And make it compatible to OpenGL
+    switch(header.ddspf.dwFourCC){
+      case FOURCC_DXT1:
+        result->format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        break;
+      case FOURCC_DXT3:
+        result->format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        break;
+      case FOURCC_DXT5:
+        result->format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        break;
+      default:
+        printf("ERROR::TEXTURE::NOT_A_VALID_DXT_COMPRESSED_FILE::%s\n", filename.c_str());
+        return false;
+    }
+
+    // Mip-Stufen gegen die Dateigroesse pruefen. Fehlen hintere Stufen, werden nur die vorhandenen verwendet.
+    const unsigned int blockSize = (result->format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+    const unsigned int mipMapCount = std::max(1u, header.dwMipMapCount);  // 0: non-mipmapped texture
+    size_t offset = 4 + sizeof(DDS_HEADER);
+    unsigned int width = header.dwWidth;
+    unsigned int height = header.dwHeight;
+    result->mipStufen.clear();
+    for (unsigned int level = 0; level < mipMapCount; ++level) {
+      const size_t size = static_cast<size_t>((width+3)/4) * ((height+3)/4) * blockSize;
+      if (size > datei->groesse() - offset) {
+        break;
+      }
+      result->mipStufen.push_back(DdsMipStufe { width, height, datei->daten() + offset, static_cast<unsigned int>(size) });
+      offset += size;
+      if (width == 1 && height == 1) {
+        break;
+      }
+      width = std::max(1u, width / 2);
+      height = std::max(1u, height / 2);
+    }
+    if (result->mipStufen.empty()) {
+      printf("ERROR::TEXTURE::TRUNCATED_DDS_FILE::%s\n", filename.c_str());
+      return false;
+    }
+
+    result->datei = std::move(datei);
+    return true;
   }
 
-  bool load_DDS(const std::string& ddsFile){
-          if (!readDDS(ddsFile)) {
-            return false;
-          }
-
-	  // Time  to load it in opengl
-	  TRY(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
-
-	  // Fill  mipmaps
-	  unsigned int blockSize = (this->format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-	  unsigned int offset = 0;
-
-	  for (unsigned int level = 0; level < this->mipMapCount && (this->width || this->height); ++level){
-		  unsigned int size = ((this->width+3)/4)*((this->height+3)/4)*blockSize;
-		  TRY(glCompressedTexImage2D(GL_TEXTURE_2D,level,this->format,this->width,this->height,0,size,this->buffer + offset));
-
-		  offset += size;
-		  this->width /= 2;
-		  this->height /= 2;
-	  }
-
-	  TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT));
-	  TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT));
-	  TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR));
-	  TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,this->mipMapCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
-
-	  TRY(glBindTexture(GL_TEXTURE_2D, 0));
-
-	  delete[] this->buffer;
-
-          return true;
+  // Laedt die Daten in die aktuell an GL_TEXTURE_2D gebundene Textur, direkt aus der gemappten Datei.
+  // Mip-Stufen feiner als basisStufe werden weggelassen; basisStufe wird zur Stufe 0 der Textur.
+  static bool load_DDS(const DdsDaten& dds, size_t basisStufe = 0){
+    TRY(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
+    basisStufe = std::min(basisStufe, dds.mipStufen.size() - 1);
+    const GLint levels = static_cast<GLint>(dds.mipStufen.size() - basisStufe);
+    for (GLint level = 0; level < levels; ++level){
+      const auto& stufe = dds.mipStufen[basisStufe + level];
+      TRY(glCompressedTexImage2D(GL_TEXTURE_2D,level,dds.format,stufe.width,stufe.height,0,stufe.size,stufe.daten));
+    }
+
+    TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT));
+    TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT));
+    TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR));
+    TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+    // Sonst waere die Textur bei unvollstaendiger Mip-Kette nicht vollstaendig
+    TRY(glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,levels - 1));
+
+    TRY(glBindTexture(GL_TEXTURE_2D, 0));
+
+    TRY_CHECKPOINT("load_DDS");
+    return true;
   }
 
-private:
-		  unsigned int height;
-		  unsigned int width;
-		  unsigned int mipMapCount;
-		  unsigned int format;
-		  unsigned char* buffer;
-		  unsigned int bufSize;
-
 };
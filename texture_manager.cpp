@@ -0,0 +1,135 @@
+#include "./texture_manager.hpp"
+
+#include "./macros.hpp"
+#include "./texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ls3render {
+
+size_t basisStufe(const DdsDaten& dds, float uvProPixel) {
+  // Auf Stufe n kommen (Kantenlaenge / 2^n) * uvProPixel Texel auf ein Pixel, das soll nicht unter 1 fallen.
+  const auto& basis = dds.mipStufen.front();
+  const float texelProPixel = static_cast<float>(std::max(basis.width, basis.height)) * uvProPixel;
+  if (!(texelProPixel > 1.0f)) {
+    return 0;
+  }
+  return std::min(static_cast<size_t>(std::floor(std::log2(texelProPixel))), dds.mipStufen.size() - 1);
+}
+
+namespace {
+
+bool ladeTextur(const std::string& pfad, const DdsDaten& dds, size_t basisStufe, GLuint texture_id) {
+  TRY(glBindTexture(GL_TEXTURE_2D, texture_id));
+
+  // Vor load_DDS, das die Textur am Ende wieder abbindet
+  if (GLEW_EXT_texture_filter_anisotropic) {
+    // https://gamedev.stackexchange.com/a/69397
+    float aniso = 0.0f;
+    TRY(glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &aniso));
+    TRY(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso));
+  }
+
+  if (!Texture::load_DDS(dds, basisStufe)) {
+    std::cerr << "Uploading image " << pfad << " failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+DdsCache& DdsCache::instance() {
+  static DdsCache instance;
+  return instance;
+}
+
+std::shared_ptr<const DdsDaten> DdsCache::lade(const std::string& pfad) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_dateien.find(pfad);
+    if (it != std::end(m_dateien)) {
+      return it->second;
+    }
+  }
+
+  // Lesen ausserhalb des Locks, wie beim Ls3Cache
+#ifndef NDEBUG
+  std::cerr << "Loading image " << pfad << std::endl;
+#endif
+  auto dds = std::make_shared<DdsDaten>();
+  if (!Texture::readDDS(pfad, dds.get())) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_dateien.emplace(pfad, std::move(dds)).first->second;
+}
+
+void DdsCache::leere() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_dateien.clear();
+}
+
+GLTexture::~GLTexture() {
+  glDeleteTextures(1, &m_id);
+}
+
+TextureHandle TextureManager::get(const std::string& pfad, float uvProPixel) {
+  const auto dds = DdsCache::instance().lade(pfad);
+  if (!dds) {
+    std::cerr << "Loading image " << pfad << " failed" << std::endl;
+    return nullptr;
+  }
+  const size_t stufe = basisStufe(*dds, uvProPixel);
+
+  // Die groebste geladene Fassung, die noch fein genug ist
+  auto& fassungen = m_textures[pfad];
+  auto it = fassungen.upper_bound(stufe);
+  if (it != std::begin(fassungen)) {
+    return std::prev(it)->second;
+  }
+
+  GLuint texture_id;
+  glGenTextures(1, &texture_id);
+  auto texture = std::make_shared<const GLTexture>(texture_id);
+  if (!ladeTextur(pfad, *dds, stufe, texture_id)) {
+    return nullptr;
+  }
+
+  fassungen.emplace(stufe, texture);
+  return texture;
+}
+
+size_t TextureManager::evictUnused() {
+  size_t result = 0;
+  for (auto it = std::begin(m_textures); it != std::end(m_textures); ) {
+    auto& fassungen = it->second;
+    for (auto fassung = std::begin(fassungen); fassung != std::end(fassungen); ) {
+      if (fassung->second.use_count() == 1) {
+        fassung = fassungen.erase(fassung);
+        ++result;
+      } else {
+        ++fassung;
+      }
+    }
+    if (fassungen.empty()) {
+      it = m_textures.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return result;
+}
+
+void TextureManager::clear() {
+  m_textures.clear();
+}
+
+}
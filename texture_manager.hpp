@@ -0,0 +1,78 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct DdsDaten;
+
+namespace ls3render {
+
+// Feinste Mip-Stufe, die bei uvProPixel Texturkoordinaten pro Ausgabepixel (0: unbekannt) noch abgetastet wird.
+size_t basisStufe(const DdsDaten& dds, float uvProPixel);
+
+// Prozessweiter Cache gelesener DDS-Dateien. Die Texturmanager aller Kontexte laden
+// daraus hoch, so dass jede Datei nur einmal gelesen wird.
+class DdsCache {
+ public:
+  static DdsCache& instance();
+
+  // Gibt die Datei aus dem Cache zurueck oder liest sie. nullptr bei Fehlschlag.
+  std::shared_ptr<const DdsDaten> lade(const std::string& pfad);
+
+  void leere();
+
+ private:
+  DdsCache() = default;
+
+  std::mutex m_mutex;
+  std::unordered_map<std::string, std::shared_ptr<const DdsDaten>> m_dateien;
+};
+
+// Eine auf die Grafikkarte geladene Textur. Der GL-Texturname wird freigegeben,
+// sobald der letzte Verweis auf das Objekt verschwindet.
+class GLTexture {
+ public:
+  explicit GLTexture(GLuint id) : m_id(id) {}
+  ~GLTexture();
+  GLTexture(const GLTexture&) = delete;
+  GLTexture& operator=(const GLTexture&) = delete;
+
+  GLuint id() const { return m_id; }
+
+ private:
+  GLuint m_id;
+};
+
+using TextureHandle = std::shared_ptr<const GLTexture>;
+
+// Verwaltet die GL-Texturen pro (aufgeloestem) Dateipfad und Basis-Mip-Stufe.
+// Texturen bleiben ueber mehrere Render-Vorgaenge und ls3render_Reset hinweg geladen,
+// bis sie mit evictUnused() oder clear() entfernt werden.
+// Gehoert zu einem GL-Kontext und darf nur verwendet werden, wenn dieser aktiv ist.
+class TextureManager {
+ public:
+  // Liefert die Textur fuer den angegebenen Pfad und laedt sie bei Bedarf. nullptr bei Fehlschlag.
+  // uvProPixel: Groesste Aenderung der Texturkoordinaten pro Ausgabepixel (0: unbekannt). Mip-Stufen, die dabei
+  // nie abgetastet werden, werden nicht hochgeladen. Ist die Textur bereits mit einer mindestens so feinen
+  // Basis-Stufe geladen, wird diese verwendet, sonst wird eine feinere Fassung zusaetzlich geladen.
+  TextureHandle get(const std::string& pfad, float uvProPixel = 0.0f);
+
+  // Gibt alle Texturen frei, die ausserhalb des Texturmanagers nicht mehr verwendet werden.
+  // @return Die Anzahl der freigegebenen Texturen.
+  size_t evictUnused();
+
+  void clear();
+
+ private:
+  // Pro Pfad die geladenen Fassungen nach Basis-Mip-Stufe
+  std::unordered_map<std::string, std::map<size_t, TextureHandle>> m_textures;
+};
+
+}
@@ -0,0 +1,144 @@
+#include "./thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace ls3render {
+
+namespace {
+
+// Pool und Index des aufrufenden Threads, falls er zu einem Pool gehoert
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local size_t t_index = std::numeric_limits<size_t>::max();
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t anzahlThreads) {
+  anzahlThreads = std::max<size_t>(anzahlThreads, 1);
+  for (size_t i = 0; i < anzahlThreads; i++) {
+    m_schlangen.push_back(std::make_unique<Warteschlange>());
+  }
+  for (size_t i = 0; i < anzahlThreads; i++) {
+    m_threads.emplace_back(&ThreadPool::arbeite, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_beenden = true;
+  }
+  m_bedingung.notify_all();
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+}
+
+ThreadPool& ThreadPool::instance() {
+  static ThreadPool instance(std::thread::hardware_concurrency());
+  return instance;
+}
+
+void ThreadPool::starte(std::function<void()> aufgabe) {
+  const size_t index = (t_pool == this) ? t_index : (m_naechsteSchlange++ % m_schlangen.size());
+  {
+    // Vor dem Einreihen zaehlen, damit kein Thread eine Aufgabe holt, die noch nicht gezaehlt ist
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_anstehend;
+  }
+  {
+    auto& schlange = *m_schlangen[index];
+    std::lock_guard<std::mutex> lock(schlange.mutex);
+    schlange.aufgaben.push_back(std::move(aufgabe));
+  }
+  m_bedingung.notify_one();
+}
+
+bool ThreadPool::hole(size_t eigene, std::function<void()>* aufgabe) {
+  const size_t n = m_schlangen.size();
+  for (size_t i = 0; i < n; i++) {
+    auto& schlange = *m_schlangen[(eigene + i) % n];
+    std::lock_guard<std::mutex> lock(schlange.mutex);
+    if (schlange.aufgaben.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      *aufgabe = std::move(schlange.aufgaben.back());
+      schlange.aufgaben.pop_back();
+    } else {
+      *aufgabe = std::move(schlange.aufgaben.front());
+      schlange.aufgaben.pop_front();
+    }
+    std::lock_guard<std::mutex> lock_anstehend(m_mutex);
+    --m_anstehend;
+    return true;
+  }
+  return false;
+}
+
+bool ThreadPool::hilf() {
+  std::function<void()> aufgabe;
+  const size_t eigene = (t_pool == this) ? t_index : 0;
+  if (!hole(eigene, &aufgabe)) {
+    return false;
+  }
+  aufgabe();
+  return true;
+}
+
+void ThreadPool::arbeite(size_t index) {
+  t_pool = this;
+  t_index = index;
+  while (true) {
+    std::function<void()> aufgabe;
+    if (hole(index, &aufgabe)) {
+      aufgabe();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_bedingung.wait(lock, [this]() { return m_beenden || m_anstehend > 0; });
+    if (m_beenden) {
+      return;
+    }
+  }
+}
+
+void AufgabenGruppe::starte(std::function<void()> aufgabe) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_offen;
+  }
+  m_pool.starte([this, aufgabe = std::move(aufgabe)]() {
+    aufgabe();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_offen == 0) {
+      m_bedingung.notify_all();
+    }
+  });
+}
+
+void AufgabenGruppe::warte() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_offen == 0) {
+        return;
+      }
+    }
+    if (m_pool.hilf()) {
+      continue;
+    }
+    // Nichts mehr zu stehlen, die restlichen Aufgaben laufen gerade in anderen Threads
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_bedingung.wait_for(lock, std::chrono::milliseconds(1), [this]() { return m_offen == 0; });
+  }
+}
+
+}
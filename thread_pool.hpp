@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ls3render {
+
+// Thread-Pool mit einer Warteschlange pro Thread. Ein Thread arbeitet seine eigene Schlange
+// von hinten ab (zuletzt erzeugte Aufgaben zuerst, gut fuer rekursiv erzeugte Aufgaben)
+// und stiehlt, wenn sie leer ist, von vorne aus den Schlangen der anderen.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t anzahlThreads);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Prozessweiter Pool mit einem Thread pro Prozessorkern.
+  static ThreadPool& instance();
+
+  // Aus einem Pool-Thread in dessen eigene Schlange, sonst reihum verteilt.
+  void starte(std::function<void()> aufgabe);
+
+  // Fuehrt eine anstehende Aufgabe im aufrufenden Thread aus. false, wenn keine ansteht.
+  bool hilf();
+
+ private:
+  struct Warteschlange {
+    std::mutex mutex;
+    std::deque<std::function<void()>> aufgaben;
+  };
+
+  bool hole(size_t eigene, std::function<void()>* aufgabe);
+  void arbeite(size_t index);
+
+  std::vector<std::unique_ptr<Warteschlange>> m_schlangen;
+  std::vector<std::thread> m_threads;
+  std::atomic<size_t> m_naechsteSchlange { 0 };
+
+  std::mutex m_mutex;
+  std::condition_variable m_bedingung;
+  size_t m_anstehend { 0 };  // Aufgaben in allen Schlangen
+  bool m_beenden { false };
+};
+
+// Eine Gruppe von Aufgaben im Pool, auf deren Ende gewartet werden kann.
+// Der wartende Thread arbeitet dabei selbst Aufgaben ab, Aufgaben duerfen also weitere Aufgaben
+// in derselben Gruppe starten und auch selbst warten.
+class AufgabenGruppe {
+ public:
+  explicit AufgabenGruppe(ThreadPool& pool = ThreadPool::instance()) : m_pool(pool) {}
+  ~AufgabenGruppe() { warte(); }
+  AufgabenGruppe(const AufgabenGruppe&) = delete;
+  AufgabenGruppe& operator=(const AufgabenGruppe&) = delete;
+
+  void starte(std::function<void()> aufgabe);
+  void warte();
+
+ private:
+  ThreadPool& m_pool;
+  std::mutex m_mutex;
+  std::condition_variable m_bedingung;
+  size_t m_offen { 0 };
+};
+
+}